@@ -0,0 +1,883 @@
+/*
+ * NAS Monitor - shared configuration parser (libnasmon-config)
+ *
+ * The file is read with one read() and tokenized in place: lines, keys and
+ * values are spans into that buffer, and only what is kept gets copied.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-config.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_CONFIG_SIZE (1024 * 1024)
+
+typedef struct {
+    const char *start;
+    size_t len;
+} Span;
+
+#define MAX_INTERVAL 86400      // a day, in seconds
+#define MAX_MOUNT_TIMEOUT 3600
+
+static const struct {
+    const char *key;
+    size_t offset;
+    int min, max;
+} int_keys[] = {
+    { "home_ac_interval",      offsetof(MonitorConfig, home_ac_interval), 1, MAX_INTERVAL },
+    { "home_battery_interval", offsetof(MonitorConfig, home_battery_interval), 1, MAX_INTERVAL },
+    { "away_ac_interval",      offsetof(MonitorConfig, away_ac_interval), 1, MAX_INTERVAL },
+    { "away_battery_interval", offsetof(MonitorConfig, away_battery_interval), 1, MAX_INTERVAL },
+    { "min_check_interval",    offsetof(MonitorConfig, min_check_interval), 1, MAX_INTERVAL },
+    { "max_failed_attempts",   offsetof(MonitorConfig, max_failed_attempts), 1, 100 },
+    // A percentage; 0 turns the cutoff off
+    { "min_battery_level",     offsetof(MonitorConfig, min_battery_level), 0, 100 },
+    { "max_concurrency",       offsetof(MonitorConfig, max_concurrency), 1, 64 },
+    { "probe_timeout_ms",      offsetof(MonitorConfig, probe_timeout_ms), 1, 60000 },
+    // KiB, so up to 1 GiB
+    { "max_log_size",          offsetof(MonitorConfig, max_log_size), 1, 1024 * 1024 },
+    { "timer_slack",           offsetof(MonitorConfig, timer_slack), 1, 3600 },
+    { "stale_mount_timeout_ms", offsetof(MonitorConfig, stale_mount_timeout_ms), 1, 600000 },
+    { "dns_cache_ttl",         offsetof(MonitorConfig, dns_cache_ttl), 1, MAX_INTERVAL },
+    { "mount_timeout",         offsetof(MonitorConfig, mount_timeout), 1, MAX_MOUNT_TIMEOUT },
+};
+
+static const struct {
+    const char *key;
+    size_t offset;
+} bool_keys[] = {
+    { "enable_notifications", offsetof(MonitorConfig, enable_notifications) },
+    { "event_driven",         offsetof(MonitorConfig, event_driven) },
+    { "adaptive_schedule",    offsetof(MonitorConfig, adaptive_schedule) },
+    { "unmount_on_leave",     offsetof(MonitorConfig, unmount_on_leave) },
+    { "unmount_on_suspend",   offsetof(MonitorConfig, unmount_on_suspend) },
+    { "lean_memory",          offsetof(MonitorConfig, lean_memory) },
+    { "shared_probe",         offsetof(MonitorConfig, shared_probe) },
+};
+
+void config_set_defaults(MonitorConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->home_ac_interval = 15;
+    config->home_battery_interval = 60;
+    config->away_ac_interval = 180;
+    config->away_battery_interval = 600;
+    config->min_check_interval = 5;
+    config->max_failed_attempts = 3;
+    config->min_battery_level = 10;
+    config->max_concurrency = 4;
+    config->probe_timeout_ms = 500;
+    config->max_log_size = 1024;
+    config->timer_slack = 30;
+    config->stale_mount_timeout_ms = 2000;
+    config->dns_cache_ttl = 300;
+    config->mount_timeout = 30;
+    config->enable_notifications = true;
+    config->event_driven = true;
+    config->unmount_on_leave = true;
+    config->unmount_on_suspend = true;
+    config->shared_probe = true;
+}
+
+static Span span_trim(Span s) {
+    while (s.len > 0 && isspace((unsigned char)s.start[0])) {
+        s.start++;
+        s.len--;
+    }
+    while (s.len > 0 && isspace((unsigned char)s.start[s.len - 1])) {
+        s.len--;
+    }
+    return s;
+}
+
+static bool span_is(Span s, const char *literal) {
+    return strlen(literal) == s.len && memcmp(s.start, literal, s.len) == 0;
+}
+
+static char *span_dup(Span s) {
+    return strndup(s.start, s.len);
+}
+
+// Grows an array whenever count reaches a power of two (from 4 on), so
+// appends stay amortised O(1) without a capacity field next to each count
+static void *reserve(void *array, int count, size_t size) {
+    if (count != 0 && (count < 4 || (count & (count - 1)) != 0)) {
+        return array;
+    }
+    return realloc(array, (size_t)(count ? count * 2 : 4) * size);
+}
+
+static void add_issue(MonitorConfig *config, int line, const char *format, ...) {
+    ConfigIssue *issues = reserve(config->issues, config->issue_count, sizeof(ConfigIssue));
+    if (!issues) {
+        return;
+    }
+    config->issues = issues;
+
+    char *message = NULL;
+    va_list args;
+    va_start(args, format);
+    int ret = vasprintf(&message, format, args);
+    va_end(args);
+    if (ret < 0) {
+        return;
+    }
+
+    config->issues[config->issue_count].line = line;
+    config->issues[config->issue_count].message = message;
+    config->issue_count++;
+}
+
+// A plain decimal from min to max; no sign, unit or spaces
+static bool parse_int(Span value, int min, int max, int *out) {
+    long parsed = 0;
+
+    if (value.len == 0 || value.len > 9) {
+        return false;
+    }
+    for (size_t i = 0; i < value.len; i++) {
+        if (!isdigit((unsigned char)value.start[i])) {
+            return false;
+        }
+        parsed = parsed * 10 + (value.start[i] - '0');
+    }
+    if (parsed < min || parsed > max) {
+        return false;
+    }
+
+    *out = (int)parsed;
+    return true;
+}
+
+static bool parse_bool(Span value, bool *out) {
+    if (span_is(value, "true")) {
+        *out = true;
+    } else if (span_is(value, "false")) {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void free_list(char **items, int count) {
+    for (int i = 0; i < count; i++) {
+        free(items[i]);
+    }
+    free(items);
+}
+
+// Appends each comma-separated entry of value to items
+static void split_list(Span value, bool keep_empty, char ***items, int *count) {
+    const char *end = value.start + value.len;
+    const char *start = value.start;
+    for (;;) {
+        const char *comma = memchr(start, ',', (size_t)(end - start));
+        Span entry = span_trim((Span){ start, (size_t)((comma ? comma : end) - start) });
+
+        if (entry.len > 0 || keep_empty) {
+            char **grown = reserve(*items, *count, sizeof(char *));
+            if (!grown) {
+                return;
+            }
+            *items = grown;
+            (*items)[(*count)++] = span_dup(entry);
+        }
+
+        if (!comma) break;
+        start = comma + 1;
+    }
+}
+
+static void clear_networks(MonitorConfig *config) {
+    free_list(config->home_networks, config->network_count);
+    config->home_networks = NULL;
+    config->network_count = 0;
+}
+
+static void parse_networks(MonitorConfig *config, Span value) {
+    clear_networks(config);
+    if (value.len == 0) {
+        return;
+    }
+
+    // Empty entries are kept: a trailing comma means "wired counts as home"
+    split_list(value, true, &config->home_networks, &config->network_count);
+}
+
+// Returns NULL once the device is added, otherwise why it was not. A line
+// the parser would read as a comment, header or key cannot be a spec, since
+// it would not read back as one once saved.
+static const char *add_device(MonitorConfig *config, Span spec) {
+    spec = span_trim(spec);
+    const char *slash = memchr(spec.start, '/', spec.len);
+    if (!slash || slash == spec.start || slash == spec.start + spec.len - 1 ||
+        spec.start[0] == '#' || spec.start[0] == '[' || memchr(spec.start, '=', spec.len)) {
+        return "expected host/share";
+    }
+
+    for (int i = 0; i < config->device_count; i++) {
+        if (span_is(spec, config->devices[i].spec)) {
+            return "duplicate device";
+        }
+    }
+
+    NasDevice *devices = reserve(config->devices, config->device_count, sizeof(NasDevice));
+    if (!devices) {
+        return strerror(ENOMEM);
+    }
+    config->devices = devices;
+
+    NasDevice *device = &config->devices[config->device_count++];
+    device->spec = span_dup(spec);
+    device->host = strndup(spec.start, (size_t)(slash - spec.start));
+    device->share = strndup(slash + 1, (size_t)(spec.start + spec.len - slash - 1));
+    return NULL;
+}
+
+static void add_extra(MonitorConfig *config, Span section, Span key, Span value) {
+    ConfigEntry *extra = reserve(config->extra, config->extra_count, sizeof(ConfigEntry));
+    if (!extra) {
+        return;
+    }
+    config->extra = extra;
+
+    ConfigEntry *entry = &config->extra[config->extra_count++];
+    entry->section = span_dup(section);
+    entry->key = span_dup(key);
+    entry->value = span_dup(value);
+}
+
+static bool span_starts_with(Span s, const char *prefix) {
+    size_t len = strlen(prefix);
+    return s.len >= len && memcmp(s.start, prefix, len) == 0;
+}
+
+// aa:bb:cc:dd:ee:ff in either case, with ':' or '-'; normalised in place
+static bool normalize_mac(char *mac) {
+    if (strlen(mac) != 17) {
+        return false;
+    }
+    for (int i = 0; i < 17; i++) {
+        if (i % 3 == 2) {
+            if (mac[i] != ':' && mac[i] != '-') return false;
+            mac[i] = ':';
+        } else {
+            if (!isxdigit((unsigned char)mac[i])) return false;
+            mac[i] = (char)tolower((unsigned char)mac[i]);
+        }
+    }
+    return true;
+}
+
+// Returns false if value listed addresses but none of them was valid
+static bool parse_macs(MonitorConfig *config, int line, const char *key, Span value,
+                       char ***items, int *count) {
+    free_list(*items, *count);
+    *items = NULL;
+    *count = 0;
+    split_list(value, false, items, count);
+
+    int kept = 0;
+    for (int i = 0; i < *count; i++) {
+        if (normalize_mac((*items)[i])) {
+            (*items)[kept++] = (*items)[i];
+        } else {
+            add_issue(config, line, "%s: expected a MAC address like aa:bb:cc:dd:ee:ff, got \"%s\"",
+                      key, (*items)[i]);
+            free((*items)[i]);
+        }
+    }
+    bool listed = *count > 0;
+    *count = kept;
+    return kept > 0 || !listed;
+}
+
+// a.b.c.d/prefix, or a bare address for a /32
+static bool parse_subnet(const char *text, NetworkSubnet *subnet) {
+    char address[INET_ADDRSTRLEN];
+    const char *slash = strchr(text, '/');
+    size_t len = slash ? (size_t)(slash - text) : strlen(text);
+    if (len >= sizeof(address)) {
+        return false;
+    }
+    memcpy(address, text, len);
+    address[len] = '\0';
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, address, &addr) != 1) {
+        return false;
+    }
+
+    long prefix = 32;
+    if (slash) {
+        char *end;
+        errno = 0;
+        prefix = strtol(slash + 1, &end, 10);
+        if (errno || end == slash + 1 || *end || prefix < 0 || prefix > 32) {
+            return false;
+        }
+    }
+
+    subnet->mask = prefix ? UINT32_MAX << (32 - prefix) : 0;
+    subnet->network = ntohl(addr.s_addr) & subnet->mask;
+    return true;
+}
+
+static void free_subnets(NetworkSubnet *subnets, int count) {
+    for (int i = 0; i < count; i++) {
+        free(subnets[i].text);
+    }
+    free(subnets);
+}
+
+// Returns false if value listed subnets but none of them was valid
+static bool parse_subnets(MonitorConfig *config, int line, NetworkProfile *profile, Span value) {
+    free_subnets(profile->subnets, profile->subnet_count);
+    profile->subnets = NULL;
+    profile->subnet_count = 0;
+
+    char **items = NULL;
+    int count = 0;
+    split_list(value, false, &items, &count);
+
+    for (int i = 0; i < count; i++) {
+        NetworkSubnet subnet = { .text = items[i] };
+        if (!parse_subnet(items[i], &subnet)) {
+            add_issue(config, line, "subnet: expected an IPv4 address/prefix like 192.168.1.0/24, got \"%s\"",
+                      items[i]);
+            free(items[i]);
+            continue;
+        }
+
+        NetworkSubnet *subnets = reserve(profile->subnets, profile->subnet_count,
+                                         sizeof(NetworkSubnet));
+        if (!subnets) {
+            free(items[i]);
+            continue;
+        }
+        profile->subnets = subnets;
+        profile->subnets[profile->subnet_count++] = subnet;
+    }
+    free(items);
+    return profile->subnet_count > 0 || count == 0;
+}
+
+static void free_profile(NetworkProfile *profile) {
+    free(profile->name);
+    free(profile->ssid);
+    free_list(profile->connections, profile->connection_count);
+    free_subnets(profile->subnets, profile->subnet_count);
+    free_list(profile->bssids, profile->bssid_count);
+    free_list(profile->gateway_macs, profile->gateway_mac_count);
+    free_list(profile->devices, profile->device_count);
+}
+
+// Names end up in logs, status output and the shell script's variables
+static bool valid_profile_name(Span name) {
+    if (name.len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < name.len; i++) {
+        char c = name.start[i];
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The profile for a [profile:NAME] header, created on first sight; a
+// repeated header continues the same profile
+static NetworkProfile *find_profile(MonitorConfig *config, Span name) {
+    for (int i = 0; i < config->profile_count; i++) {
+        if (span_is(name, config->profiles[i].name)) {
+            return &config->profiles[i];
+        }
+    }
+    return NULL;
+}
+
+static void begin_profile(MonitorConfig *config, Span name, int line) {
+    if (!valid_profile_name(name)) {
+        add_issue(config, line, "profile name: expected letters, digits, '-', '_' or '.', got \"%.*s\"",
+                  (int)name.len, name.start);
+        return;
+    }
+    if (find_profile(config, name)) {
+        return;
+    }
+
+    NetworkProfile *profiles = reserve(config->profiles, config->profile_count,
+                                       sizeof(NetworkProfile));
+    if (!profiles) {
+        return;
+    }
+    config->profiles = profiles;
+
+    NetworkProfile *profile = &config->profiles[config->profile_count++];
+    memset(profile, 0, sizeof(*profile));
+    profile->name = span_dup(name);
+    profile->line = line;
+}
+
+static void set_profile_value(MonitorConfig *config, NetworkProfile *profile, Span section,
+                              Span key, Span value, int line) {
+    if (span_is(key, "ssid")) {
+        free(profile->ssid);
+        profile->ssid = span_dup(value);
+    } else if (span_is(key, "connection")) {
+        free_list(profile->connections, profile->connection_count);
+        profile->connections = NULL;
+        profile->connection_count = 0;
+        split_list(value, false, &profile->connections, &profile->connection_count);
+    } else if (span_is(key, "subnet")) {
+        // An empty list would match anywhere; the profile is dropped instead
+        profile->unusable |= !parse_subnets(config, line, profile, value);
+    } else if (span_is(key, "bssid")) {
+        profile->unusable |= !parse_macs(config, line, "bssid", value,
+                                         &profile->bssids, &profile->bssid_count);
+    } else if (span_is(key, "gateway_mac")) {
+        profile->unusable |= !parse_macs(config, line, "gateway_mac", value,
+                                         &profile->gateway_macs, &profile->gateway_mac_count);
+    } else if (span_is(key, "devices")) {
+        free_list(profile->devices, profile->device_count);
+        profile->devices = NULL;
+        profile->device_count = 0;
+        split_list(value, false, &profile->devices, &profile->device_count);
+    } else if (span_is(key, "home_ac_interval") || span_is(key, "home_battery_interval")) {
+        int *interval = span_is(key, "home_ac_interval") ? &profile->home_ac_interval
+                                                         : &profile->home_battery_interval;
+        if (!parse_int(value, 1, MAX_INTERVAL, interval)) {
+            add_issue(config, line, "%.*s: expected a number from 1 to %d, got \"%.*s\"",
+                      (int)key.len, key.start, MAX_INTERVAL, (int)value.len, value.start);
+        }
+    } else {
+        add_extra(config, section, key, value);
+    }
+}
+
+static bool lists_device(const MonitorConfig *config, const char *spec) {
+    for (int i = 0; i < config->device_count; i++) {
+        if (strcmp(config->devices[i].spec, spec) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Checks what can only be checked once the whole file is read: every
+// profile needs something to recognise its network by, and its devices
+// must be in [nas_devices].
+// A profile whose device list ends up empty is dropped rather than
+// silently widened to all devices.
+static void finish_profiles(MonitorConfig *config) {
+    int kept = 0;
+    for (int i = 0; i < config->profile_count; i++) {
+        NetworkProfile *profile = &config->profiles[i];
+        bool had_devices = profile->device_count > 0;
+
+        int devices = 0;
+        for (int d = 0; d < profile->device_count; d++) {
+            if (lists_device(config, profile->devices[d])) {
+                profile->devices[devices++] = profile->devices[d];
+            } else {
+                add_issue(config, profile->line, "profile %s: \"%s\" is not in [nas_devices]",
+                          profile->name, profile->devices[d]);
+                free(profile->devices[d]);
+            }
+        }
+        profile->device_count = devices;
+
+        const char *error = NULL;
+        if (profile->unusable) {
+            error = "no valid address in a bssid, gateway_mac or subnet list";
+        } else if (!profile->ssid && profile->connection_count == 0 && profile->subnet_count == 0) {
+            error = "no ssid, connection or subnet (use \"ssid=\" for any wired network)";
+        } else if (had_devices && devices == 0) {
+            error = "none of its devices are configured";
+        }
+        if (error) {
+            add_issue(config, profile->line, "profile %s: %s; ignored", profile->name, error);
+            free_profile(profile);
+            continue;
+        }
+        config->profiles[kept++] = *profile;
+    }
+    config->profile_count = kept;
+}
+
+// Like profile devices, only once every [nas_devices] line has been read
+static void finish_mount_timeouts(MonitorConfig *config) {
+    int kept = 0;
+    for (int i = 0; i < config->mount_timeout_count; i++) {
+        MountTimeout *timeout = &config->mount_timeouts[i];
+        if (lists_device(config, timeout->spec)) {
+            config->mount_timeouts[kept++] = *timeout;
+        } else {
+            add_issue(config, timeout->line, "mount_timeouts: \"%s\" is not in [nas_devices]",
+                      timeout->spec);
+            free(timeout->spec);
+        }
+    }
+    config->mount_timeout_count = kept;
+}
+
+// A later line for the same share replaces the earlier one
+static void set_mount_timeout(MonitorConfig *config, Span spec, Span value, int line) {
+    int seconds;
+    if (!parse_int(value, 1, MAX_MOUNT_TIMEOUT, &seconds)) {
+        add_issue(config, line, "%.*s: expected a number from 1 to %d, got \"%.*s\"",
+                  (int)spec.len, spec.start, MAX_MOUNT_TIMEOUT, (int)value.len, value.start);
+        return;
+    }
+
+    for (int i = 0; i < config->mount_timeout_count; i++) {
+        if (span_is(spec, config->mount_timeouts[i].spec)) {
+            config->mount_timeouts[i].seconds = seconds;
+            config->mount_timeouts[i].line = line;
+            return;
+        }
+    }
+
+    MountTimeout *timeouts = reserve(config->mount_timeouts, config->mount_timeout_count,
+                                     sizeof(MountTimeout));
+    if (!timeouts) {
+        return;
+    }
+    config->mount_timeouts = timeouts;
+    config->mount_timeouts[config->mount_timeout_count++] = (MountTimeout){
+        .spec = span_dup(spec),
+        .seconds = seconds,
+        .line = line,
+    };
+}
+
+static void set_value(MonitorConfig *config, Span section, Span key, Span value, int line) {
+    if (span_is(section, "mount_timeouts")) {
+        set_mount_timeout(config, key, value, line);
+        return;
+    }
+    if (span_starts_with(section, "profile:")) {
+        Span name = span_trim((Span){ section.start + 8, section.len - 8 });
+        NetworkProfile *profile = find_profile(config, name);
+        if (profile) {
+            set_profile_value(config, profile, section, key, value, line);
+        }
+        return;
+    }
+
+    if (span_is(key, "home_networks")) {
+        parse_networks(config, value);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(int_keys) / sizeof(int_keys[0]); i++) {
+        if (span_is(key, int_keys[i].key)) {
+            // Keep the previous value on garbage, like an unset key
+            if (!parse_int(value, int_keys[i].min, int_keys[i].max,
+                           (int *)((char *)config + int_keys[i].offset))) {
+                add_issue(config, line, "%s: expected a number from %d to %d, got \"%.*s\"",
+                          int_keys[i].key, int_keys[i].min, int_keys[i].max,
+                          (int)value.len, value.start);
+            }
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(bool_keys) / sizeof(bool_keys[0]); i++) {
+        if (span_is(key, bool_keys[i].key)) {
+            if (!parse_bool(value, (bool *)((char *)config + bool_keys[i].offset))) {
+                add_issue(config, line, "%s: expected true or false, got \"%.*s\"",
+                          bool_keys[i].key, (int)value.len, value.start);
+            }
+            return;
+        }
+    }
+
+    // Possibly from a newer version; carried along rather than rejected
+    add_extra(config, section, key, value);
+}
+
+void config_parse(MonitorConfig *config, const char *text, size_t length) {
+    const char *end = text + length;
+    Span section = { "", 0 };
+    int line_number = 0;
+
+    for (const char *p = text; p < end; ) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+
+        Span line = span_trim((Span){ p, (size_t)(eol - p) });
+        p = eol < end ? eol + 1 : end;
+        line_number++;
+
+        // Skip comments and empty lines
+        if (line.len == 0 || line.start[0] == '#') {
+            continue;
+        }
+
+        // Section headers
+        if (line.start[0] == '[') {
+            if (line.start[line.len - 1] != ']') {
+                add_issue(config, line_number, "unterminated section header");
+                continue;
+            }
+            section = span_trim((Span){ line.start + 1, line.len - 2 });
+            if (span_starts_with(section, "profile:")) {
+                begin_profile(config, span_trim((Span){ section.start + 8, section.len - 8 }),
+                              line_number);
+            }
+            continue;
+        }
+
+        const char *equals = memchr(line.start, '=', line.len);
+        if (!equals) {
+            if (span_is(section, "nas_devices")) {
+                const char *error = add_device(config, line);
+                if (error) {
+                    add_issue(config, line_number, "%s: \"%.*s\"",
+                              error, (int)line.len, line.start);
+                }
+            } else {
+                add_issue(config, line_number, "expected key=value");
+            }
+            continue;
+        }
+
+        Span key = span_trim((Span){ line.start, (size_t)(equals - line.start) });
+        Span value = span_trim((Span){ equals + 1, (size_t)(line.start + line.len - equals - 1) });
+        if (key.len == 0) {
+            add_issue(config, line_number, "missing key before '='");
+            continue;
+        }
+        set_value(config, section, key, value, line_number);
+    }
+
+    finish_profiles(config);
+    finish_mount_timeouts(config);
+}
+
+int config_load(MonitorConfig *config, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (st.st_size > MAX_CONFIG_SIZE) {
+        close(fd);
+        errno = EFBIG;
+        return -1;
+    }
+
+    char *text = malloc((size_t)st.st_size + 1);
+    if (!text) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    size_t length = 0;
+    while (length < (size_t)st.st_size) {
+        ssize_t n = read(fd, text + length, (size_t)st.st_size - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;  // shrank under us; parse what is there
+        }
+        length += (size_t)n;
+    }
+    close(fd);
+
+    config_parse(config, text, length);
+    free(text);
+    return 0;
+}
+
+void config_set_networks(MonitorConfig *config, const char *list) {
+    parse_networks(config, span_trim((Span){ list, strlen(list) }));
+}
+
+char *config_join_networks(const MonitorConfig *config) {
+    size_t length = 1;
+    for (int i = 0; i < config->network_count; i++) {
+        length += strlen(config->home_networks[i]) + 1;
+    }
+
+    char *list = malloc(length);
+    if (!list) {
+        return NULL;
+    }
+
+    char *p = list;
+    for (int i = 0; i < config->network_count; i++) {
+        if (i > 0) *p++ = ',';
+        size_t len = strlen(config->home_networks[i]);
+        memcpy(p, config->home_networks[i], len);
+        p += len;
+    }
+    *p = '\0';
+    return list;
+}
+
+bool config_add_device(MonitorConfig *config, const char *spec) {
+    return add_device(config, (Span){ spec, strlen(spec) }) == NULL;
+}
+
+static bool is_device_line(Span section, Span line) {
+    return span_is(section, "nas_devices") && line.len > 0 && line.start[0] != '#' &&
+           line.start[0] != '[' && !memchr(line.start, '=', line.len);
+}
+
+static bool spec_listed(Span line, const char *const *specs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (span_is(line, specs[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+char *config_edit_devices(const char *text, size_t length,
+                          const char *const *add, int add_count,
+                          const char *const *remove, int remove_count) {
+    const char *end = text + length;
+    Span section = { "", 0 };
+
+    // Additions go after the last device line of the last [nas_devices]
+    // section, or right below its header if it lists none
+    const char *insert = NULL;
+    for (const char *p = text; p < end; ) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *next = eol ? eol + 1 : end;
+        Span line = span_trim((Span){ p, (size_t)((eol ? eol : end) - p) });
+        p = next;
+
+        if (line.len > 0 && line.start[0] == '[' && line.start[line.len - 1] == ']') {
+            section = span_trim((Span){ line.start + 1, line.len - 2 });
+            if (span_is(section, "nas_devices")) {
+                insert = next;
+            }
+        } else if (is_device_line(section, line)) {
+            insert = next;
+        }
+    }
+
+    char *out = NULL;
+    size_t out_length = 0;
+    FILE *stream = open_memstream(&out, &out_length);
+    if (!stream) {
+        return NULL;
+    }
+
+    section = (Span){ "", 0 };
+    bool line_open = false;     // the last line copied had no newline
+    for (const char *p = text; p < end; ) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *next = eol ? eol + 1 : end;
+        Span line = span_trim((Span){ p, (size_t)((eol ? eol : end) - p) });
+
+        if (line.len > 0 && line.start[0] == '[' && line.start[line.len - 1] == ']') {
+            section = span_trim((Span){ line.start + 1, line.len - 2 });
+        }
+        if (!is_device_line(section, line) || !spec_listed(line, remove, remove_count)) {
+            fwrite(p, 1, (size_t)(next - p), stream);
+            line_open = next[-1] != '\n';
+        }
+        if (next == insert && add_count > 0) {
+            if (line_open) {
+                fputc('\n', stream);
+            }
+            for (int i = 0; i < add_count; i++) {
+                fprintf(stream, "%s\n", add[i]);
+            }
+        }
+        p = next;
+    }
+
+    if (!insert && add_count > 0) {
+        // A blank line after whatever the file ended with
+        const char *gap = length == 0 ? "" : text[length - 1] == '\n' ? "\n" : "\n\n";
+        fprintf(stream, "%s[nas_devices]\n", gap);
+        for (int i = 0; i < add_count; i++) {
+            fprintf(stream, "%s\n", add[i]);
+        }
+    }
+
+    if (fclose(stream) != 0) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+int config_mount_timeout(const MonitorConfig *config, const NasDevice *device) {
+    for (int i = 0; i < config->mount_timeout_count; i++) {
+        if (strcmp(config->mount_timeouts[i].spec, device->spec) == 0) {
+            return config->mount_timeouts[i].seconds;
+        }
+    }
+    return config->mount_timeout;
+}
+
+void config_free(MonitorConfig *config) {
+    clear_networks(config);
+
+    for (int i = 0; i < config->device_count; i++) {
+        free(config->devices[i].spec);
+        free(config->devices[i].host);
+        free(config->devices[i].share);
+    }
+    free(config->devices);
+
+    for (int i = 0; i < config->profile_count; i++) {
+        free_profile(&config->profiles[i]);
+    }
+    free(config->profiles);
+
+    for (int i = 0; i < config->mount_timeout_count; i++) {
+        free(config->mount_timeouts[i].spec);
+    }
+    free(config->mount_timeouts);
+
+    for (int i = 0; i < config->issue_count; i++) {
+        free(config->issues[i].message);
+    }
+    free(config->issues);
+
+    for (int i = 0; i < config->extra_count; i++) {
+        free(config->extra[i].section);
+        free(config->extra[i].key);
+        free(config->extra[i].value);
+    }
+    free(config->extra);
+
+    memset(config, 0, sizeof(*config));
+}
+
+bool config_is_home_network(const MonitorConfig *config, const char *network) {
+    for (int i = 0; i < config->network_count; i++) {
+        if (strcmp(config->home_networks[i], network) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,148 @@
+/*
+ * NAS Monitor - shared configuration parser (libnasmon-config)
+ *
+ * Reads the INI-style config.conf for both nas-monitord and nas-config-gui,
+ * so the two cannot disagree about what a file means. Plain C, no GLib.
+ */
+
+#ifndef MONITOR_CONFIG_H
+#define MONITOR_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    char *spec;     /* "host/share" exactly as written in the config */
+    char *host;
+    char *share;
+} NasDevice;
+
+/* A [mount_timeouts] line: how long mounting one share may take, in place
+ * of [behavior] mount_timeout. */
+typedef struct {
+    char *spec;     /* "host/share", as listed in [nas_devices] */
+    int seconds;
+    int line;
+} MountTimeout;
+
+/* Something wrong with one line; the line is skipped or the key keeps its
+ * previous value, and loading carries on. */
+typedef struct {
+    int line;
+    char *message;
+} ConfigIssue;
+
+/* A key this version does not know, kept so a rewrite does not drop it. */
+typedef struct {
+    char *section;
+    char *key;
+    char *value;
+} ConfigEntry;
+
+typedef struct {
+    char *text;             /* as written, e.g. "192.168.1.0/24" */
+    uint32_t network;       /* host byte order, host bits cleared */
+    uint32_t mask;
+} NetworkSubnet;
+
+/* A [profile:NAME] section: a network recognised by its SSID, its
+ * NetworkManager connection or its subnet, narrowed down by access point
+ * or default gateway when given, with the shares reachable there and its
+ * own home intervals. Every key given has to match. Lists are
+ * comma-separated in the file. */
+typedef struct {
+    char *name;
+    char *ssid;             /* "" matches wired; NULL when not keyed on SSID */
+    char **connections;     /* NetworkManager connection names or UUIDs, VPNs too */
+    int connection_count;
+    NetworkSubnet *subnets; /* IPv4 */
+    int subnet_count;
+    char **bssids;          /* lowercase aa:bb:cc:dd:ee:ff; none means any AP */
+    int bssid_count;
+    char **gateway_macs;    /* lowercase, like bssids */
+    int gateway_mac_count;
+    char **devices;         /* "host/share" specs from [nas_devices]; none means all */
+    int device_count;
+    int home_ac_interval;   /* 0 = use [intervals] */
+    int home_battery_interval;
+    int line;               /* of the section header, for issues */
+    bool unusable;          /* a matching key had no valid entry; never applies */
+} NetworkProfile;
+
+typedef struct {
+    char **home_networks;
+    int network_count;
+    NasDevice *devices;
+    int device_count;
+    NetworkProfile *profiles;
+    int profile_count;
+    int home_ac_interval;
+    int home_battery_interval;
+    int away_ac_interval;
+    int away_battery_interval;
+    int min_check_interval; /* floor for adaptive_schedule */
+    int max_failed_attempts;
+    int min_battery_level;
+    int max_concurrency;    /* mount attempts in flight */
+    int probe_timeout_ms;   /* TCP connect timeout for the SMB port probe */
+    int max_log_size;       /* KiB before the log is rotated to .1 */
+    int timer_slack;        /* seconds a poll may run late to share a wakeup */
+    int stale_mount_timeout_ms; /* a mounted share slower than this is detached */
+    int dns_cache_ttl;      /* seconds a host's resolved addresses are reused */
+    int mount_timeout;      /* seconds before a mount attempt is given up on */
+    bool enable_notifications;
+    bool event_driven;
+    bool adaptive_schedule; /* learn when shares come and go (nas-monitord) */
+    bool unmount_on_leave;  /* detach shares the new network cannot reach */
+    bool unmount_on_suspend; /* detach every share before the system sleeps */
+    bool lean_memory;       /* one malloc arena, trimmed after each cycle */
+    bool shared_probe;      /* ask nas-probed when it is running */
+    MountTimeout *mount_timeouts;   /* per share; only for listed devices */
+    int mount_timeout_count;
+
+    ConfigIssue *issues;
+    int issue_count;
+    ConfigEntry *extra;
+    int extra_count;
+} MonitorConfig;
+
+void config_set_defaults(MonitorConfig *config);
+
+/* Returns 0 on success, -1 if the file could not be read (errno set).
+ * Problems inside the file do not fail the load; they are collected in
+ * config->issues with their line numbers. */
+int config_load(MonitorConfig *config, const char *path);
+
+/* Same as config_load for text already in memory. */
+void config_parse(MonitorConfig *config, const char *text, size_t length);
+
+/* Replaces the home networks with a comma-separated list; empty entries are
+ * kept (a trailing comma means wired counts as home). */
+void config_set_networks(MonitorConfig *config, const char *list);
+
+/* Comma-separated home networks as written in the file; caller frees. */
+char *config_join_networks(const MonitorConfig *config);
+
+/* Appends a "host/share" entry. Returns false if it is malformed or
+ * already listed. */
+bool config_add_device(MonitorConfig *config, const char *spec);
+
+/* Returns config text with a batch of device changes made: [nas_devices]
+ * lines naming a remove spec are dropped, and the add specs are appended
+ * to the last [nas_devices] section, which is created at the end if there
+ * is none. Everything else, comments and unknown keys included, is kept
+ * byte for byte. The specs are not checked here (see config_add_device).
+ * Returns a newly allocated NUL-terminated string, or NULL with errno set. */
+char *config_edit_devices(const char *text, size_t length,
+                          const char *const *add, int add_count,
+                          const char *const *remove, int remove_count);
+
+/* The share's [mount_timeouts] entry if it has one, else mount_timeout. */
+int config_mount_timeout(const MonitorConfig *config, const NasDevice *device);
+
+void config_free(MonitorConfig *config);
+
+bool config_is_home_network(const MonitorConfig *config, const char *network);
+
+#endif /* MONITOR_CONFIG_H */
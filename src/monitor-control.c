@@ -0,0 +1,159 @@
+/*
+ * NAS Monitor daemon - local control socket
+ *
+ * A line-oriented request/reply protocol on a Unix socket, served from the
+ * main loop so handlers can read daemon state without locking:
+ *
+ *   $ printf 'status\n' | nc -U "$XDG_RUNTIME_DIR/nas-monitor.sock"
+ *
+ * What a request means is up to the handler; nas-monitord's take arguments
+ * after the command name, separated by tabs (see nas-monitorctl).
+ *
+ * Under nas-monitor.socket systemd owns the listening socket and starts
+ * the daemon on the first connection; the socket is then taken over as
+ * passed in (sd_listen_fds(3), without libsystemd) rather than bound.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-control.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LISTEN_FDS_START 3
+
+typedef struct {
+    ControlServer *server;
+    GSocketConnection *connection;
+    GDataInputStream *input;
+    char *reply;
+} ControlClient;
+
+static void client_free(ControlClient *client) {
+    g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+    g_object_unref(client->input);
+    g_object_unref(client->connection);
+    g_free(client->reply);
+    g_free(client);
+}
+
+static void on_reply_written(GObject *source, GAsyncResult *result, gpointer user_data) {
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, NULL);
+    client_free(user_data);
+}
+
+static void on_line_read(GObject *source G_GNUC_UNUSED, GAsyncResult *result,
+                         gpointer user_data) {
+    ControlClient *client = user_data;
+    char *line = g_data_input_stream_read_line_finish(client->input, result, NULL, NULL);
+    if (!line) {
+        client_free(client);
+        return;
+    }
+
+    client->reply = client->server->func(g_strstrip(line), client->server->user_data);
+    g_free(line);
+
+    GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(client->connection));
+    g_output_stream_write_all_async(output, client->reply, strlen(client->reply),
+                                    G_PRIORITY_DEFAULT, NULL, on_reply_written, client);
+}
+
+static gboolean on_incoming(GSocketService *service G_GNUC_UNUSED,
+                            GSocketConnection *connection,
+                            GObject *source G_GNUC_UNUSED, gpointer user_data) {
+    ControlClient *client = g_new0(ControlClient, 1);
+    client->server = user_data;
+    client->connection = g_object_ref(connection);
+    client->input = g_data_input_stream_new(
+        g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+
+    g_data_input_stream_read_line_async(client->input, G_PRIORITY_DEFAULT, NULL,
+                                        on_line_read, client);
+    return TRUE;
+}
+
+// The socket systemd passed in, or -1. The variables are cleared either
+// way so that mount helpers and other children do not think it is theirs.
+static int activation_fd(void) {
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    int fd = -1;
+
+    if (pid && fds && strtol(pid, NULL, 10) == getpid() && strtol(fds, NULL, 10) >= 1) {
+        fd = LISTEN_FDS_START;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return fd;
+}
+
+static bool add_activated(ControlServer *server, int fd, GError **error) {
+    GSocket *listening = g_socket_new_from_fd(fd, error);
+    if (!listening) {
+        return false;
+    }
+    bool ok = g_socket_listener_add_socket(G_SOCKET_LISTENER(server->service), listening,
+                                           NULL, error);
+    g_object_unref(listening);
+    return ok;
+}
+
+static bool add_bound(ControlServer *server, const char *path, GError **error) {
+    // Only one daemon holds the instance lock, so a leftover socket is stale
+    unlink(path);
+
+    GSocketAddress *address = g_unix_socket_address_new(path);
+    mode_t old_umask = umask(0077);
+    bool ok = g_socket_listener_add_address(G_SOCKET_LISTENER(server->service), address,
+                                            G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                            NULL, NULL, error);
+    umask(old_umask);
+    g_object_unref(address);
+    return ok;
+}
+
+bool control_server_start(ControlServer *server, const char *path,
+                          ControlFunc func, gpointer user_data, GError **error) {
+    memset(server, 0, sizeof(*server));
+
+    server->service = g_socket_service_new();
+    int fd = activation_fd();
+    server->activated = fd >= 0;
+    bool ok = server->activated ? add_activated(server, fd, error)
+                                : add_bound(server, path, error);
+
+    if (!ok) {
+        g_clear_object(&server->service);
+        return false;
+    }
+
+    server->path = g_strdup(path);
+    server->func = func;
+    server->user_data = user_data;
+    g_signal_connect(server->service, "incoming", G_CALLBACK(on_incoming), server);
+    g_socket_service_start(server->service);
+    return true;
+}
+
+void control_server_stop(ControlServer *server) {
+    if (!server->service) {
+        return;
+    }
+
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+    g_clear_object(&server->service);
+    // systemd keeps listening on its socket to start the next instance
+    if (!server->activated) {
+        unlink(server->path);
+    }
+    g_clear_pointer(&server->path, g_free);
+}
@@ -0,0 +1,33 @@
+/*
+ * NAS Monitor daemon - local control socket
+ */
+
+#ifndef MONITOR_CONTROL_H
+#define MONITOR_CONTROL_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+/* Handles one request line (already stripped) and returns the reply as a
+ * newly allocated string; the caller frees it once it has been sent. */
+typedef char *(*ControlFunc)(const char *command, gpointer user_data);
+
+typedef struct {
+    GSocketService *service;
+    char *path;
+    bool activated;         /* listening on a socket passed in by systemd */
+    ControlFunc func;
+    gpointer user_data;
+} ControlServer;
+
+/* Listens on a Unix stream socket at path, readable by the owner only, or
+ * on the one systemd passed in if started by socket activation (path is
+ * then not touched). Each connection sends one line and gets one reply,
+ * then is closed. */
+bool control_server_start(ControlServer *server, const char *path,
+                          ControlFunc func, gpointer user_data, GError **error);
+
+/* Stops listening and removes the socket file unless systemd owns it. */
+void control_server_stop(ControlServer *server);
+
+#endif /* MONITOR_CONTROL_H */
@@ -0,0 +1,48 @@
+/*
+ * NAS Monitor daemon - small GDBus helpers
+ */
+
+#include "monitor-dbus.h"
+
+#define DBUS_CALL_TIMEOUT_MS 2000
+
+GVariant *dbus_get_property(GDBusConnection *bus, const char *name,
+                            const char *path, const char *iface,
+                            const char *property) {
+    if (!bus) {
+        return NULL;
+    }
+
+    GVariant *reply = g_dbus_connection_call_sync(
+        bus, name, path, "org.freedesktop.DBus.Properties", "Get",
+        g_variant_new("(ss)", iface, property), G_VARIANT_TYPE("(v)"),
+        G_DBUS_CALL_FLAGS_NONE, DBUS_CALL_TIMEOUT_MS, NULL, NULL);
+    if (!reply) {
+        return NULL;
+    }
+
+    GVariant *value = NULL;
+    g_variant_get(reply, "(v)", &value);
+    g_variant_unref(reply);
+    return value;
+}
+
+GVariant *dbus_get_all_properties(GDBusConnection *bus, const char *name,
+                                  const char *path, const char *iface) {
+    if (!bus) {
+        return NULL;
+    }
+
+    GVariant *reply = g_dbus_connection_call_sync(
+        bus, name, path, "org.freedesktop.DBus.Properties", "GetAll",
+        g_variant_new("(s)", iface), G_VARIANT_TYPE("(a{sv})"),
+        G_DBUS_CALL_FLAGS_NONE, DBUS_CALL_TIMEOUT_MS, NULL, NULL);
+    if (!reply) {
+        return NULL;
+    }
+
+    GVariant *properties = NULL;
+    g_variant_get(reply, "(@a{sv})", &properties);
+    g_variant_unref(reply);
+    return properties;
+}
@@ -0,0 +1,21 @@
+/*
+ * NAS Monitor daemon - small GDBus helpers
+ */
+
+#ifndef MONITOR_DBUS_H
+#define MONITOR_DBUS_H
+
+#include <gio/gio.h>
+
+/* Synchronous org.freedesktop.DBus.Properties.Get; returns the unboxed
+ * value or NULL if the service, object or property is not available. */
+GVariant *dbus_get_property(GDBusConnection *bus, const char *name,
+                            const char *path, const char *iface,
+                            const char *property);
+
+/* Properties.GetAll in one round trip; returns the a{sv} dictionary or
+ * NULL. Read values with g_variant_lookup(). */
+GVariant *dbus_get_all_properties(GDBusConnection *bus, const char *name,
+                                  const char *path, const char *iface);
+
+#endif /* MONITOR_DBUS_H */
@@ -0,0 +1,125 @@
+/*
+ * NAS Monitor daemon - NetworkManager/UPower change notifications
+ *
+ * Both services publish state through org.freedesktop.DBus.Properties
+ * PropertiesChanged. Only the properties that feed the mount decision are
+ * forwarded; access point signal strength and similar chatter is dropped
+ * here so it never wakes the cycle.
+ */
+
+#include "monitor-events.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define NM_NAME "org.freedesktop.NetworkManager"
+#define UPOWER_NAME "org.freedesktop.UPower"
+#define UPOWER_DISPLAY_DEVICE "/org/freedesktop/UPower/devices/DisplayDevice"
+#define PROPERTIES_IFACE "org.freedesktop.DBus.Properties"
+
+static bool has_property(GVariant *changed, const char *const names[]) {
+    for (int i = 0; names[i]; i++) {
+        GVariant *value = g_variant_lookup_value(changed, names[i], NULL);
+        if (value) {
+            g_variant_unref(value);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void on_nm_properties_changed(GDBusConnection *bus G_GNUC_UNUSED,
+                                     const gchar *sender G_GNUC_UNUSED,
+                                     const gchar *path G_GNUC_UNUSED,
+                                     const gchar *iface G_GNUC_UNUSED,
+                                     const gchar *signal G_GNUC_UNUSED,
+                                     GVariant *params, gpointer user_data) {
+    MonitorEvents *events = user_data;
+    static const char *const manager_props[] = {
+        "PrimaryConnection", "ActiveConnections", "State", NULL
+    };
+    static const char *const wireless_props[] = { "ActiveAccessPoint", NULL };
+    // A VPN finishing activation or a new DHCP lease changes the identity
+    static const char *const active_props[] = { "State", "Ip4Config", "SpecificObject", NULL };
+
+    const char *changed_iface;
+    GVariant *changed;
+    g_variant_get(params, "(&s@a{sv}as)", &changed_iface, &changed, NULL);
+
+    bool relevant = false;
+    if (strcmp(changed_iface, NM_NAME) == 0) {
+        relevant = has_property(changed, manager_props);
+    } else if (strcmp(changed_iface, NM_NAME ".Device.Wireless") == 0) {
+        relevant = has_property(changed, wireless_props);
+    } else if (strcmp(changed_iface, NM_NAME ".Connection.Active") == 0) {
+        relevant = has_property(changed, active_props);
+    }
+    g_variant_unref(changed);
+
+    if (relevant) {
+        events->func(MONITOR_EVENT_NETWORK, 0, events->user_data);
+    }
+}
+
+static void on_upower_properties_changed(GDBusConnection *bus G_GNUC_UNUSED,
+                                         const gchar *sender G_GNUC_UNUSED,
+                                         const gchar *path,
+                                         const gchar *iface G_GNUC_UNUSED,
+                                         const gchar *signal G_GNUC_UNUSED,
+                                         GVariant *params, gpointer user_data) {
+    MonitorEvents *events = user_data;
+
+    const char *changed_iface;
+    GVariant *changed;
+    g_variant_get(params, "(&s@a{sv}as)", &changed_iface, &changed, NULL);
+
+    gboolean on_battery;
+    gdouble percentage;
+    if (strcmp(changed_iface, UPOWER_NAME) == 0 &&
+        g_variant_lookup(changed, "OnBattery", "b", &on_battery)) {
+        events->func(MONITOR_EVENT_POWER, 0, events->user_data);
+    } else if (strcmp(changed_iface, UPOWER_NAME ".Device") == 0 &&
+               strcmp(path, UPOWER_DISPLAY_DEVICE) == 0 &&
+               g_variant_lookup(changed, "Percentage", "d", &percentage)) {
+        events->func(MONITOR_EVENT_BATTERY, (int)percentage, events->user_data);
+    }
+    g_variant_unref(changed);
+}
+
+void events_subscribe(MonitorEvents *events, GDBusConnection *system_bus,
+                      bool watch_upower, MonitorEventFunc func, gpointer user_data) {
+    memset(events, 0, sizeof(*events));
+    if (!system_bus) {
+        return;
+    }
+
+    events->bus = g_object_ref(system_bus);
+    events->func = func;
+    events->user_data = user_data;
+
+    // Any NetworkManager object: the manager, WiFi devices, active connections
+    events->nm_subscription = g_dbus_connection_signal_subscribe(
+        system_bus, NM_NAME, PROPERTIES_IFACE, "PropertiesChanged",
+        NULL, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+        on_nm_properties_changed, events, NULL);
+
+    // Daemon object (OnBattery) and the aggregate display device (Percentage)
+    if (watch_upower) {
+        events->upower_subscription = g_dbus_connection_signal_subscribe(
+            system_bus, UPOWER_NAME, PROPERTIES_IFACE, "PropertiesChanged",
+            NULL, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+            on_upower_properties_changed, events, NULL);
+    }
+}
+
+void events_unsubscribe(MonitorEvents *events) {
+    if (!events->bus) {
+        return;
+    }
+
+    g_dbus_connection_signal_unsubscribe(events->bus, events->nm_subscription);
+    if (events->upower_subscription) {
+        g_dbus_connection_signal_unsubscribe(events->bus, events->upower_subscription);
+    }
+    g_clear_object(&events->bus);
+}
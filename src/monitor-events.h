@@ -0,0 +1,34 @@
+/*
+ * NAS Monitor daemon - NetworkManager/UPower change notifications
+ */
+
+#ifndef MONITOR_EVENTS_H
+#define MONITOR_EVENTS_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+typedef enum {
+    MONITOR_EVENT_NETWORK,  /* active connection or access point changed */
+    MONITOR_EVENT_POWER,    /* UPower OnBattery changed */
+    MONITOR_EVENT_BATTERY   /* DisplayDevice Percentage changed */
+} MonitorEventKind;
+
+/* value carries the new battery percentage for MONITOR_EVENT_BATTERY. */
+typedef void (*MonitorEventFunc)(MonitorEventKind kind, int value, gpointer user_data);
+
+typedef struct {
+    GDBusConnection *bus;
+    guint nm_subscription;
+    guint upower_subscription;
+    MonitorEventFunc func;
+    gpointer user_data;
+} MonitorEvents;
+
+/* watch_upower is false when power state comes from sysfs uevents instead. */
+void events_subscribe(MonitorEvents *events, GDBusConnection *system_bus,
+                      bool watch_upower, MonitorEventFunc func, gpointer user_data);
+
+void events_unsubscribe(MonitorEvents *events);
+
+#endif /* MONITOR_EVENTS_H */
@@ -0,0 +1,69 @@
+/*
+ * NAS Monitor daemon - latency histograms
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-histogram.h"
+
+#define LINEAR_LIMIT (2 * HISTOGRAM_SUB_BUCKETS)
+#define SUB_BITS 3
+#define FIRST_MAGNITUDE 4       /* log2(LINEAR_LIMIT) */
+
+static int bucket_index(gint64 value) {
+    if (value < LINEAR_LIMIT) {
+        return value < 0 ? 0 : (int)value;
+    }
+
+    int magnitude = 63 - __builtin_clzll((unsigned long long)value);
+    int sub = (int)(value >> (magnitude - SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    int index = LINEAR_LIMIT + (magnitude - FIRST_MAGNITUDE) * HISTOGRAM_SUB_BUCKETS + sub;
+    return MIN(index, HISTOGRAM_BUCKETS - 1);
+}
+
+static gint64 bucket_top(int index) {
+    if (index < LINEAR_LIMIT) {
+        return index;
+    }
+
+    int magnitude = FIRST_MAGNITUDE + (index - LINEAR_LIMIT) / HISTOGRAM_SUB_BUCKETS;
+    int sub = (index - LINEAR_LIMIT) % HISTOGRAM_SUB_BUCKETS;
+    return ((gint64)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (magnitude - SUB_BITS)) - 1;
+}
+
+void histogram_record(Histogram *histogram, gint64 value_us) {
+    value_us = MAX(value_us, 0);
+    histogram->counts[bucket_index(value_us)]++;
+    histogram->total++;
+    histogram->sum_us += value_us;
+    histogram->max_us = MAX(histogram->max_us, value_us);
+}
+
+void histogram_merge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    into->sum_us += from->sum_us;
+    into->max_us = MAX(into->max_us, from->max_us);
+}
+
+gint64 histogram_percentile(const Histogram *histogram, double percentile) {
+    if (!histogram->total) {
+        return 0;
+    }
+
+    // Rank of the value wanted, counting from 1
+    guint64 rank = (guint64)(percentile / 100.0 * (double)histogram->total + 0.5);
+    rank = CLAMP(rank, 1, histogram->total);
+
+    guint64 seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        // The last bucket also holds everything past its range
+        if (seen >= rank && i < HISTOGRAM_BUCKETS - 1) {
+            return MIN(bucket_top(i), histogram->max_us);
+        }
+    }
+    return histogram->max_us;
+}
@@ -0,0 +1,34 @@
+/*
+ * NAS Monitor daemon - latency histograms
+ */
+
+#ifndef MONITOR_HISTOGRAM_H
+#define MONITOR_HISTOGRAM_H
+
+#include <glib.h>
+
+/* Log-linear buckets in the manner of HdrHistogram: 16 exact ones for
+ * 0-15us, then 8 per power of two, so every recorded value is known to
+ * within 12.5% from 1us up to the top bucket (about 19 hours). Fixed size,
+ * about 1 KiB, and recording is a few shifts. */
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_BUCKETS (2 * HISTOGRAM_SUB_BUCKETS + 32 * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    guint32 counts[HISTOGRAM_BUCKETS];
+    guint64 total;
+    gint64 sum_us;
+    gint64 max_us;
+} Histogram;
+
+void histogram_record(Histogram *histogram, gint64 value_us);
+
+/* Adds every value recorded in from to into. */
+void histogram_merge(Histogram *into, const Histogram *from);
+
+/* Smallest value that percentile (0-100) percent of the recorded values
+ * do not exceed, as the top of its bucket but never above the largest
+ * value seen; 0 if nothing was recorded. */
+gint64 histogram_percentile(const Histogram *histogram, double percentile);
+
+#endif /* MONITOR_HISTOGRAM_H */
@@ -0,0 +1,137 @@
+/*
+ * NAS Monitor daemon - timestamped logging
+ *
+ * Same line format as setup_logging in nas-monitor.sh:
+ *   YYYY-MM-DD HH:MM:SS: message
+ *
+ * Lines are collected in a stdio buffer and written out in batches by
+ * monitor_log_flush() (the daemon calls it at the end of every cycle), so
+ * a mount storm costs one write() instead of one per line. Once the file
+ * grows past the size limit it is renamed to <path>.1 and reopened.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define LOG_BUFFER_SIZE 16384
+
+static FILE *log_file = NULL;
+static char log_path[512];
+static long log_size = 0;
+static long log_max_size = 0;
+
+static void make_parent_dirs(const char *path) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", path);
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+}
+
+static bool open_file(void) {
+    log_file = fopen(log_path, "a");
+    if (!log_file) {
+        return false;
+    }
+    setvbuf(log_file, NULL, _IOFBF, LOG_BUFFER_SIZE);
+
+    struct stat st;
+    log_size = fstat(fileno(log_file), &st) == 0 ? (long)st.st_size : 0;
+    return true;
+}
+
+int monitor_log_open(const char *path) {
+    if (!path || strcmp(path, "-") == 0) {
+        log_file = stderr;
+        log_path[0] = '\0';
+        return 0;
+    }
+
+    snprintf(log_path, sizeof(log_path), "%s", path);
+    make_parent_dirs(path);
+    if (!open_file()) {
+        int saved = errno;
+        log_file = stderr;
+        log_path[0] = '\0';
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+void monitor_log_set_max_size(long max_bytes) {
+    log_max_size = max_bytes > 0 ? max_bytes : 0;
+}
+
+static void rotate(void) {
+    char old_path[sizeof(log_path) + 2];
+    snprintf(old_path, sizeof(old_path), "%s.1", log_path);
+
+    fclose(log_file);
+    rename(log_path, old_path);
+    if (!open_file()) {
+        log_file = stderr;
+        log_path[0] = '\0';
+    }
+}
+
+// strftime only when the second changes; bursts share one formatted stamp
+static const char *timestamp(void) {
+    static char stamp[32];
+    static time_t stamp_time = -1;
+
+    time_t now = time(NULL);
+    if (now != stamp_time) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        stamp_time = now;
+    }
+    return stamp;
+}
+
+void monitor_log(const char *format, ...) {
+    FILE *out = log_file ? log_file : stderr;
+
+    va_list args;
+    va_start(args, format);
+    int written = fprintf(out, "%s: ", timestamp());
+    written += vfprintf(out, format, args);
+    fputc('\n', out);
+    va_end(args);
+
+    if (out == stderr) {
+        return;  // unbuffered already; journald adds its own batching
+    }
+
+    log_size += written + 1;
+    if (log_max_size && log_size > log_max_size) {
+        rotate();
+    }
+}
+
+void monitor_log_flush(void) {
+    if (log_file) {
+        fflush(log_file);
+    }
+}
+
+void monitor_log_close(void) {
+    if (log_file && log_file != stderr) {
+        fclose(log_file);
+    }
+    log_file = NULL;
+}
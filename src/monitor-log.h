@@ -0,0 +1,24 @@
+/*
+ * NAS Monitor daemon - timestamped logging
+ */
+
+#ifndef MONITOR_LOG_H
+#define MONITOR_LOG_H
+
+#include <stdbool.h>
+
+/* Opens the log file for appending; NULL or "-" logs to stderr. */
+int monitor_log_open(const char *path);
+
+/* Rotate to <path>.1 once the file exceeds max_bytes; 0 disables rotation. */
+void monitor_log_set_max_size(long max_bytes);
+
+/* Buffered; lines reach the file on monitor_log_flush() or when the
+ * buffer fills. */
+void monitor_log(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+void monitor_log_flush(void);
+
+void monitor_log_close(void);
+
+#endif /* MONITOR_LOG_H */
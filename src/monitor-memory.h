@@ -0,0 +1,33 @@
+/*
+ * NAS Monitor daemon - memory footprint
+ */
+
+#ifndef MONITOR_MEMORY_H
+#define MONITOR_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    long rss_kb;            /* resident now */
+    long peak_rss_kb;       /* high-water mark since start */
+    size_t heap_bytes;      /* handed out by malloc and not yet freed */
+    size_t heap_free_bytes; /* held by malloc for reuse */
+    size_t mapped_bytes;    /* large blocks malloc mapped on their own */
+    size_t mapped_blocks;
+    bool lean;
+} MemoryUsage;
+
+/* For lean_memory, before any thread has allocated: every thread shares
+ * the main malloc arena, which grows in reserve-sized steps and keeps
+ * that much when trimmed, and idle worker threads exit at once instead
+ * of lingering with their stacks. Cannot be undone. */
+void memory_lean_setup(size_t reserve);
+
+/* Gives free heap beyond the reserve back to the kernel; a no-op unless
+ * memory_lean_setup was called. */
+void memory_trim(void);
+
+void memory_usage(MemoryUsage *usage);
+
+#endif /* MONITOR_MEMORY_H */
@@ -0,0 +1,304 @@
+/*
+ * NAS Monitor daemon - gvfs SMB mount handling
+ *
+ * Everything goes through GIO's client side of gvfs: mounts are D-Bus calls
+ * to gvfsd, and the volume monitor keeps its list of mounts current from
+ * gvfsd's signals, so neither a mount nor a lookup starts a process.
+ */
+
+#include "monitor-log.h"
+#include "monitor-mount.h"
+
+#include <string.h>
+
+typedef struct {
+    MountDoneFunc done;
+    gpointer user_data;
+    GCancellable *cancellable;  /* cancelled on the timeout */
+    guint timeout_source;
+    bool timed_out;
+    int timeout_ms;             /* mounts and unmounts, for the log */
+    char *spec;
+} MountRequest;
+
+// Splits smb://[user@]host/share[/path] into host and share.
+static bool parse_smb_uri(const char *uri, char **host, char **share) {
+    if (g_ascii_strncasecmp(uri, "smb://", 6) != 0) {
+        return false;
+    }
+
+    const char *authority = uri + 6;
+    const char *slash = strchr(authority, '/');
+    if (!slash) {
+        return false;
+    }
+
+    const char *at = memchr(authority, '@', slash - authority);
+    if (at) {
+        authority = at + 1;
+    }
+
+    const char *share_start = slash + 1;
+    const char *share_end = strchr(share_start, '/');
+    if (!share_end) {
+        share_end = share_start + strlen(share_start);
+    }
+    if (share_end == share_start) {
+        return false;
+    }
+
+    *host = g_strndup(authority, slash - authority);
+    char *escaped = g_strndup(share_start, share_end - share_start);
+    *share = g_uri_unescape_string(escaped, NULL);
+    g_free(escaped);
+    return *share != NULL;
+}
+
+// Host names and SMB share names are both case-insensitive, so the key is
+// the lowercased "host/share" pair.
+static char *share_key(const char *host, const char *share) {
+    char *key = g_strdup_printf("%s/%s", host, share);
+    char *lower = g_ascii_strdown(key, -1);
+    g_free(key);
+    return lower;
+}
+
+// The key of an SMB mount, or NULL for anything else
+static char *mount_key(GMount *mount) {
+    GFile *root = g_mount_get_root(mount);
+    char *uri = g_file_get_uri(root);
+    g_object_unref(root);
+
+    char *host = NULL;
+    char *share = NULL;
+    char *key = NULL;
+    if (parse_smb_uri(uri, &host, &share)) {
+        key = share_key(host, share);
+    }
+
+    g_free(host);
+    g_free(share);
+    g_free(uri);
+    return key;
+}
+
+MountTable *mount_table_snapshot(GVolumeMonitor *monitor) {
+    MountTable *table = g_new0(MountTable, 1);
+    table->shares = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          g_object_unref);
+
+    GList *mounts = g_volume_monitor_get_mounts(monitor);
+    for (GList *iter = mounts; iter; iter = iter->next) {
+        GMount *mount = iter->data;
+        char *key = mount_key(mount);
+        if (key) {
+            g_hash_table_replace(table->shares, key, g_object_ref(mount));
+        }
+    }
+    g_list_free_full(mounts, g_object_unref);
+
+    return table;
+}
+
+bool mount_table_contains(const MountTable *table, const NasDevice *device) {
+    return mount_table_lookup(table, device) != NULL;
+}
+
+GMount *mount_table_lookup(const MountTable *table, const NasDevice *device) {
+    char *key = share_key(device->host, device->share);
+    GMount *mount = g_hash_table_lookup(table->shares, key);
+    g_free(key);
+    return mount;
+}
+
+void mount_table_free(MountTable *table) {
+    g_hash_table_unref(table->shares);
+    g_free(table);
+}
+
+static void on_mount_added(GVolumeMonitor *volume_monitor G_GNUC_UNUSED, GMount *mount,
+                           gpointer user_data) {
+    MountWatch *watch = user_data;
+    char *key = mount_key(mount);
+    if (!key) {
+        return;
+    }
+
+    g_hash_table_replace(watch->table->shares, key, g_object_ref(mount));
+    watch->changed(watch->user_data);
+}
+
+static void on_mount_removed(GVolumeMonitor *volume_monitor G_GNUC_UNUSED, GMount *mount,
+                             gpointer user_data) {
+    MountWatch *watch = user_data;
+    char *key = mount_key(mount);
+    if (!key) {
+        return;
+    }
+
+    // Only if it is still the mount we know; a remount may have replaced it
+    if (g_hash_table_lookup(watch->table->shares, key) == mount) {
+        g_hash_table_remove(watch->table->shares, key);
+        watch->changed(watch->user_data);
+    }
+    g_free(key);
+}
+
+void mount_watch_start(MountWatch *watch, GVolumeMonitor *volume_monitor,
+                       MountChangedFunc changed, gpointer user_data) {
+    watch->volume_monitor = g_object_ref(volume_monitor);
+    watch->table = mount_table_snapshot(volume_monitor);
+    watch->changed = changed;
+    watch->user_data = user_data;
+    watch->added_handler = g_signal_connect(volume_monitor, "mount-added",
+                                            G_CALLBACK(on_mount_added), watch);
+    watch->removed_handler = g_signal_connect(volume_monitor, "mount-removed",
+                                              G_CALLBACK(on_mount_removed), watch);
+}
+
+void mount_watch_stop(MountWatch *watch) {
+    if (!watch->volume_monitor) {
+        return;
+    }
+
+    g_signal_handler_disconnect(watch->volume_monitor, watch->added_handler);
+    g_signal_handler_disconnect(watch->volume_monitor, watch->removed_handler);
+    g_clear_pointer(&watch->table, mount_table_free);
+    g_clear_object(&watch->volume_monitor);
+}
+
+// gvfs has already tried the password saved in the keyring, if there is
+// one, before it asks. Nobody is there to answer, so the mount fails
+// straight away rather than waiting on a prompt.
+static void on_ask_password(GMountOperation *operation, const char *message G_GNUC_UNUSED,
+                            const char *default_user G_GNUC_UNUSED,
+                            const char *default_domain G_GNUC_UNUSED,
+                            GAskPasswordFlags flags G_GNUC_UNUSED, gpointer user_data) {
+    MountRequest *request = user_data;
+    monitor_log("%s needs a password that is not saved; connect to it once in the "
+                "file manager and choose to remember the password", request->spec);
+    g_mount_operation_reply(operation, G_MOUNT_OPERATION_ABORTED);
+}
+
+static void on_ask_question(GMountOperation *operation, const char *message G_GNUC_UNUSED,
+                            const char **choices G_GNUC_UNUSED,
+                            gpointer user_data G_GNUC_UNUSED) {
+    g_mount_operation_reply(operation, G_MOUNT_OPERATION_ABORTED);
+}
+
+static gboolean on_request_timeout(gpointer user_data) {
+    MountRequest *request = user_data;
+    request->timeout_source = 0;
+    request->timed_out = true;
+    g_cancellable_cancel(request->cancellable);
+    return G_SOURCE_REMOVE;
+}
+
+static void start_timeout(MountRequest *request, guint timeout_ms) {
+    request->cancellable = g_cancellable_new();
+    request->timeout_source = g_timeout_add(timeout_ms, on_request_timeout, request);
+}
+
+static void finish_request(MountRequest *request, bool success) {
+    if (request->timeout_source) {
+        g_source_remove(request->timeout_source);
+    }
+    request->done(success, request->user_data);
+
+    g_clear_object(&request->cancellable);
+    g_free(request->spec);
+    g_free(request);
+}
+
+static void on_mounted(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MountRequest *request = user_data;
+
+    GError *error = NULL;
+    bool success = g_file_mount_enclosing_volume_finish(G_FILE(source), result, &error);
+    // Mounted by someone else (the file manager, a previous attempt) meanwhile
+    if (!success && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_ALREADY_MOUNTED)) {
+        success = true;
+    }
+    if (!success && request->timed_out) {
+        monitor_log("Mounting %s timed out after %ds", request->spec,
+                    request->timeout_ms / 1000);
+    }
+    g_clear_error(&error);
+    g_object_unref(source);
+    finish_request(request, success);
+}
+
+void mount_device_async(const NasDevice *device, int timeout_s, MountDoneFunc done,
+                        gpointer user_data) {
+    MountRequest *request = g_new0(MountRequest, 1);
+    request->done = done;
+    request->user_data = user_data;
+    request->spec = g_strdup(device->spec);
+    request->timeout_ms = timeout_s * 1000;
+    start_timeout(request, (guint)request->timeout_ms);
+
+    char *uri = g_strdup_printf("smb://%s", device->spec);
+    GFile *location = g_file_new_for_uri(uri);
+    g_free(uri);
+
+    GMountOperation *operation = g_mount_operation_new();
+    g_signal_connect(operation, "ask-password", G_CALLBACK(on_ask_password), request);
+    g_signal_connect(operation, "ask-question", G_CALLBACK(on_ask_question), request);
+
+    g_file_mount_enclosing_volume(location, G_MOUNT_MOUNT_NONE, operation,
+                                  request->cancellable, on_mounted, request);
+    // The call holds its own reference until it completes
+    g_object_unref(operation);
+}
+
+static void on_unmounted(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MountRequest *request = user_data;
+
+    GError *error = NULL;
+    bool success = g_mount_unmount_with_operation_finish(G_MOUNT(source), result, &error);
+    // Someone else got there first
+    if (!success && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+        success = true;
+    }
+    if (!success && request->timed_out) {
+        monitor_log("Unmounting %s timed out after %dms", request->spec, request->timeout_ms);
+    }
+    g_clear_error(&error);
+    g_object_unref(source);
+    finish_request(request, success);
+}
+
+void mount_unmount_async(GMount *mount, int timeout_ms, MountDoneFunc done,
+                         gpointer user_data) {
+    MountRequest *request = g_new0(MountRequest, 1);
+    request->done = done;
+    request->user_data = user_data;
+    request->spec = mount_key(mount);
+    request->timeout_ms = timeout_ms;
+    start_timeout(request, (guint)timeout_ms);
+
+    g_mount_unmount_with_operation(g_object_ref(mount), G_MOUNT_UNMOUNT_FORCE, NULL,
+                                   request->cancellable, on_unmounted, request);
+}
+
+static void on_root_queried(GObject *source, GAsyncResult *result, gpointer user_data) {
+    MountRequest *request = user_data;
+
+    GFileInfo *info = g_file_query_info_finish(G_FILE(source), result, NULL);
+    bool responding = info != NULL;
+    g_clear_object(&info);
+    g_object_unref(source);
+    finish_request(request, responding);
+}
+
+void mount_check_async(GMount *mount, int timeout_ms, MountDoneFunc done, gpointer user_data) {
+    MountRequest *request = g_new0(MountRequest, 1);
+    request->done = done;
+    request->user_data = user_data;
+    start_timeout(request, (guint)timeout_ms);
+
+    // Just the type: the backend still has to ask the server, but nothing is listed
+    GFile *root = g_mount_get_root(mount);
+    g_file_query_info_async(root, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE,
+                            G_PRIORITY_DEFAULT, request->cancellable, on_root_queried, request);
+}
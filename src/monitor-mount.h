@@ -0,0 +1,71 @@
+/*
+ * NAS Monitor daemon - gvfs SMB mount handling
+ */
+
+#ifndef MONITOR_MOUNT_H
+#define MONITOR_MOUNT_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+#include "monitor-config.h"
+
+/* SMB shares gvfs has mounted, keyed by exact host/share. */
+typedef struct {
+    GHashTable *shares;     /* key -> GMount, referenced */
+} MountTable;
+
+/* Enumerates the volume monitor once; lookups afterwards are O(1). */
+MountTable *mount_table_snapshot(GVolumeMonitor *monitor);
+
+bool mount_table_contains(const MountTable *table, const NasDevice *device);
+
+/* The mount gvfs has for device, or NULL; owned by the table. */
+GMount *mount_table_lookup(const MountTable *table, const NasDevice *device);
+
+void mount_table_free(MountTable *table);
+
+/* Called from the main loop after an SMB mount came or went. */
+typedef void (*MountChangedFunc)(gpointer user_data);
+
+/* A MountTable kept current from the volume monitor's mount-added and
+ * mount-removed signals, so a cycle reads it without enumerating. */
+typedef struct {
+    GVolumeMonitor *volume_monitor;
+    MountTable *table;
+    gulong added_handler;
+    gulong removed_handler;
+    MountChangedFunc changed;
+    gpointer user_data;
+} MountWatch;
+
+void mount_watch_start(MountWatch *watch, GVolumeMonitor *volume_monitor,
+                       MountChangedFunc changed, gpointer user_data);
+
+void mount_watch_stop(MountWatch *watch);
+
+typedef void (*MountDoneFunc)(bool success, gpointer user_data);
+
+/* Mounts smb://host/share through g_file_mount_enclosing_volume without
+ * blocking the main loop. gvfs logs in with the password saved in the
+ * keyring; without one the attempt fails instead of prompting. An attempt
+ * still running after timeout_s is cancelled and reported as failed, so a
+ * half-dead server holds up a queue slot for no longer than that. */
+void mount_device_async(const NasDevice *device, int timeout_s, MountDoneFunc done,
+                        gpointer user_data);
+
+/* Unmounts without waiting for open files to be closed: the shares this is
+ * used on are on a network we left or have stopped answering, so nothing
+ * pending on them can complete anyway. Like a mount, an unmount still
+ * running after timeout_ms is cancelled and reported as failed; gvfsd can
+ * otherwise sit on it for as long as the dead server takes to time out. */
+void mount_unmount_async(GMount *mount, int timeout_ms, MountDoneFunc done,
+                         gpointer user_data);
+
+/* Queries the mount root through gvfs and reports false if that fails or
+ * takes longer than timeout_ms, which is how a dead server shows. The query
+ * is a D-Bus call to gvfsd rather than a stat() of the FUSE path, so it can
+ * be abandoned instead of blocking a thread until the SMB timeout. */
+void mount_check_async(GMount *mount, int timeout_ms, MountDoneFunc done, gpointer user_data);
+
+#endif /* MONITOR_MOUNT_H */
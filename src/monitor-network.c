@@ -0,0 +1,185 @@
+/*
+ * NAS Monitor daemon - current network detection
+ *
+ * Identity comes from NetworkManager's ActiveConnections, one GetAll per
+ * connection, so wired docks and VPNs are seen as well as WiFi and no scan
+ * listing is ever requested (unlike `nmcli dev wifi`). The gateway comes
+ * from procfs, which is two small reads.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-network.h"
+#include "monitor-dbus.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NM_NAME "org.freedesktop.NetworkManager"
+#define NM_PATH "/org/freedesktop/NetworkManager"
+#define NM_ACTIVE_IFACE NM_NAME ".Connection.Active"
+#define NM_AP_IFACE NM_NAME ".AccessPoint"
+#define NM_IP4_IFACE NM_NAME ".IP4Config"
+#define NM_ACTIVE_STATE_ACTIVATED 2
+#define ROUTE_FLAG_GATEWAY 0x2  /* RTF_GATEWAY in /proc/net/route */
+
+static void read_access_point(GDBusConnection *bus, const char *ap_path, NetworkIdentity *id) {
+    GVariant *ap = dbus_get_all_properties(bus, NM_NAME, ap_path, NM_AP_IFACE);
+    if (!ap) {
+        return;
+    }
+
+    GVariant *ssid = g_variant_lookup_value(ap, "Ssid", G_VARIANT_TYPE("ay"));
+    if (ssid) {
+        gsize len = 0;
+        const guchar *bytes = g_variant_get_fixed_array(ssid, &len, sizeof(guchar));
+        id->ssid = g_strndup((const char *)bytes, len);
+        g_variant_unref(ssid);
+
+        const char *address;
+        if (g_variant_lookup(ap, "HwAddress", "&s", &address)) {
+            id->bssid = g_ascii_strdown(address, -1);
+        }
+    }
+    g_variant_unref(ap);
+}
+
+static void read_addresses(GDBusConnection *bus, const char *config_path, NetworkIdentity *id) {
+    GVariant *data = dbus_get_property(bus, NM_NAME, config_path, NM_IP4_IFACE, "AddressData");
+    if (!data) {
+        return;
+    }
+
+    GVariantIter iter;
+    GVariant *entry;
+    g_variant_iter_init(&iter, data);
+    while ((entry = g_variant_iter_next_value(&iter))) {
+        const char *text;
+        struct in_addr addr;
+        if (g_variant_lookup(entry, "address", "&s", &text) &&
+            inet_pton(AF_INET, text, &addr) == 1) {
+            guint32 address = ntohl(addr.s_addr);
+            g_array_append_val(id->addresses, address);
+        }
+        g_variant_unref(entry);
+    }
+    g_variant_unref(data);
+}
+
+static void read_active_connection(GDBusConnection *bus, const char *path, unsigned details,
+                                   NetworkIdentity *id) {
+    GVariant *active = dbus_get_all_properties(bus, NM_NAME, path, NM_ACTIVE_IFACE);
+    if (!active) {
+        return;
+    }
+
+    // Connections still coming up or going down are not where we are yet
+    guint32 state = 0;
+    if (!g_variant_lookup(active, "State", "u", &state) || state != NM_ACTIVE_STATE_ACTIVATED) {
+        g_variant_unref(active);
+        return;
+    }
+
+    const char *value;
+    if (g_variant_lookup(active, "Id", "&s", &value)) {
+        g_ptr_array_add(id->connections, g_strdup(value));
+    }
+    if (g_variant_lookup(active, "Uuid", "&s", &value)) {
+        g_ptr_array_add(id->connections, g_strdup(value));
+    }
+
+    // For WiFi the specific object is the access point in use
+    const char *type;
+    if (!id->ssid && g_variant_lookup(active, "Type", "&s", &type) &&
+        strcmp(type, "802-11-wireless") == 0 &&
+        g_variant_lookup(active, "SpecificObject", "&o", &value) && strcmp(value, "/") != 0) {
+        read_access_point(bus, value, id);
+    }
+
+    if ((details & NETWORK_ADDRESSES) &&
+        g_variant_lookup(active, "Ip4Config", "&o", &value) && strcmp(value, "/") != 0) {
+        read_addresses(bus, value, id);
+    }
+    g_variant_unref(active);
+}
+
+// The IPv4 default route's gateway, then its entry in the ARP table. The
+// kernel prints addresses as raw network-order words in native-endian hex,
+// so reading back with %x gives the in_addr bits unchanged.
+static char *gateway_mac(void) {
+    FILE *routes = fopen("/proc/net/route", "re");
+    if (!routes) {
+        return g_strdup("");
+    }
+
+    char line[256];
+    unsigned destination, gateway = 0, flags;
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), routes)) {
+        char iface[64];
+        found = sscanf(line, "%63s %x %x %x", iface, &destination, &gateway, &flags) == 4 &&
+                destination == 0 && (flags & ROUTE_FLAG_GATEWAY);
+    }
+    fclose(routes);
+    if (!found) {
+        return g_strdup("");
+    }
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr = { .s_addr = gateway };
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+    FILE *arp = fopen("/proc/net/arp", "re");
+    if (!arp) {
+        return g_strdup("");
+    }
+
+    char *mac = NULL;
+    while (!mac && fgets(line, sizeof(line), arp)) {
+        char address[64], hw_address[32];
+        unsigned type, arp_flags;
+        // Flags 0 is an incomplete entry with a 00:00:... address
+        if (sscanf(line, "%63s %x %x %31s", address, &type, &arp_flags, hw_address) == 4 &&
+            arp_flags != 0 && strcmp(address, ip) == 0) {
+            mac = g_ascii_strdown(hw_address, -1);
+        }
+    }
+    fclose(arp);
+    return mac ? mac : g_strdup("");
+}
+
+void network_identify(GDBusConnection *system_bus, unsigned details, NetworkIdentity *id) {
+    id->ssid = NULL;
+    id->bssid = NULL;
+    id->connections = g_ptr_array_new_with_free_func(g_free);
+    id->addresses = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+    // Without NetworkManager this looks like a wired network with no name
+    GVariant *paths = dbus_get_property(system_bus, NM_NAME, NM_PATH, NM_NAME,
+                                        "ActiveConnections");
+    if (paths) {
+        GVariantIter iter;
+        const char *path;
+        g_variant_iter_init(&iter, paths);
+        while (g_variant_iter_next(&iter, "&o", &path)) {
+            read_active_connection(system_bus, path, details, id);
+        }
+        g_variant_unref(paths);
+    }
+
+    if (!id->ssid) id->ssid = g_strdup("");
+    if (!id->bssid) id->bssid = g_strdup("");
+    id->gateway_mac = (details & NETWORK_GATEWAY) ? gateway_mac() : g_strdup("");
+}
+
+void network_identity_clear(NetworkIdentity *id) {
+    g_clear_pointer(&id->ssid, g_free);
+    g_clear_pointer(&id->bssid, g_free);
+    g_clear_pointer(&id->gateway_mac, g_free);
+    g_clear_pointer(&id->connections, g_ptr_array_unref);
+    if (id->addresses) {
+        g_array_free(id->addresses, TRUE);
+        id->addresses = NULL;
+    }
+}
@@ -0,0 +1,34 @@
+/*
+ * NAS Monitor daemon - current network detection
+ */
+
+#ifndef MONITOR_NETWORK_H
+#define MONITOR_NETWORK_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+/* Optional parts of the identity, each costing extra reads. */
+typedef enum {
+    NETWORK_GATEWAY = 1 << 0,   /* gateway_mac */
+    NETWORK_ADDRESSES = 1 << 1  /* addresses */
+} NetworkDetail;
+
+/* What network profiles are matched against. Strings are never NULL once
+ * filled in; MACs are lowercase aa:bb:cc:dd:ee:ff. */
+typedef struct {
+    char *ssid;         /* "" when not on WiFi (wired, disconnected, no NM) */
+    char *bssid;        /* of the active access point, "" when not on WiFi */
+    char *gateway_mac;  /* of the IPv4 default gateway, "" if not looked up */
+    GPtrArray *connections; /* name and UUID of each activated connection,
+                             * VPNs included */
+    GArray *addresses;  /* guint32 IPv4 addresses in host byte order */
+} NetworkIdentity;
+
+/* Reads the activated connections from NetworkManager's properties (no WiFi
+ * scan, works for Ethernet and VPNs), plus the details asked for. */
+void network_identify(GDBusConnection *system_bus, unsigned details, NetworkIdentity *id);
+
+void network_identity_clear(NetworkIdentity *id);
+
+#endif /* MONITOR_NETWORK_H */
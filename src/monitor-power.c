@@ -0,0 +1,245 @@
+/*
+ * NAS Monitor daemon - power source and battery detection
+ *
+ * /sys/class/power_supply is read directly and the result cached until the
+ * kernel announces a power_supply uevent (adapter plugged, capacity tick),
+ * so a cycle normally costs no I/O at all. UPower over D-Bus is the
+ * fallback for systems where sysfs exposes no adapter or battery.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-power.h"
+#include "monitor-dbus.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define UPOWER_NAME "org.freedesktop.UPower"
+#define UPOWER_PATH "/org/freedesktop/UPower"
+#define UPOWER_DISPLAY_DEVICE "/org/freedesktop/UPower/devices/DisplayDevice"
+#define POWER_SUPPLY_DIR "/sys/class/power_supply"
+#define DEFAULT_BATTERY_LEVEL 50
+#define UEVENT_BUFFER 4096
+
+static bool read_attr(const char *supply, const char *attr, char *buf, size_t size) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", POWER_SUPPLY_DIR, supply, attr);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    bool ok = fgets(buf, size, file) != NULL;
+    fclose(file);
+
+    if (ok) {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    return ok;
+}
+
+static bool read_attr_long(const char *supply, const char *attr, long *value) {
+    char buf[32];
+    if (!read_attr(supply, attr, buf, sizeof(buf))) {
+        return false;
+    }
+    char *end;
+    *value = strtol(buf, &end, 10);
+    return end != buf;
+}
+
+// capacity, or derived from energy/charge counters on firmware without it
+static bool battery_percent(const char *supply, long *percent) {
+    if (read_attr_long(supply, "capacity", percent)) {
+        return true;
+    }
+
+    static const char *const counters[][2] = {
+        { "energy_now", "energy_full" },
+        { "charge_now", "charge_full" },
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        long now, full;
+        if (read_attr_long(supply, counters[i][0], &now) &&
+            read_attr_long(supply, counters[i][1], &full) && full > 0) {
+            *percent = now * 100 / full;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns false if sysfs has neither an adapter nor a system battery.
+static bool read_sysfs(PowerStatus *status) {
+    DIR *dir = opendir(POWER_SUPPLY_DIR);
+    if (!dir) {
+        return false;
+    }
+
+    int adapters = 0, adapters_online = 0;
+    int batteries = 0, batteries_discharging = 0;
+    long capacity_sum = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char type[32], buf[32];
+        if (!read_attr(entry->d_name, "type", type, sizeof(type))) {
+            continue;
+        }
+
+        if (strcmp(type, "Mains") == 0 || strcmp(type, "USB") == 0) {
+            long online = 0;
+            adapters++;
+            if (read_attr_long(entry->d_name, "online", &online) && online == 1) {
+                adapters_online++;
+            }
+        } else if (strcmp(type, "Battery") == 0) {
+            // Skip mice, keyboards and other peripherals with batteries
+            if (read_attr(entry->d_name, "scope", buf, sizeof(buf)) &&
+                strcmp(buf, "Device") == 0) {
+                continue;
+            }
+
+            long percent;
+            if (!battery_percent(entry->d_name, &percent)) {
+                continue;
+            }
+            batteries++;
+            capacity_sum += percent;
+            if (read_attr(entry->d_name, "status", buf, sizeof(buf)) &&
+                strcmp(buf, "Discharging") == 0) {
+                batteries_discharging++;
+            }
+        }
+    }
+    closedir(dir);
+
+    if (adapters == 0 && batteries == 0) {
+        return false;
+    }
+
+    // Without an adapter entry, a battery that isn't discharging means AC
+    status->on_ac = adapters ? adapters_online > 0
+                             : batteries_discharging == 0;
+    status->battery_level = batteries ? (int)(capacity_sum / batteries)
+                                      : DEFAULT_BATTERY_LEVEL;
+    return true;
+}
+
+static void read_upower(GDBusConnection *bus, PowerStatus *status) {
+    status->on_ac = false;  // Assume battery power if can't determine
+    status->battery_level = DEFAULT_BATTERY_LEVEL;
+
+    GVariant *on_battery = dbus_get_property(bus, UPOWER_NAME, UPOWER_PATH,
+                                             UPOWER_NAME, "OnBattery");
+    if (on_battery) {
+        status->on_ac = !g_variant_get_boolean(on_battery);
+        g_variant_unref(on_battery);
+    }
+
+    GVariant *present = dbus_get_property(bus, UPOWER_NAME, UPOWER_DISPLAY_DEVICE,
+                                          UPOWER_NAME ".Device", "IsPresent");
+    if (present && g_variant_get_boolean(present)) {
+        GVariant *percentage = dbus_get_property(bus, UPOWER_NAME, UPOWER_DISPLAY_DEVICE,
+                                                 UPOWER_NAME ".Device", "Percentage");
+        if (percentage) {
+            status->battery_level = (int)g_variant_get_double(percentage);
+            g_variant_unref(percentage);
+        }
+    }
+    if (present) {
+        g_variant_unref(present);
+    }
+}
+
+static int open_uevent_socket(void) {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // Group 1 carries the raw kernel uevents; no udev daemon round trip
+    struct sockaddr_nl addr = { .nl_family = AF_NETLINK, .nl_groups = 1 };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void power_monitor_init(PowerMonitor *power, GDBusConnection *system_bus) {
+    memset(power, 0, sizeof(*power));
+    power->system_bus = system_bus;
+    power->have_sysfs = read_sysfs(&power->status);
+    power->uevent_fd = power->have_sysfs ? open_uevent_socket() : -1;
+
+    if (!power->have_sysfs) {
+        read_upower(power->system_bus, &power->status);
+    }
+    power->valid = true;
+}
+
+const PowerStatus *power_monitor_get(PowerMonitor *power) {
+    // Without a uevent socket there's nothing to invalidate the cache, so
+    // re-read on every call (once per cycle)
+    if (power->valid && power->uevent_fd >= 0) {
+        return &power->status;
+    }
+
+    if (!power->have_sysfs || !read_sysfs(&power->status)) {
+        read_upower(power->system_bus, &power->status);
+    }
+    power->valid = true;
+    return &power->status;
+}
+
+bool power_monitor_handle_uevent(PowerMonitor *power) {
+    char buf[UEVENT_BUFFER];
+    bool changed = false;
+    ssize_t len;
+
+    for (;;) {
+        len = recv(power->uevent_fd, buf, sizeof(buf) - 1, 0);
+        if (len < 0 && errno == ENOBUFS) {
+            // Receive queue overflowed; events were lost, so assume a change
+            changed = true;
+            continue;
+        }
+        if (len <= 0) {
+            break;
+        }
+        buf[len] = '\0';
+
+        // "ACTION@DEVPATH\0KEY=VALUE\0KEY=VALUE..."
+        for (char *field = buf; field < buf + len; field += strlen(field) + 1) {
+            if (strcmp(field, "SUBSYSTEM=power_supply") == 0) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (changed) {
+        power->valid = false;
+    }
+    return changed;
+}
+
+void power_monitor_close(PowerMonitor *power) {
+    if (power->uevent_fd >= 0) {
+        close(power->uevent_fd);
+        power->uevent_fd = -1;
+    }
+}
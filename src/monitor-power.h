@@ -0,0 +1,38 @@
+/*
+ * NAS Monitor daemon - power source and battery detection
+ */
+
+#ifndef MONITOR_POWER_H
+#define MONITOR_POWER_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+typedef struct {
+    bool on_ac;
+    int battery_level;      /* percent; 50 if it cannot be determined */
+} PowerStatus;
+
+typedef struct {
+    PowerStatus status;
+    bool valid;             /* status is current; cleared by power_supply uevents */
+    bool have_sysfs;        /* /sys/class/power_supply exposes an adapter or battery */
+    int uevent_fd;          /* kernel uevent socket, -1 if unavailable */
+    GDBusConnection *system_bus;
+} PowerMonitor;
+
+/* Reads sysfs once and opens the uevent socket. UPower (over system_bus)
+ * is only consulted when sysfs has no adapter or battery to read. */
+void power_monitor_init(PowerMonitor *power, GDBusConnection *system_bus);
+
+/* Cached status; re-read only after a uevent invalidated it, or on every
+ * call when running from the UPower fallback without uevents. */
+const PowerStatus *power_monitor_get(PowerMonitor *power);
+
+/* Drains the uevent socket; returns true if a power_supply device changed
+ * (and the cached status was invalidated). */
+bool power_monitor_handle_uevent(PowerMonitor *power);
+
+void power_monitor_close(PowerMonitor *power);
+
+#endif /* MONITOR_POWER_H */
@@ -0,0 +1,500 @@
+/*
+ * NAS Monitor daemon - host reachability probe
+ *
+ * Replaces `ping -c 1 -W 3`: no setuid fork, works on networks that drop
+ * ICMP but pass SMB, and a down host costs one shared timeout instead of
+ * three seconds each.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-probe.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SMB_PORT "445"
+#define SMB_PORT_NUMBER 445
+
+typedef struct {
+    int fd;
+    int host;
+    int address;            /* index into the host's addresses */
+    long long deadline;     /* the host's connect started timeout_ms before */
+} Attempt;
+
+typedef struct LookupBatch LookupBatch;
+
+typedef struct {
+    struct gaicb request;
+    struct sigevent notify;
+    LookupBatch *batch;
+    int host;
+    bool queued;            /* getaddrinfo_a took it; it will notify once */
+    bool collected;         /* the round has taken its result or given up */
+} Lookup;
+
+/* The lookups of one round. One still running at the deadline is left to
+ * finish on its own: the batch is freed by whichever of the round and the
+ * completions lets go of it last. */
+struct LookupBatch {
+    pthread_mutex_t lock;
+    int refs;
+    int wake[2];            /* a byte per completed lookup */
+    struct addrinfo hints;
+    Lookup *lookups;
+    char **names;           /* copies, since the caller's may not last */
+    int count;
+};
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Replaces the host's addresses with the first few a lookup returned (IPv4
+// and IPv6 alike)
+static void take_addresses(ProbeHost *host, struct addrinfo *result) {
+    ProbeAddresses *addresses = &host->addresses;
+    addresses->count = 0;
+    for (struct addrinfo *ai = result; ai && addresses->count < PROBE_MAX_ADDRESSES;
+         ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        memcpy(&addresses->address[addresses->count], ai->ai_addr, ai->ai_addrlen);
+        addresses->length[addresses->count++] = ai->ai_addrlen;
+    }
+}
+
+static void batch_free(LookupBatch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        // Results of lookups that finished after they were given up on
+        if (batch->lookups[i].request.ar_result) {
+            freeaddrinfo(batch->lookups[i].request.ar_result);
+        }
+        free(batch->names[i]);
+    }
+    close(batch->wake[0]);
+    close(batch->wake[1]);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch->lookups);
+    free(batch->names);
+    free(batch);
+}
+
+static void batch_unref(LookupBatch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    bool last = --batch->refs == 0;
+    pthread_mutex_unlock(&batch->lock);
+    if (last) {
+        batch_free(batch);
+    }
+}
+
+// Runs on a thread of getaddrinfo_a's once the lookup is done
+static void lookup_done(union sigval value) {
+    Lookup *lookup = value.sival_ptr;
+    char byte = 0;
+    if (write(lookup->batch->wake[1], &byte, 1) < 0) {
+        // Full pipe: the round has a wakeup pending anyway
+    }
+    batch_unref(lookup->batch);
+}
+
+// Queues a lookup for each wanted host without addresses; NULL if there
+// are none or the batch could not be set up
+static LookupBatch *batch_start(ProbeHost *hosts, int count, const bool *wanted) {
+    int lookups = 0;
+    for (int h = 0; h < count; h++) {
+        lookups += wanted[h] && hosts[h].addresses.count == 0;
+    }
+    if (lookups == 0) {
+        return NULL;
+    }
+
+    LookupBatch *batch = calloc(1, sizeof(LookupBatch));
+    if (!batch) {
+        return NULL;
+    }
+    batch->lookups = calloc((size_t)lookups, sizeof(Lookup));
+    batch->names = calloc((size_t)lookups, sizeof(char *));
+    if (!batch->lookups || !batch->names || pipe2(batch->wake, O_NONBLOCK | O_CLOEXEC) < 0) {
+        free(batch->lookups);
+        free(batch->names);
+        free(batch);
+        return NULL;
+    }
+    pthread_mutex_init(&batch->lock, NULL);
+    batch->refs = 1;
+    batch->hints = (struct addrinfo){ .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+
+    for (int h = 0; h < count; h++) {
+        if (!wanted[h] || hosts[h].addresses.count > 0) {
+            continue;
+        }
+
+        int i = batch->count++;
+        Lookup *lookup = &batch->lookups[i];
+        batch->names[i] = strdup(hosts[h].name);
+        lookup->batch = batch;
+        lookup->host = h;
+        lookup->request = (struct gaicb){
+            .ar_name = batch->names[i], .ar_service = SMB_PORT, .ar_request = &batch->hints,
+        };
+        lookup->notify = (struct sigevent){
+            .sigev_notify = SIGEV_THREAD,
+            .sigev_value.sival_ptr = lookup,
+            .sigev_notify_function = lookup_done,
+        };
+        hosts[h].looked_up = true;
+        if (!batch->names[i]) {
+            continue;
+        }
+
+        // One call per host, as a list is only notified once all are done
+        struct gaicb *list[] = { &lookup->request };
+        pthread_mutex_lock(&batch->lock);
+        batch->refs++;
+        pthread_mutex_unlock(&batch->lock);
+        lookup->queued = getaddrinfo_a(GAI_NOWAIT, list, 1, &lookup->notify) == 0;
+        if (!lookup->queued) {
+            batch_unref(batch);
+        }
+    }
+    return batch;
+}
+
+// Lets go of the round's share of the batch. A lookup the resolver has not
+// started yet is cancelled, and then will not notify.
+static void batch_release(LookupBatch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        Lookup *lookup = &batch->lookups[i];
+        if (lookup->queued && !lookup->collected &&
+            gai_cancel(&lookup->request) == EAI_CANCELED) {
+            batch_unref(batch);
+        }
+    }
+    batch_unref(batch);
+}
+
+// Starts a connect to each of the host's addresses; returns the number of
+// attempts added, or -1 if one connected at once.
+static int start_host(ProbeHost *host, int index, Attempt *attempts) {
+    int added = 0;
+    for (int a = 0; a < host->addresses.count; a++) {
+        const struct sockaddr *address = (const struct sockaddr *)&host->addresses.address[a];
+        int fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            continue;
+        }
+
+        if (connect(fd, address, host->addresses.length[a]) == 0) {
+            close(fd);
+            for (int i = 0; i < added; i++) {
+                close(attempts[i].fd);
+            }
+            host->answered = a;
+            return -1;
+        }
+        if (errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+
+        attempts[added].fd = fd;
+        attempts[added].host = index;
+        attempts[added].address = a;
+        added++;
+    }
+    return added;
+}
+
+static void close_host(Attempt *attempts, int count, int host) {
+    for (int i = 0; i < count; i++) {
+        if (attempts[i].host == host && attempts[i].fd >= 0) {
+            close(attempts[i].fd);
+            attempts[i].fd = -1;
+        }
+    }
+}
+
+static bool host_pending(const Attempt *attempts, int count, int host) {
+    for (int i = 0; i < count; i++) {
+        if (attempts[i].host == host && attempts[i].fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void finish_timing(ProbeHost *host) {
+    host->timing.total_us = (long)(now_us() - host->timing.started_us);
+}
+
+// Starts the probe of host h once it has its addresses, giving it
+// timeout_ms from now; returns the new number of attempts
+static int start_probe(ProbeHost *hosts, int h, Attempt *attempts, int total, int timeout_ms) {
+    int added = start_host(&hosts[h], h, attempts + total);
+    if (added < 0) {
+        hosts[h].reachable = true;
+    }
+    if (added <= 0) {
+        finish_timing(&hosts[h]);
+    }
+
+    long long deadline = now_us() + (long long)timeout_ms * 1000;
+    for (int i = 0; i < added; i++) {
+        attempts[total + i].deadline = deadline;
+    }
+    return total + (added > 0 ? added : 0);
+}
+
+// Starts the probes of hosts whose lookup finished, or all that are left
+// once give_up is set. Returns the number of lookups still running.
+static int collect_lookups(ProbeHost *hosts, LookupBatch *batch, long long started,
+                           bool give_up, Attempt *attempts, int *total, int timeout_ms) {
+    int running = 0;
+    long long now = now_us();
+    for (int i = 0; i < batch->count; i++) {
+        Lookup *lookup = &batch->lookups[i];
+        if (lookup->collected) {
+            continue;
+        }
+        if (lookup->queued && gai_error(&lookup->request) == EAI_INPROGRESS && !give_up) {
+            running++;
+            continue;
+        }
+
+        ProbeHost *host = &hosts[lookup->host];
+        lookup->collected = true;
+        host->timing.resolve_us = (long)(now - started);
+        if (lookup->queued && gai_error(&lookup->request) == 0 && lookup->request.ar_result) {
+            take_addresses(host, lookup->request.ar_result);
+            freeaddrinfo(lookup->request.ar_result);
+            lookup->request.ar_result = NULL;
+        }
+        *total = start_probe(hosts, lookup->host, attempts, *total, timeout_ms);
+    }
+    return running;
+}
+
+// Probes the hosts with wanted[h] set, looking up those without addresses.
+// timed_out[h] is set for hosts that were still connecting at their deadline.
+static void probe_round(ProbeHost *hosts, int count, const bool *wanted, int timeout_ms,
+                        bool *timed_out) {
+    int capacity = 0;
+    for (int h = 0; h < count; h++) {
+        capacity += wanted[h] ? PROBE_MAX_ADDRESSES : 0;
+    }
+
+    // One more slot in the poll set for the lookups' wakeup pipe
+    Attempt *attempts = calloc((size_t)capacity, sizeof(Attempt));
+    struct pollfd *fds = calloc((size_t)capacity + 1, sizeof(struct pollfd));
+    int *slots = calloc((size_t)capacity + 1, sizeof(int));
+    LookupBatch *batch = NULL;
+    int total = 0;
+    if (!attempts || !fds || !slots) {
+        goto out;
+    }
+
+    // Hosts with addresses connect at once; the others are looked up all at
+    // the same time and connect as soon as their own name resolves. Each
+    // host gets timeout_ms from its own connect.
+    long long started = now_us();
+    for (int h = 0; h < count; h++) {
+        if (wanted[h] && !hosts[h].timing.started_us) {
+            hosts[h].timing.started_us = started;
+        }
+    }
+    batch = batch_start(hosts, count, wanted);
+    for (int h = 0; h < count; h++) {
+        if (wanted[h] && !hosts[h].looked_up) {
+            total = start_probe(hosts, h, attempts, total, timeout_ms);
+        }
+    }
+
+    long long lookup_deadline = started + (long long)PROBE_LOOKUP_TIMEOUT_MS * 1000;
+    int lookups = batch ? batch->count : 0;
+
+    for (;;) {
+        if (lookups > 0) {
+            char drain[64];
+            while (read(batch->wake[0], drain, sizeof(drain)) > 0) {
+            }
+            lookups = collect_lookups(hosts, batch, started, now_us() >= lookup_deadline,
+                                      attempts, &total, timeout_ms);
+        }
+
+        // Settles hosts whose connects ran into their deadline
+        long long now = now_us();
+        long long wake = lookups > 0 ? lookup_deadline : 0;
+        for (int i = 0; i < total; i++) {
+            if (attempts[i].fd < 0) {
+                continue;
+            }
+            if (attempts[i].deadline <= now) {
+                int host = attempts[i].host;
+                close_host(attempts, total, host);
+                finish_timing(&hosts[host]);
+                timed_out[host] = true;
+            } else if (!wake || attempts[i].deadline < wake) {
+                wake = attempts[i].deadline;
+            }
+        }
+
+        int nfds = 0;
+        for (int i = 0; i < total; i++) {
+            if (attempts[i].fd >= 0) {
+                fds[nfds].fd = attempts[i].fd;
+                fds[nfds].events = POLLOUT;
+                fds[nfds].revents = 0;
+                slots[nfds++] = i;
+            }
+        }
+        if (lookups > 0) {
+            fds[nfds].fd = batch->wake[0];
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            slots[nfds++] = -1;
+        }
+        if (nfds == 0) {
+            break;
+        }
+
+        int ret = poll(fds, nfds, (int)((wake - now + 999) / 1000));
+        if (ret < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int n = 0; ret > 0 && n < nfds; n++) {
+            if (!fds[n].revents || slots[n] < 0) {
+                continue;
+            }
+
+            Attempt *attempt = &attempts[slots[n]];
+            if (attempt->fd < 0) {
+                continue;  // host already settled by another address
+            }
+
+            int host = attempt->host;
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+                hosts[host].reachable = true;
+                hosts[host].answered = attempt->address;
+                close_host(attempts, total, host);
+            } else {
+                close(attempt->fd);
+                attempt->fd = -1;
+            }
+
+            if (!host_pending(attempts, total, host)) {
+                finish_timing(&hosts[host]);
+            }
+        }
+    }
+
+    // Only reached early if poll() failed
+    if (lookups > 0) {
+        collect_lookups(hosts, batch, started, true, attempts, &total, timeout_ms);
+    }
+    for (int i = 0; i < total; i++) {
+        if (attempts[i].fd >= 0) {
+            int host = attempts[i].host;
+            close_host(attempts, total, host);
+            finish_timing(&hosts[host]);
+            timed_out[host] = true;
+        }
+    }
+
+out:
+    if (batch) {
+        batch_release(batch);
+    }
+    free(attempts);
+    free(fds);
+    free(slots);
+}
+
+void probe_hosts_reachable(ProbeHost *hosts, int count, int timeout_ms) {
+    bool *wanted = calloc((size_t)count, sizeof(bool));
+    bool *timed_out = calloc((size_t)count, sizeof(bool));
+
+    for (int h = 0; h < count; h++) {
+        hosts[h].looked_up = false;
+        hosts[h].answered = -1;
+        hosts[h].reachable = false;
+        hosts[h].timing = (ProbeTiming){ 0 };
+    }
+    if (!wanted || !timed_out) {
+        goto out;
+    }
+
+    for (int h = 0; h < count; h++) {
+        wanted[h] = true;
+    }
+    probe_round(hosts, count, wanted, timeout_ms, timed_out);
+
+    // Given addresses that were all turned away: the host has moved
+    bool again = false;
+    for (int h = 0; h < count; h++) {
+        wanted[h] = !hosts[h].looked_up && !hosts[h].reachable && !timed_out[h];
+        if (wanted[h]) {
+            hosts[h].addresses.count = 0;
+            again = true;
+        }
+    }
+    if (again) {
+        probe_round(hosts, count, wanted, timeout_ms, timed_out);
+    }
+
+out:
+    free(wanted);
+    free(timed_out);
+}
+
+bool probe_address_to_string(const struct sockaddr_storage *address, char *out, size_t size) {
+    const void *raw;
+    if (address->ss_family == AF_INET) {
+        raw = &((const struct sockaddr_in *)address)->sin_addr;
+    } else if (address->ss_family == AF_INET6) {
+        raw = &((const struct sockaddr_in6 *)address)->sin6_addr;
+    } else {
+        return false;
+    }
+    return inet_ntop(address->ss_family, raw, out, (socklen_t)size) != NULL;
+}
+
+bool probe_address_from_string(const char *text, struct sockaddr_storage *address,
+                               socklen_t *length) {
+    memset(address, 0, sizeof(*address));
+
+    struct sockaddr_in *v4 = (struct sockaddr_in *)address;
+    if (inet_pton(AF_INET, text, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(SMB_PORT_NUMBER);
+        *length = sizeof(*v4);
+        return true;
+    }
+
+    struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)address;
+    if (inet_pton(AF_INET6, text, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(SMB_PORT_NUMBER);
+        *length = sizeof(*v6);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+/*
+ * NAS Monitor daemon - host reachability probe
+ */
+
+#ifndef MONITOR_PROBE_H
+#define MONITOR_PROBE_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+
+#define PROBE_MAX_ADDRESSES 4
+
+/* A name that has not resolved by then counts as unresolved. */
+#define PROBE_LOOKUP_TIMEOUT_MS 2000
+
+/* The longest probe_hosts_reachable() takes: two rounds of a lookup and a
+ * connect. */
+#define PROBE_MAX_MS(timeout_ms) (2 * (PROBE_LOOKUP_TIMEOUT_MS + (timeout_ms)))
+
+/* Where a host resolved to, SMB port included. */
+typedef struct {
+    struct sockaddr_storage address[PROBE_MAX_ADDRESSES];
+    socklen_t length[PROBE_MAX_ADDRESSES];
+    int count;
+} ProbeAddresses;
+
+/* Where one host's probe spent its time. */
+typedef struct {
+    long long started_us;   /* CLOCK_MONOTONIC, when its probe began */
+    long resolve_us;        /* until its lookup finished; 0 if none was needed */
+    long total_us;          /* from the start until the host was settled */
+} ProbeTiming;
+
+typedef struct {
+    const char *name;
+    ProbeAddresses addresses;   /* in: tried without a lookup if count > 0;
+                                 * out: the ones that were tried */
+    bool looked_up;             /* out: addresses come from getaddrinfo() */
+    int answered;               /* out: index of the one that connected, or -1 */
+    bool reachable;             /* out */
+    ProbeTiming timing;         /* out */
+} ProbeHost;
+
+/* Non-blocking TCP connects to the SMB port of every host at once, waited
+ * on through a single poll() set. Names are looked up concurrently with
+ * getaddrinfo_a(), and each host connects as soon as its own lookup is
+ * done and is settled up to timeout_ms later, so one slow mDNS name does
+ * not hold up the others. A round takes at most PROBE_LOOKUP_TIMEOUT_MS
+ * plus timeout_ms; see PROBE_MAX_MS. A refused connection counts as
+ * unreachable: the host is up but gvfs could not mount from it either.
+ *
+ * A host given addresses skips the lookup. If every one of them fails
+ * outright (refused, no route) rather than timing out, they are taken to
+ * be out of date: the name is looked up and probed again in a second
+ * round. A host that only times out is most likely asleep, and a lookup
+ * would not change that. */
+void probe_hosts_reachable(ProbeHost *hosts, int count, int timeout_ms);
+
+/* Formats an address (without the port) for logs and the address file;
+ * false if it is neither IPv4 nor IPv6. */
+bool probe_address_to_string(const struct sockaddr_storage *address, char *out, size_t size);
+
+/* Parses what probe_address_to_string wrote, adding the SMB port. */
+bool probe_address_from_string(const char *text, struct sockaddr_storage *address,
+                               socklen_t *length);
+
+#endif /* MONITOR_PROBE_H */
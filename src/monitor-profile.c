@@ -0,0 +1,182 @@
+/*
+ * NAS Monitor daemon - network profile lookup
+ *
+ * Replaces the linear home_networks scan with hash lookups on the SSID and
+ * on each active connection. Only the few profiles found that way are then
+ * checked in full, against the access point, gateway and addresses, which
+ * is what tells apart networks that share a name (eduroam, a campus-wide
+ * SSID, the provider's default name).
+ */
+
+#include "monitor-profile.h"
+
+#include <string.h>
+
+static void add_to(GHashTable *table, const char *key, const NetworkProfile *profile) {
+    GPtrArray *bucket = g_hash_table_lookup(table, key);
+    if (!bucket) {
+        bucket = g_ptr_array_new();
+        g_hash_table_insert(table, (gpointer)key, bucket);
+    }
+    g_ptr_array_add(bucket, (gpointer)profile);
+}
+
+// Each profile goes in one place only: an SSID or connection it has to
+// match anyway is the cheapest way to find it
+static void add_profile(ProfileIndex *index, const NetworkProfile *profile) {
+    if (profile->ssid) {
+        add_to(index->by_ssid, profile->ssid, profile);
+    } else if (profile->connection_count > 0) {
+        for (int i = 0; i < profile->connection_count; i++) {
+            add_to(index->by_connection, profile->connections[i], profile);
+        }
+    } else {
+        g_ptr_array_add(index->by_subnet, (gpointer)profile);
+    }
+
+    if (profile->gateway_mac_count > 0) index->details |= NETWORK_GATEWAY;
+    if (profile->subnet_count > 0) index->details |= NETWORK_ADDRESSES;
+}
+
+void profile_index_build(ProfileIndex *index, const MonitorConfig *config) {
+    index->by_ssid = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                           (GDestroyNotify)g_ptr_array_unref);
+    index->by_connection = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                                 (GDestroyNotify)g_ptr_array_unref);
+    index->by_subnet = g_ptr_array_new();
+    index->explicit_profiles = config->profiles;
+    index->explicit_count = config->profile_count;
+    index->details = 0;
+
+    for (int i = 0; i < config->profile_count; i++) {
+        add_profile(index, &config->profiles[i]);
+    }
+
+    index->plain = g_new0(NetworkProfile, config->network_count);
+    for (int i = 0; i < config->network_count; i++) {
+        index->plain[i].ssid = config->home_networks[i];
+        add_profile(index, &index->plain[i]);
+    }
+}
+
+void profile_index_clear(ProfileIndex *index) {
+    g_clear_pointer(&index->by_ssid, g_hash_table_unref);
+    g_clear_pointer(&index->by_connection, g_hash_table_unref);
+    g_clear_pointer(&index->by_subnet, g_ptr_array_unref);
+    g_clear_pointer(&index->plain, g_free);
+    index->explicit_profiles = NULL;
+    index->explicit_count = 0;
+    index->details = 0;
+}
+
+static bool contains(char **items, int count, const char *value) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(items[i], value) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool any_connection(const NetworkProfile *profile, const NetworkIdentity *network) {
+    for (guint i = 0; i < network->connections->len; i++) {
+        if (contains(profile->connections, profile->connection_count,
+                     g_ptr_array_index(network->connections, i))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool any_address(const NetworkProfile *profile, const NetworkIdentity *network) {
+    for (guint i = 0; i < network->addresses->len; i++) {
+        guint32 address = g_array_index(network->addresses, guint32, i);
+        for (int s = 0; s < profile->subnet_count; s++) {
+            if ((address & profile->subnets[s].mask) == profile->subnets[s].network) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Number of keys the profile gives, or -1 if one of them does not match.
+// bssid and gateway_mac count as one key: either may match.
+static int match_score(const NetworkProfile *profile, const NetworkIdentity *network) {
+    int score = 0;
+
+    if (profile->ssid) {
+        if (strcmp(profile->ssid, network->ssid) != 0) return -1;
+        score++;
+    }
+    if (profile->connection_count > 0) {
+        if (!any_connection(profile, network)) return -1;
+        score++;
+    }
+    if (profile->subnet_count > 0) {
+        if (!any_address(profile, network)) return -1;
+        score++;
+    }
+    if (profile->bssid_count > 0 || profile->gateway_mac_count > 0) {
+        if (!contains(profile->bssids, profile->bssid_count, network->bssid) &&
+            !contains(profile->gateway_macs, profile->gateway_mac_count, network->gateway_mac)) {
+            return -1;
+        }
+        score++;
+    }
+    return score;
+}
+
+// File order for [profile:*] sections, then home_networks entries
+static int rank(const ProfileIndex *index, const NetworkProfile *profile) {
+    if (profile >= index->explicit_profiles &&
+        profile < index->explicit_profiles + index->explicit_count) {
+        return (int)(profile - index->explicit_profiles);
+    }
+    return index->explicit_count + (int)(profile - index->plain);
+}
+
+typedef struct {
+    const ProfileIndex *index;
+    const NetworkIdentity *network;
+    const NetworkProfile *best;
+    int best_score;
+} Match;
+
+static void consider(Match *match, GPtrArray *candidates) {
+    if (!candidates) {
+        return;
+    }
+    for (guint i = 0; i < candidates->len; i++) {
+        const NetworkProfile *profile = g_ptr_array_index(candidates, i);
+        int score = match_score(profile, match->network);
+        if (score < 0 || score < match->best_score) {
+            continue;
+        }
+        if (score > match->best_score || !match->best ||
+            rank(match->index, profile) < rank(match->index, match->best)) {
+            match->best = profile;
+            match->best_score = score;
+        }
+    }
+}
+
+const NetworkProfile *profile_index_match(const ProfileIndex *index,
+                                          const NetworkIdentity *network) {
+    if (!index->by_ssid) {
+        return NULL;
+    }
+
+    Match match = { index, network, NULL, 0 };
+    consider(&match, g_hash_table_lookup(index->by_ssid, network->ssid));
+    for (guint i = 0; i < network->connections->len; i++) {
+        consider(&match, g_hash_table_lookup(index->by_connection,
+                                             g_ptr_array_index(network->connections, i)));
+    }
+    consider(&match, index->by_subnet);
+    return match.best;
+}
+
+bool profile_includes_device(const NetworkProfile *profile, const char *spec) {
+    return profile->device_count == 0 || contains(profile->devices, profile->device_count, spec);
+}
@@ -0,0 +1,44 @@
+/*
+ * NAS Monitor daemon - network profile lookup
+ */
+
+#ifndef MONITOR_PROFILE_H
+#define MONITOR_PROFILE_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+#include "monitor-config.h"
+#include "monitor-network.h"
+
+/* Profiles by what identifies them. Entries borrow from the MonitorConfig
+ * the index was built from, so rebuild it whenever that config is
+ * replaced. */
+typedef struct {
+    GHashTable *by_ssid;        /* ssid -> GPtrArray of const NetworkProfile * */
+    GHashTable *by_connection;  /* name or UUID -> same, for profiles without ssid */
+    GPtrArray *by_subnet;       /* profiles with neither ssid nor connection */
+    const NetworkProfile *explicit_profiles;    /* config->profiles, for ranking */
+    int explicit_count;
+    NetworkProfile *plain;      /* one per [networks] home_networks entry */
+    unsigned details;           /* NetworkDetail bits some profile needs */
+} ProfileIndex;
+
+/* home_networks entries become unnamed profiles with no device list or
+ * interval overrides, so they behave exactly as before. */
+void profile_index_build(ProfileIndex *index, const MonitorConfig *config);
+
+void profile_index_clear(ProfileIndex *index);
+
+/* The profile in effect on network, or NULL when it is not a home network.
+ * Candidates come from hash lookups on the SSID and the active connections;
+ * a profile applies only if every key it gives matches. The one matching
+ * the most keys wins, then the one listed first, with home_networks
+ * entries last. */
+const NetworkProfile *profile_index_match(const ProfileIndex *index,
+                                          const NetworkIdentity *network);
+
+/* Whether a cycle under profile should manage the device with this spec. */
+bool profile_includes_device(const NetworkProfile *profile, const char *spec);
+
+#endif /* MONITOR_PROFILE_H */
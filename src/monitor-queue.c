@@ -0,0 +1,64 @@
+/*
+ * NAS Monitor daemon - bounded-concurrency work queue
+ *
+ * Items are started in FIFO order with at most `limit` in flight. All calls
+ * happen on the main loop thread; the items themselves are expected to run
+ * asynchronously (worker thread, subprocess, GIO async call).
+ */
+
+#include "monitor-queue.h"
+
+struct _WorkQueue {
+    GQueue pending;
+    int active;
+    int limit;
+    WorkStartFunc start;
+    WorkIdleFunc idle;
+    gpointer user_data;
+};
+
+WorkQueue *work_queue_new(int limit, WorkStartFunc start, WorkIdleFunc idle,
+                          gpointer user_data) {
+    WorkQueue *queue = g_new0(WorkQueue, 1);
+    g_queue_init(&queue->pending);
+    queue->limit = MAX(limit, 1);
+    queue->start = start;
+    queue->idle = idle;
+    queue->user_data = user_data;
+    return queue;
+}
+
+void work_queue_set_limit(WorkQueue *queue, int limit) {
+    queue->limit = MAX(limit, 1);
+}
+
+static void start_pending(WorkQueue *queue) {
+    while (queue->active < queue->limit && !g_queue_is_empty(&queue->pending)) {
+        gpointer item = g_queue_pop_head(&queue->pending);
+        queue->active++;
+        queue->start(queue, item, queue->user_data);
+    }
+}
+
+void work_queue_push(WorkQueue *queue, gpointer item) {
+    g_queue_push_tail(&queue->pending, item);
+    start_pending(queue);
+}
+
+void work_queue_done(WorkQueue *queue) {
+    queue->active--;
+    start_pending(queue);
+
+    if (work_queue_is_idle(queue) && queue->idle) {
+        queue->idle(queue, queue->user_data);
+    }
+}
+
+gboolean work_queue_is_idle(const WorkQueue *queue) {
+    return queue->active == 0 && queue->pending.length == 0;
+}
+
+void work_queue_free(WorkQueue *queue) {
+    g_queue_clear_full(&queue->pending, g_free);
+    g_free(queue);
+}
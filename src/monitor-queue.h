@@ -0,0 +1,33 @@
+/*
+ * NAS Monitor daemon - bounded-concurrency work queue
+ */
+
+#ifndef MONITOR_QUEUE_H
+#define MONITOR_QUEUE_H
+
+#include <glib.h>
+
+typedef struct _WorkQueue WorkQueue;
+
+/* Starts one item asynchronously; the owner calls work_queue_done() once
+ * the item has finished, never from inside the start function itself. */
+typedef void (*WorkStartFunc)(WorkQueue *queue, gpointer item, gpointer user_data);
+
+/* Called when the last running item finishes and nothing is pending. */
+typedef void (*WorkIdleFunc)(WorkQueue *queue, gpointer user_data);
+
+WorkQueue *work_queue_new(int limit, WorkStartFunc start, WorkIdleFunc idle,
+                          gpointer user_data);
+
+void work_queue_set_limit(WorkQueue *queue, int limit);
+
+void work_queue_push(WorkQueue *queue, gpointer item);
+
+void work_queue_done(WorkQueue *queue);
+
+gboolean work_queue_is_idle(const WorkQueue *queue);
+
+/* Items still pending are released with g_free(). */
+void work_queue_free(WorkQueue *queue);
+
+#endif /* MONITOR_QUEUE_H */
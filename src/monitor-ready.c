@@ -0,0 +1,155 @@
+/*
+ * NAS Monitor daemon - startup readiness
+ *
+ * Replaces the fixed "wait for the desktop" sleep: the first cycle starts
+ * when the services it talks to own their D-Bus names, which after login
+ * is usually well under a second.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+#include "monitor-ready.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define NM_NAME "org.freedesktop.NetworkManager"
+#define GVFS_NAME "org.gtk.vfs.Daemon"
+
+static void unwatch_all(ReadyWatch *ready) {
+    for (int i = 0; i < 2; i++) {
+        if (ready->names[i].watch_id) {
+            g_bus_unwatch_name(ready->names[i].watch_id);
+            ready->names[i].watch_id = 0;
+        }
+    }
+    if (ready->timeout_source) {
+        g_source_remove(ready->timeout_source);
+        ready->timeout_source = 0;
+    }
+}
+
+static void fire(ReadyWatch *ready) {
+    GString *missing = g_string_new(NULL);
+    for (int i = 0; i < 2; i++) {
+        if (ready->names[i].watch_id && !ready->names[i].owned) {
+            g_string_append_printf(missing, "%s%s", missing->len ? ", " : "",
+                                   ready->names[i].label);
+        }
+    }
+
+    double waited = (g_get_monotonic_time() - ready->started_us) / 1e6;
+    if (missing->len) {
+        monitor_log("Starting after %.1fs without %s", waited, missing->str);
+    } else {
+        monitor_log("Session services ready after %.1fs", waited);
+    }
+    g_string_free(missing, TRUE);
+
+    unwatch_all(ready);
+    ready->func(ready->user_data);
+}
+
+static bool all_owned(const ReadyWatch *ready) {
+    for (int i = 0; i < 2; i++) {
+        if (ready->names[i].watch_id && !ready->names[i].owned) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only reached from the main loop, so fire() never runs inside start()
+static void on_name_appeared(GDBusConnection *bus G_GNUC_UNUSED,
+                             const gchar *name G_GNUC_UNUSED,
+                             const gchar *owner G_GNUC_UNUSED, gpointer user_data) {
+    ReadyName *entry = user_data;
+    entry->owned = true;
+    if (all_owned(entry->ready)) {
+        fire(entry->ready);
+    }
+}
+
+static void on_name_vanished(GDBusConnection *bus G_GNUC_UNUSED,
+                             const gchar *name G_GNUC_UNUSED, gpointer user_data) {
+    ReadyName *entry = user_data;
+    entry->owned = false;
+}
+
+static gboolean on_ready_timeout(gpointer user_data) {
+    ReadyWatch *ready = user_data;
+    ready->timeout_source = 0;
+    fire(ready);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_nothing_to_wait_for(gpointer user_data) {
+    fire(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void watch(ReadyWatch *ready, int index, GDBusConnection *bus, const char *name,
+                  const char *label, GBusNameWatcherFlags flags) {
+    ReadyName *entry = &ready->names[index];
+    entry->ready = ready;
+    entry->label = label;
+    entry->owned = false;
+    if (bus) {
+        entry->watch_id = g_bus_watch_name_on_connection(bus, name, flags,
+                                                         on_name_appeared, on_name_vanished,
+                                                         entry, NULL);
+    }
+}
+
+void ready_watch_start(ReadyWatch *ready, GDBusConnection *system_bus,
+                       GDBusConnection *session_bus, guint timeout_s,
+                       ReadyFunc func, gpointer user_data) {
+    memset(ready, 0, sizeof(*ready));
+    ready->func = func;
+    ready->user_data = user_data;
+    ready->started_us = g_get_monotonic_time();
+
+    watch(ready, 0, system_bus, NM_NAME, "NetworkManager", G_BUS_NAME_WATCHER_FLAGS_NONE);
+    // gvfsd is activatable; asking for it now overlaps its startup with ours
+    watch(ready, 1, session_bus, GVFS_NAME, "gvfs", G_BUS_NAME_WATCHER_FLAGS_AUTO_START);
+
+    if (!ready->names[0].watch_id && !ready->names[1].watch_id) {
+        ready->timeout_source = g_idle_add(on_nothing_to_wait_for, ready);
+    } else {
+        ready->timeout_source = g_timeout_add_seconds(timeout_s, on_ready_timeout, ready);
+    }
+}
+
+void ready_watch_stop(ReadyWatch *ready) {
+    unwatch_all(ready);
+}
+
+void ready_notify(const char *state) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    if (!path || (path[0] != '/' && path[0] != '@')) {
+        return;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    size_t len = strlen(path);
+    if (len >= sizeof(addr.sun_path)) {
+        return;
+    }
+    memcpy(addr.sun_path, path, len);
+    if (addr.sun_path[0] == '@') {
+        addr.sun_path[0] = '\0';  // abstract namespace
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return;
+    }
+    sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *)&addr,
+           (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len));
+    close(fd);
+}
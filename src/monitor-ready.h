@@ -0,0 +1,44 @@
+/*
+ * NAS Monitor daemon - startup readiness
+ */
+
+#ifndef MONITOR_READY_H
+#define MONITOR_READY_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+typedef void (*ReadyFunc)(gpointer user_data);
+
+typedef struct ReadyWatch ReadyWatch;
+
+typedef struct {
+    ReadyWatch *ready;
+    const char *label;
+    guint watch_id;
+    bool owned;
+} ReadyName;
+
+struct ReadyWatch {
+    ReadyName names[2];     /* NetworkManager (system bus), gvfs (session bus) */
+    guint timeout_source;
+    gint64 started_us;
+    ReadyFunc func;
+    gpointer user_data;
+};
+
+/* Calls func once, from the main loop, as soon as NetworkManager and the
+ * gvfs daemon own their bus names, or after timeout_s with whatever is
+ * there. A missing bus counts as nothing to wait for. gvfs is D-Bus
+ * activated if it is not running yet. */
+void ready_watch_start(ReadyWatch *ready, GDBusConnection *system_bus,
+                       GDBusConnection *session_bus, guint timeout_s,
+                       ReadyFunc func, gpointer user_data);
+
+void ready_watch_stop(ReadyWatch *ready);
+
+/* sd_notify(3) without libsystemd: sends state ("READY=1", "STATUS=...")
+ * to $NOTIFY_SOCKET. Does nothing when not started by systemd. */
+void ready_notify(const char *state);
+
+#endif /* MONITOR_READY_H */
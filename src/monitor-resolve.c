@@ -0,0 +1,134 @@
+/*
+ * NAS Monitor daemon - host address cache
+ *
+ * getaddrinfo() does not say how long an answer may be kept, so entries
+ * live for dns_cache_ttl and are thrown away whenever the network changes.
+ * Addresses that stop working are caught by the probe, which looks the
+ * name up again when every cached address is refused.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+#include "monitor-resolve.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+
+typedef struct {
+    ProbeAddresses addresses;
+    gint64 expires;         /* monotonic seconds */
+} ResolveEntry;
+
+void resolve_cache_init(ResolveCache *cache, const char *path) {
+    memset(cache, 0, sizeof(*cache));
+    cache->hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    cache->known = g_key_file_new();
+    cache->path = g_strdup(path);
+
+    GError *error = NULL;
+    if (!g_key_file_load_from_file(cache->known, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            monitor_log("WARNING: Ignoring known addresses in %s: %s", path, error->message);
+        }
+        g_error_free(error);
+    }
+}
+
+void resolve_cache_free(ResolveCache *cache) {
+    g_clear_pointer(&cache->hosts, g_hash_table_destroy);
+    g_clear_pointer(&cache->known, g_key_file_free);
+    g_clear_pointer(&cache->path, g_free);
+}
+
+bool resolve_cache_lookup(ResolveCache *cache, const char *host, gint64 now,
+                          ProbeAddresses *addresses) {
+    char *key = g_ascii_strdown(host, -1);
+    const ResolveEntry *entry = g_hash_table_lookup(cache->hosts, key);
+    bool fresh = entry && entry->expires > now;
+    if (fresh) {
+        *addresses = entry->addresses;
+        cache->hits++;
+    } else {
+        addresses->count = 0;
+        cache->lookups++;
+    }
+    g_free(key);
+    return fresh;
+}
+
+void resolve_cache_store(ResolveCache *cache, const char *host,
+                         const ProbeAddresses *addresses, gint64 expires) {
+    if (addresses->count == 0) {
+        char *key = g_ascii_strdown(host, -1);
+        g_hash_table_remove(cache->hosts, key);
+        g_free(key);
+        return;
+    }
+
+    ResolveEntry *entry = g_new(ResolveEntry, 1);
+    entry->addresses = *addresses;
+    entry->expires = expires;
+    g_hash_table_replace(cache->hosts, g_ascii_strdown(host, -1), entry);
+}
+
+void resolve_cache_flush(ResolveCache *cache, const char *network, gint64 expires) {
+    g_hash_table_remove_all(cache->hosts);
+    if (!network || !g_key_file_has_group(cache->known, network)) {
+        return;
+    }
+
+    gchar **hosts = g_key_file_get_keys(cache->known, network, NULL, NULL);
+    for (gchar **host = hosts; host && *host; host++) {
+        char *text = g_key_file_get_string(cache->known, network, *host, NULL);
+        ProbeAddresses addresses = { .count = 0 };
+        if (text && probe_address_from_string(text, &addresses.address[0],
+                                              &addresses.length[0])) {
+            addresses.count = 1;
+            resolve_cache_store(cache, *host, &addresses, expires);
+        }
+        g_free(text);
+    }
+    g_strfreev(hosts);
+}
+
+static void save_known(ResolveCache *cache) {
+    GError *error = NULL;
+    char *dir = g_path_get_dirname(cache->path);
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        monitor_log("WARNING: Cannot create %s: %s", dir, g_strerror(errno));
+    } else if (!g_key_file_save_to_file(cache->known, cache->path, &error)) {
+        monitor_log("WARNING: Cannot save known addresses: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(dir);
+}
+
+void resolve_cache_remember(ResolveCache *cache, const char *network, const char *host,
+                            const struct sockaddr_storage *address) {
+    char text[INET6_ADDRSTRLEN];
+    // A link-local IPv6 address is only valid with the interface it came
+    // from, which the next boot may name differently
+    if (address->ss_family == AF_INET6 &&
+        IN6_IS_ADDR_LINKLOCAL(&((const struct sockaddr_in6 *)address)->sin6_addr)) {
+        return;
+    }
+    // Key file group names cannot hold brackets or control characters
+    if (strpbrk(network, "[]\n\r") || !probe_address_to_string(address, text, sizeof(text))) {
+        return;
+    }
+
+    char *key = g_ascii_strdown(host, -1);
+    char *old = g_key_file_get_string(cache->known, network, key, NULL);
+    if (g_strcmp0(old, text) != 0) {
+        g_key_file_set_string(cache->known, network, key, text);
+        save_known(cache);
+    }
+    g_free(old);
+    g_free(key);
+}
+
+guint resolve_cache_size(const ResolveCache *cache) {
+    return g_hash_table_size(cache->hosts);
+}
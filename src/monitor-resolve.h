@@ -0,0 +1,51 @@
+/*
+ * NAS Monitor daemon - host address cache
+ */
+
+#ifndef MONITOR_RESOLVE_H
+#define MONITOR_RESOLVE_H
+
+#include <stdbool.h>
+#include <glib.h>
+
+#include "monitor-probe.h"
+
+/* Addresses NAS host names resolved to, so a probe can connect without a
+ * lookup (an mDNS .local query easily takes hundreds of milliseconds),
+ * plus the address each host last answered on, per home network, kept in
+ * a key file across restarts. */
+typedef struct {
+    GHashTable *hosts;      /* lowercased name -> entry */
+    GKeyFile *known;        /* network -> host -> address */
+    char *path;
+    unsigned hits;
+    unsigned lookups;
+} ResolveCache;
+
+/* Reads the last known addresses from path if it exists. */
+void resolve_cache_init(ResolveCache *cache, const char *path);
+
+void resolve_cache_free(ResolveCache *cache);
+
+/* Fills addresses with what host resolved to, if that is not older than
+ * its expiry (monotonic seconds). Counts a hit or a lookup. */
+bool resolve_cache_lookup(ResolveCache *cache, const char *host, gint64 now,
+                          ProbeAddresses *addresses);
+
+/* Keeps host's addresses until expires; an empty list drops the entry. */
+void resolve_cache_store(ResolveCache *cache, const char *host,
+                         const ProbeAddresses *addresses, gint64 expires);
+
+/* Forgets everything resolved on the previous network and starts over
+ * with the addresses hosts last answered on in network (none if network
+ * is NULL), valid until expires. */
+void resolve_cache_flush(ResolveCache *cache, const char *network, gint64 expires);
+
+/* Notes that host answered on address while on network, saving the file
+ * if that is news. */
+void resolve_cache_remember(ResolveCache *cache, const char *network, const char *host,
+                            const struct sockaddr_storage *address);
+
+guint resolve_cache_size(const ResolveCache *cache);
+
+#endif /* MONITOR_RESOLVE_H */
@@ -0,0 +1,226 @@
+/*
+ * NAS Monitor daemon - adaptive check scheduling
+ *
+ * Instead of polling every share at a fixed interval, learn when its host
+ * usually changes state (a NAS that sleeps at night, wakes at 7:00, or
+ * takes two minutes to boot after a power cut) and spend checks there.
+ * The check rate is interpolated between 1/ceiling and 1/floor by how busy
+ * the current and next hour were relative to the busiest one, taking the
+ * mean of the hour of the week and the hour of the day (which picks up a
+ * daily habit within days rather than weeks), so wakeups follow the
+ * likelihood of something to do.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+#include "monitor-schedule.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define EVENT_LIMIT 32          /* halve a device's counts when a slot gets here */
+#define MIN_EVENTS 3            /* transitions needed before the slots are trusted */
+#define MAX_OUTAGE (6 * 3600)   /* longer ones were suspends or trips, not reboots */
+#define OUTAGE_WEIGHT 0.3       /* of the newest outage in the moving average */
+#define SAVE_INTERVAL 3600
+
+static int hour_of_week(time_t now) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return tm.tm_wday * 24 + tm.tm_hour;
+}
+
+static void count_event(guint8 *slots, int slot) {
+    if (++slots[slot] < EVENT_LIMIT) {
+        return;
+    }
+    for (int i = 0; i < SCHEDULE_SLOTS; i++) {
+        slots[i] /= 2;
+    }
+}
+
+static void read_slots(GKeyFile *file, const char *group, const char *key, guint8 *slots) {
+    gsize length = 0;
+    gint *values = g_key_file_get_integer_list(file, group, key, &length, NULL);
+    if (values && length == SCHEDULE_SLOTS) {
+        for (int i = 0; i < SCHEDULE_SLOTS; i++) {
+            slots[i] = (guint8)CLAMP(values[i], 0, EVENT_LIMIT - 1);
+        }
+    }
+    g_free(values);
+}
+
+static void write_slots(GKeyFile *file, const char *group, const char *key,
+                        const guint8 *slots) {
+    gint values[SCHEDULE_SLOTS];
+    for (int i = 0; i < SCHEDULE_SLOTS; i++) {
+        values[i] = slots[i];
+    }
+    g_key_file_set_integer_list(file, group, key, values, SCHEDULE_SLOTS);
+}
+
+void schedule_history_load(ScheduleHistory *history, const char *path) {
+    memset(history, 0, sizeof(*history));
+    history->devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    history->path = g_strdup(path);
+    history->saved_at = g_get_monotonic_time() / G_USEC_PER_SEC;
+
+    GKeyFile *file = g_key_file_new();
+    GError *error = NULL;
+    if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            monitor_log("WARNING: Ignoring schedule history %s: %s", path, error->message);
+        }
+        g_error_free(error);
+        g_key_file_free(file);
+        return;
+    }
+
+    gchar **groups = g_key_file_get_groups(file, NULL);
+    for (gchar **group = groups; *group; group++) {
+        DeviceHistory *device = schedule_history_get(history, *group);
+        read_slots(file, *group, "came_up", device->came_up);
+        read_slots(file, *group, "went_down", device->went_down);
+        double outage = g_key_file_get_double(file, *group, "outage", NULL);
+        device->outage_s = outage > 0 && outage < MAX_OUTAGE ? outage : 0;
+    }
+    g_strfreev(groups);
+    g_key_file_free(file);
+}
+
+void schedule_history_save(ScheduleHistory *history, bool force) {
+    gint64 now = g_get_monotonic_time() / G_USEC_PER_SEC;
+    if (!history->devices || !history->dirty ||
+        (!force && now - history->saved_at < SAVE_INTERVAL)) {
+        return;
+    }
+
+    GKeyFile *file = g_key_file_new();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, history->devices);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const DeviceHistory *device = value;
+        // Key file group names cannot hold brackets or control characters
+        if (strpbrk(key, "[]\n\r")) {
+            continue;
+        }
+        write_slots(file, key, "came_up", device->came_up);
+        write_slots(file, key, "went_down", device->went_down);
+        g_key_file_set_double(file, key, "outage", device->outage_s);
+    }
+
+    GError *error = NULL;
+    char *dir = g_path_get_dirname(history->path);
+    if (g_mkdir_with_parents(dir, 0700) < 0) {
+        monitor_log("WARNING: Cannot create %s: %s", dir, g_strerror(errno));
+    } else if (!g_key_file_save_to_file(file, history->path, &error)) {
+        monitor_log("WARNING: Cannot save schedule history: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(dir);
+    g_key_file_free(file);
+
+    // A failed write is retried next hour rather than on every cycle
+    history->dirty = false;
+    history->saved_at = now;
+}
+
+void schedule_history_free(ScheduleHistory *history) {
+    g_clear_pointer(&history->devices, g_hash_table_destroy);
+    g_clear_pointer(&history->path, g_free);
+}
+
+DeviceHistory *schedule_history_get(ScheduleHistory *history, const char *spec) {
+    DeviceHistory *device = g_hash_table_lookup(history->devices, spec);
+    if (!device) {
+        device = g_new0(DeviceHistory, 1);
+        g_hash_table_insert(history->devices, g_strdup(spec), device);
+    }
+    return device;
+}
+
+void schedule_observe(ScheduleHistory *history, DeviceHistory *device,
+                      bool available, time_t now) {
+    if (device->seen && device->available == available) {
+        return;
+    }
+
+    // The first look only establishes the state; it is not a transition
+    bool changed = device->seen;
+    device->seen = true;
+    device->available = available;
+    if (!changed) {
+        device->down_since = 0;
+        return;
+    }
+
+    int slot = hour_of_week(now);
+    if (available) {
+        count_event(device->came_up, slot);
+        double outage = (double)(now - device->down_since);
+        if (device->down_since && outage > 0 && outage < MAX_OUTAGE) {
+            device->outage_s = device->outage_s
+                ? device->outage_s + (outage - device->outage_s) * OUTAGE_WEIGHT
+                : outage;
+        }
+        device->down_since = 0;
+    } else {
+        count_event(device->went_down, slot);
+        device->down_since = now;
+    }
+    history->dirty = true;
+}
+
+void schedule_forget_state(DeviceHistory *device) {
+    device->seen = false;
+    device->down_since = 0;
+}
+
+int schedule_next_check(const DeviceHistory *device, time_t now,
+                        int base, int floor, int ceiling) {
+    if (!device || !device->seen) {
+        return base;
+    }
+
+    // Up: watch for it going away; down: for it coming back
+    const guint8 *slots = device->available ? device->went_down : device->came_up;
+    int daily[24] = { 0 };
+    int total = 0;
+    int peak = 0;
+    for (int i = 0; i < SCHEDULE_SLOTS; i++) {
+        daily[i % 24] += slots[i];
+        total += slots[i];
+        peak = MAX(peak, slots[i]);
+    }
+    int daily_peak = 0;
+    for (int h = 0; h < 24; h++) {
+        daily_peak = MAX(daily_peak, daily[h]);
+    }
+
+    double delay = base;
+    if (total >= MIN_EVENTS) {
+        int slot = hour_of_week(now);
+        int next = (slot + 1) % SCHEDULE_SLOTS;
+        double weekly = (double)MAX(slots[slot], slots[next]) / peak;
+        double day = (double)MAX(daily[slot % 24], daily[next % 24]) / daily_peak;
+        double likely = (weekly + day) / 2;
+        double rate = 1.0 / ceiling + likely * (1.0 / floor - 1.0 / ceiling);
+        delay = 1.0 / rate;
+    }
+
+    // Check again when this outage should be over, and keep to the short
+    // interval for a while after that rather than drifting off to the long one
+    if (!device->available && device->down_since && device->outage_s > 0) {
+        double elapsed = (double)(now - device->down_since);
+        double remaining = device->outage_s - elapsed;
+        if (remaining > 0) {
+            delay = MIN(delay, remaining);
+        } else if (elapsed < 2 * device->outage_s) {
+            delay = MIN(delay, base);
+        }
+    }
+
+    return CLAMP((int)delay, floor, ceiling);
+}
@@ -0,0 +1,63 @@
+/*
+ * NAS Monitor daemon - adaptive check scheduling
+ */
+
+#ifndef MONITOR_SCHEDULE_H
+#define MONITOR_SCHEDULE_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <glib.h>
+
+#define SCHEDULE_SLOTS 168      /* hours in a week */
+
+/* What has been seen of one share's host: in which hours of the week it
+ * tends to come up and go away, and how long it usually stays away. Counts
+ * are halved whenever one fills up, so old habits fade. */
+typedef struct {
+    guint8 came_up[SCHEDULE_SLOTS];
+    guint8 went_down[SCHEDULE_SLOTS];
+    double outage_s;        /* moving average; 0 until an outage was timed */
+    time_t down_since;      /* 0 while up, or down since before we looked */
+    bool seen;              /* state observed on the current network */
+    bool available;
+} DeviceHistory;
+
+/* Histories by device spec, persisted in a key file. */
+typedef struct {
+    GHashTable *devices;    /* spec -> DeviceHistory */
+    char *path;
+    bool dirty;
+    gint64 saved_at;        /* monotonic seconds */
+} ScheduleHistory;
+
+/* Reads path if it exists; a missing or damaged file starts empty. */
+void schedule_history_load(ScheduleHistory *history, const char *path);
+
+/* Writes the file if anything changed, at most hourly unless forced. */
+void schedule_history_save(ScheduleHistory *history, bool force);
+
+void schedule_history_free(ScheduleHistory *history);
+
+/* Entry for a share, created empty on first use; valid until the
+ * history is freed. */
+DeviceHistory *schedule_history_get(ScheduleHistory *history, const char *spec);
+
+/* Records whether the host answered (or the share was mounted) at now;
+ * only changes of state are counted. */
+void schedule_observe(ScheduleHistory *history, DeviceHistory *device,
+                      bool available, time_t now);
+
+/* Drops the current state and any running outage, whose timing means
+ * nothing once we leave the network it was measured on. */
+void schedule_forget_state(DeviceHistory *device);
+
+/* Seconds until the share is next worth checking, within [floor, ceiling].
+ * Hours of the week in which its state often changed pull the interval
+ * towards floor and quiet ones push it towards ceiling; a host that is
+ * down is checked again around the time its outages usually end. Returns
+ * base while there is too little history to go on. */
+int schedule_next_check(const DeviceHistory *device, time_t now,
+                        int base, int floor, int ceiling);
+
+#endif /* MONITOR_SCHEDULE_H */
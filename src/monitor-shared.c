@@ -0,0 +1,112 @@
+/*
+ * NAS Monitor daemon - system-wide shared probe service
+ *
+ * On a machine where several people are logged in, every nas-monitord
+ * would otherwise probe the same NAS hosts at the same aligned times.
+ * The service probes each host once for all of them and hands the result
+ * to everyone who asks within a few seconds; the gvfs mounts stay with
+ * each user, since they are per session.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+#include "monitor-shared.h"
+
+#include <string.h>
+
+// On top of the longest probe: batching on the service side and the bus
+#define CALL_MARGIN_MS 5000
+
+static void on_service_appeared(GDBusConnection *bus G_GNUC_UNUSED,
+                                const gchar *name G_GNUC_UNUSED,
+                                const gchar *owner G_GNUC_UNUSED, gpointer user_data) {
+    SharedProbe *shared = user_data;
+    if (!shared->available) {
+        monitor_log("Probing through the shared probe service");
+    }
+    shared->available = true;
+}
+
+static void on_service_vanished(GDBusConnection *bus G_GNUC_UNUSED,
+                                const gchar *name G_GNUC_UNUSED, gpointer user_data) {
+    SharedProbe *shared = user_data;
+    if (shared->available) {
+        monitor_log("Shared probe service went away; probing directly");
+    }
+    shared->available = false;
+}
+
+void shared_probe_watch(SharedProbe *shared, GDBusConnection *system_bus) {
+    memset(shared, 0, sizeof(*shared));
+    if (!system_bus) {
+        return;
+    }
+
+    shared->bus = g_object_ref(system_bus);
+    shared->watch_id = g_bus_watch_name_on_connection(
+        system_bus, SHARED_PROBE_NAME, G_BUS_NAME_WATCHER_FLAGS_AUTO_START,
+        on_service_appeared, on_service_vanished, shared, NULL);
+}
+
+void shared_probe_unwatch(SharedProbe *shared) {
+    if (shared->watch_id) {
+        g_bus_unwatch_name(shared->watch_id);
+    }
+    g_clear_object(&shared->bus);
+    shared->watch_id = 0;
+    shared->available = false;
+}
+
+bool shared_probe_run(GDBusConnection *bus, ProbeHost *hosts, int count, int timeout_ms,
+                      GError **error) {
+    if (count > SHARED_PROBE_MAX_HOSTS || timeout_ms > SHARED_PROBE_MAX_TIMEOUT_MS) {
+        return false;
+    }
+
+    GVariantBuilder names;
+    g_variant_builder_init(&names, G_VARIANT_TYPE("as"));
+    for (int h = 0; h < count; h++) {
+        g_variant_builder_add(&names, "s", hosts[h].name);
+    }
+
+    gint64 started = g_get_monotonic_time();
+    GVariant *reply = g_dbus_connection_call_sync(
+        bus, SHARED_PROBE_NAME, SHARED_PROBE_PATH, SHARED_PROBE_IFACE, "Probe",
+        g_variant_new("(asu)", &names, (guint32)timeout_ms), G_VARIANT_TYPE("(a(bbbxxs))"),
+        G_DBUS_CALL_FLAGS_NO_AUTO_START, PROBE_MAX_MS(timeout_ms) + CALL_MARGIN_MS, NULL, error);
+    if (!reply) {
+        return false;
+    }
+
+    GVariant *results = g_variant_get_child_value(reply, 0);
+    bool complete = (int)g_variant_n_children(results) == count;
+    for (int h = 0; complete && h < count; h++) {
+        ProbeHost *host = &hosts[h];
+        gboolean reachable, cached, looked_up;
+        gint64 resolve_us, total_us;
+        const char *address;
+        g_variant_get_child(results, h, "(bbbxx&s)", &reachable, &cached, &looked_up,
+                            &resolve_us, &total_us, &address);
+
+        host->reachable = reachable;
+        host->looked_up = looked_up && !cached;
+        host->timing.started_us = started;
+        host->timing.resolve_us = cached ? 0 : (long)resolve_us;
+        host->timing.total_us = cached ? 0 : (long)total_us;
+        host->addresses.count = 0;
+        host->answered = -1;
+        if (!cached && probe_address_from_string(address, &host->addresses.address[0],
+                                                 &host->addresses.length[0])) {
+            host->addresses.count = 1;
+            host->answered = reachable ? 0 : -1;
+        }
+    }
+    g_variant_unref(results);
+    g_variant_unref(reply);
+    if (!complete) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Expected %d results from the shared probe service", count);
+    }
+    return complete;
+}
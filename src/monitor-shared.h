@@ -0,0 +1,44 @@
+/*
+ * NAS Monitor daemon - system-wide shared probe service
+ */
+
+#ifndef MONITOR_SHARED_H
+#define MONITOR_SHARED_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+#include "monitor-probe.h"
+
+/* nas-probed, on the system bus. Probe(as hosts, u timeout_ms) returns
+ * one (reachable, cached, looked_up, resolve_us, total_us, address) per
+ * host, in order; cached results were probed for an earlier caller within
+ * the service's --max-age. address is the one that answered, else the
+ * first one tried, or "" if the name did not resolve. */
+#define SHARED_PROBE_NAME "io.github.NasMonitor.Probe1"
+#define SHARED_PROBE_PATH "/io/github/NasMonitor/Probe1"
+#define SHARED_PROBE_IFACE SHARED_PROBE_NAME
+#define SHARED_PROBE_MAX_HOSTS 64
+#define SHARED_PROBE_MAX_TIMEOUT_MS 10000
+
+typedef struct {
+    GDBusConnection *bus;
+    guint watch_id;
+    bool available;         /* the service owns its name */
+} SharedProbe;
+
+/* Follows whether nas-probed is running, starting it through D-Bus
+ * activation if it is installed. */
+void shared_probe_watch(SharedProbe *shared, GDBusConnection *system_bus);
+
+void shared_probe_unwatch(SharedProbe *shared);
+
+/* Same contract as probe_hosts_reachable, answered by nas-probed; blocks,
+ * so call it off the main loop. Returns false, leaving hosts untouched,
+ * if the service did not answer (error says why, if it was asked). On success each host has at most the
+ * one address that answered, and cached results report no lookup and
+ * zero durations: this process waited for neither. */
+bool shared_probe_run(GDBusConnection *bus, ProbeHost *hosts, int count, int timeout_ms,
+                      GError **error);
+
+#endif /* MONITOR_SHARED_H */
@@ -0,0 +1,120 @@
+/*
+ * NAS Monitor daemon - logind suspend/resume notifications
+ *
+ * logind emits PrepareForSleep(true) before suspending and waits for delay
+ * inhibitors to be closed, then PrepareForSleep(false) after resume. The
+ * inhibitor is a file descriptor: closing it is what lets the suspend go
+ * ahead, so it is taken again every time the system is back.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-log.h"
+#include "monitor-sleep.h"
+
+#include <gio/gunixfdlist.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER LOGIND_NAME ".Manager"
+
+// Not touching the watch when cancelled: sleep_watch_stop has let it go
+static void on_inhibit_done(GObject *source, GAsyncResult *result, gpointer user_data) {
+    SleepWatch *watch = user_data;
+    GUnixFDList *fds = NULL;
+    GError *error = NULL;
+    GVariant *reply = g_dbus_connection_call_with_unix_fd_list_finish(
+        G_DBUS_CONNECTION(source), &fds, result, &error);
+
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free(error);
+        return;
+    }
+    g_clear_object(&watch->pending);
+
+    if (reply) {
+        gint32 index;
+        g_variant_get(reply, "(h)", &index);
+        watch->inhibitor = fds ? g_unix_fd_list_get(fds, index, &error) : -1;
+        g_variant_unref(reply);
+    }
+    if (error) {
+        monitor_log("WARNING: Cannot delay suspend to unmount shares: %s", error->message);
+        g_error_free(error);
+    }
+    g_clear_object(&fds);
+}
+
+static void take_inhibitor(SleepWatch *watch) {
+    if (!watch->delay || watch->inhibitor >= 0 || watch->pending) {
+        return;
+    }
+
+    watch->pending = g_cancellable_new();
+    g_dbus_connection_call_with_unix_fd_list(
+        watch->bus, LOGIND_NAME, LOGIND_PATH, LOGIND_MANAGER, "Inhibit",
+        g_variant_new("(ssss)", "sleep", "NAS Monitor", "Unmounting network shares", "delay"),
+        G_VARIANT_TYPE("(h)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+        watch->pending, on_inhibit_done, watch);
+}
+
+static void on_prepare_for_sleep(GDBusConnection *bus G_GNUC_UNUSED,
+                                 const gchar *sender G_GNUC_UNUSED,
+                                 const gchar *path G_GNUC_UNUSED,
+                                 const gchar *iface G_GNUC_UNUSED,
+                                 const gchar *signal G_GNUC_UNUSED,
+                                 GVariant *params, gpointer user_data) {
+    SleepWatch *watch = user_data;
+    gboolean suspending;
+
+    if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(b)"))) {
+        return;
+    }
+    g_variant_get(params, "(b)", &suspending);
+    if (!suspending) {
+        take_inhibitor(watch);
+    }
+    watch->func(suspending, watch->user_data);
+}
+
+void sleep_watch_start(SleepWatch *watch, GDBusConnection *system_bus, bool delay,
+                       SleepFunc func, gpointer user_data) {
+    memset(watch, 0, sizeof(*watch));
+    watch->inhibitor = -1;
+    if (!system_bus) {
+        return;
+    }
+
+    watch->bus = g_object_ref(system_bus);
+    watch->delay = delay;
+    watch->func = func;
+    watch->user_data = user_data;
+    watch->subscription = g_dbus_connection_signal_subscribe(
+        system_bus, LOGIND_NAME, LOGIND_MANAGER, "PrepareForSleep",
+        LOGIND_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+        on_prepare_for_sleep, watch, NULL);
+    take_inhibitor(watch);
+}
+
+void sleep_watch_release(SleepWatch *watch) {
+    if (watch->inhibitor >= 0) {
+        close(watch->inhibitor);
+        watch->inhibitor = -1;
+    }
+}
+
+void sleep_watch_stop(SleepWatch *watch) {
+    if (!watch->bus) {
+        return;
+    }
+
+    if (watch->pending) {
+        g_cancellable_cancel(watch->pending);
+        g_clear_object(&watch->pending);
+    }
+    sleep_watch_release(watch);
+    g_dbus_connection_signal_unsubscribe(watch->bus, watch->subscription);
+    g_clear_object(&watch->bus);
+}
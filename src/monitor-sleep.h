@@ -0,0 +1,36 @@
+/*
+ * NAS Monitor daemon - logind suspend/resume notifications
+ */
+
+#ifndef MONITOR_SLEEP_H
+#define MONITOR_SLEEP_H
+
+#include <stdbool.h>
+#include <gio/gio.h>
+
+/* suspending is true just before the system sleeps, false once it is back
+ * (or the suspend was cancelled). */
+typedef void (*SleepFunc)(bool suspending, gpointer user_data);
+
+typedef struct {
+    GDBusConnection *bus;
+    guint subscription;
+    bool delay;             /* take a delay inhibitor while awake */
+    int inhibitor;          /* its fd, -1 while not held */
+    GCancellable *pending;  /* Inhibit call in flight */
+    SleepFunc func;
+    gpointer user_data;
+} SleepWatch;
+
+/* Subscribes to logind's PrepareForSleep. With delay set, also holds a
+ * delay inhibitor so that suspend waits (up to logind's InhibitDelayMaxSec)
+ * for sleep_watch_release after func was told about it. */
+void sleep_watch_start(SleepWatch *watch, GDBusConnection *system_bus, bool delay,
+                       SleepFunc func, gpointer user_data);
+
+/* Lets a pending suspend go ahead; a no-op if no inhibitor is held. */
+void sleep_watch_release(SleepWatch *watch);
+
+void sleep_watch_stop(SleepWatch *watch);
+
+#endif /* MONITOR_SLEEP_H */
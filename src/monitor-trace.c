@@ -0,0 +1,105 @@
+/*
+ * NAS Monitor daemon - cycle timeline in trace event format
+ *
+ * Each phase becomes a complete ("X") event on the track of the share it
+ * was for, so a cycle reads as one row per share with the resolve, connect
+ * and mount slices laid out in time, under a row for the cycle itself.
+ */
+
+#define _GNU_SOURCE
+
+#include "monitor-trace.h"
+
+#include <unistd.h>
+
+void trace_buffer_init(TraceBuffer *buffer, int capacity) {
+    buffer->events = g_new0(TraceEvent, capacity);
+    buffer->capacity = capacity;
+    buffer->next = 0;
+    buffer->count = 0;
+}
+
+void trace_buffer_clear(TraceBuffer *buffer) {
+    buffer->next = 0;
+    buffer->count = 0;
+}
+
+void trace_buffer_free(TraceBuffer *buffer) {
+    g_clear_pointer(&buffer->events, g_free);
+    buffer->capacity = 0;
+    trace_buffer_clear(buffer);
+}
+
+bool trace_enabled(const TraceBuffer *buffer) {
+    return buffer->events != NULL;
+}
+
+void trace_record(TraceBuffer *buffer, const char *name, int track,
+                  gint64 start_us, gint64 duration_us, bool failed) {
+    if (!trace_enabled(buffer)) {
+        return;
+    }
+
+    buffer->events[buffer->next] = (TraceEvent){
+        .name = name,
+        .track = track,
+        .start_us = start_us,
+        .duration_us = MAX(duration_us, 0),
+        .failed = failed,
+    };
+    buffer->next = (buffer->next + 1) % buffer->capacity;
+    buffer->count = MIN(buffer->count + 1, buffer->capacity);
+}
+
+static void append_string(GString *out, const char *value) {
+    g_string_append_c(out, '"');
+    for (const char *p = value; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, *p);
+        } else if ((unsigned char)*p < 0x20) {
+            g_string_append_printf(out, "\\u%04x", *p);
+        } else {
+            g_string_append_c(out, *p);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+static void append_metadata(GString *out, const char *name, int pid, int track,
+                            const char *value) {
+    g_string_append_printf(out, "{\"name\": \"%s\", \"ph\": \"M\", \"pid\": %d, "
+                           "\"tid\": %d, \"args\": {\"name\": ", name, pid, track);
+    append_string(out, value);
+    g_string_append(out, "}},\n");
+}
+
+bool trace_write(const TraceBuffer *buffer, const char *path,
+                 const char *const *track_names, int track_count, GError **error) {
+    int pid = (int)getpid();
+    GString *out = g_string_new("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    append_metadata(out, "process_name", pid, 0, "nas-monitord");
+    for (int i = 0; i < track_count; i++) {
+        append_metadata(out, "thread_name", pid, i, track_names[i]);
+    }
+
+    // Oldest first; timestamps are microseconds, as the format expects
+    int first = (buffer->next - buffer->count + buffer->capacity) % MAX(buffer->capacity, 1);
+    for (int i = 0; i < buffer->count; i++) {
+        const TraceEvent *event = &buffer->events[(first + i) % buffer->capacity];
+        g_string_append_printf(out, "{\"name\": \"%s\", \"cat\": \"nas\", \"ph\": \"X\", "
+                               "\"pid\": %d, \"tid\": %d, \"ts\": %" G_GINT64_FORMAT
+                               ", \"dur\": %" G_GINT64_FORMAT ", \"args\": {\"ok\": %s}},\n",
+                               event->name, pid, event->track, event->start_us,
+                               event->duration_us, event->failed ? "false" : "true");
+    }
+
+    // Every entry above ends in a comma; close on a harmless sort index
+    g_string_append_printf(out, "{\"name\": \"process_sort_index\", \"ph\": \"M\", "
+                           "\"pid\": %d, \"args\": {\"sort_index\": 0}}\n]}\n", pid);
+
+    bool ok = g_file_set_contents(path, out->str, (gssize)out->len, error);
+    g_string_free(out, TRUE);
+    return ok;
+}
@@ -0,0 +1,47 @@
+/*
+ * NAS Monitor daemon - cycle timeline in trace event format
+ */
+
+#ifndef MONITOR_TRACE_H
+#define MONITOR_TRACE_H
+
+#include <stdbool.h>
+#include <glib.h>
+
+/* One timed phase, shown as a slice on its track. */
+typedef struct {
+    const char *name;       /* static string */
+    int track;
+    gint64 start_us;        /* monotonic */
+    gint64 duration_us;
+    bool failed;
+} TraceEvent;
+
+/* The latest events, oldest overwritten first. Disabled (and without any
+ * memory) until trace_buffer_init. */
+typedef struct {
+    TraceEvent *events;
+    int capacity;
+    int next;
+    int count;
+} TraceBuffer;
+
+void trace_buffer_init(TraceBuffer *buffer, int capacity);
+
+void trace_buffer_clear(TraceBuffer *buffer);
+
+void trace_buffer_free(TraceBuffer *buffer);
+
+bool trace_enabled(const TraceBuffer *buffer);
+
+/* Does nothing while the buffer is disabled. */
+void trace_record(TraceBuffer *buffer, const char *name, int track,
+                  gint64 start_us, gint64 duration_us, bool failed);
+
+/* Writes the events as a Chrome trace event JSON object, which Perfetto
+ * (ui.perfetto.dev) and chrome://tracing open directly. Track i is
+ * labelled track_names[i]. Replaces path atomically. */
+bool trace_write(const TraceBuffer *buffer, const char *path,
+                 const char *const *track_names, int track_count, GError **error);
+
+#endif /* MONITOR_TRACE_H */
@@ -2,10 +2,14 @@
  * NAS Monitor Configuration GUI
  * Lightweight GTK3-based configuration editor
  * 
- * Compile with:
- * gcc -o nas-config-gui nas-config-gui.c `pkg-config --cflags --libs gtk+-3.0` -std=c99
+ * Compile with (after `make build/libnasmon-config.a`):
+ * gcc -o nas-config-gui nas-config-gui.c build/libnasmon-config.a `pkg-config --cflags --libs gtk+-3.0` -std=c99
  */
 
+#define _GNU_SOURCE
+
+#include "monitor-config.h"
+
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,22 +19,71 @@
 #include <errno.h>
 
 #define MAX_PATH 512
-#define MAX_LINE 1024
-#define MAX_NETWORKS 10
-#define MAX_NAS_DEVICES 10
+#define SERVICE_NAME "nas-monitor.service"
+#define SYSTEMD_NAME "org.freedesktop.systemd1"
+#define SYSTEMD_PATH "/org/freedesktop/systemd1"
+
+/* One "host/share" entry; a GObject so the device list can be a
+ * GListStore that the list box renders through gtk_list_box_bind_model. */
+#define NAS_TYPE_DEVICE_ITEM (nas_device_item_get_type())
+G_DECLARE_FINAL_TYPE(NasDeviceItem, nas_device_item, NAS, DEVICE_ITEM, GObject)
+
+struct _NasDeviceItem {
+    GObject parent_instance;
+    char *spec;
+};
+
+G_DEFINE_TYPE(NasDeviceItem, nas_device_item, G_TYPE_OBJECT)
+
+static void nas_device_item_finalize(GObject *object) {
+    g_free(NAS_DEVICE_ITEM(object)->spec);
+    G_OBJECT_CLASS(nas_device_item_parent_class)->finalize(object);
+}
+
+static void nas_device_item_class_init(NasDeviceItemClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = nas_device_item_finalize;
+}
+
+static void nas_device_item_init(NasDeviceItem *item __attribute__((unused))) {
+}
+
+static NasDeviceItem *nas_device_item_new(const char *spec) {
+    NasDeviceItem *item = g_object_new(NAS_TYPE_DEVICE_ITEM, NULL);
+    item->spec = g_strdup(spec);
+    return item;
+}
 
 typedef struct {
     char config_path[MAX_PATH];
-    char home_networks[MAX_LINE];
-    char nas_devices[MAX_NAS_DEVICES][MAX_LINE];
-    int nas_count;
+    char *home_networks;
+    GListStore *nas_devices;    /* NasDeviceItem, in file order */
     int home_ac_interval;
     int home_battery_interval;
     int away_ac_interval;
     int away_battery_interval;
+    int min_check_interval;
     int max_failed_attempts;
     int min_battery_level;
+    int max_concurrency;
+    int probe_timeout_ms;
+    int max_log_size;
+    int timer_slack;
+    int stale_mount_timeout_ms;
+    int dns_cache_ttl;
+    int mount_timeout;
     gboolean enable_notifications;
+    gboolean event_driven;
+    gboolean adaptive_schedule;
+    gboolean unmount_on_leave;
+    gboolean unmount_on_suspend;
+    gboolean lean_memory;
+    gboolean shared_probe;
+    NetworkProfile *profiles;   /* [profile:*] sections, no widgets yet; kept as read */
+    int profile_count;
+    MountTimeout *mount_timeouts;   /* [mount_timeouts], likewise */
+    int mount_timeout_count;
+    ConfigEntry *extra;     /* unknown keys from the file, written back on save */
+    int extra_count;
 } Config;
 
 typedef struct {
@@ -41,10 +94,38 @@ typedef struct {
     GtkWidget *home_battery_spin;
     GtkWidget *away_ac_spin;
     GtkWidget *away_battery_spin;
+    GtkWidget *min_interval_spin;
     GtkWidget *max_attempts_spin;
     GtkWidget *min_battery_spin;
+    GtkWidget *max_concurrency_spin;
+    GtkWidget *probe_timeout_spin;
+    GtkWidget *max_log_size_spin;
+    GtkWidget *timer_slack_spin;
+    GtkWidget *stale_timeout_spin;
+    GtkWidget *dns_cache_spin;
+    GtkWidget *mount_timeout_spin;
     GtkWidget *notifications_check;
+    GtkWidget *event_driven_check;
+    GtkWidget *adaptive_check;
+    GtkWidget *unmount_check;
+    GtkWidget *suspend_check;
+    GtkWidget *lean_check;
+    GtkWidget *shared_probe_check;
     GtkWidget *status_label;
+    GtkWidget *save_button;
+    GtkWidget *restart_button;
+    GtkWidget *service_spinner;
+    GtkWidget *service_label;
+    char *load_issues;      /* problems found in the file, shown once at startup */
+    
+    // systemd user manager, reached asynchronously so the window never blocks
+    GDBusProxy *manager;    /* org.freedesktop.systemd1.Manager */
+    GDBusProxy *unit;       /* org.freedesktop.systemd1.Unit of SERVICE_NAME */
+    GDBusProxy *service;    /* org.freedesktop.systemd1.Service of the same unit */
+    char *pending_job;      /* restart/reload job we are waiting on */
+    const char *job_done;   /* status text once that job succeeds */
+    const char *job_failed;
+    guint64 memory;         /* MemoryCurrent, G_MAXUINT64 when unknown */
     Config config;
 } AppData;
 
@@ -89,110 +170,274 @@ static void init_config_path(AppData *app) {
 }
 
 static void set_defaults(Config *config) {
-    strcpy(config->home_networks, "");
-    config->nas_count = 0;
+    g_free(config->home_networks);
+    config->home_networks = g_strdup("");
+    if (!config->nas_devices) {
+        config->nas_devices = g_list_store_new(NAS_TYPE_DEVICE_ITEM);
+    }
+    g_list_store_remove_all(config->nas_devices);
     config->home_ac_interval = 15;
     config->home_battery_interval = 60;
     config->away_ac_interval = 180;
     config->away_battery_interval = 600;
+    config->min_check_interval = 5;
     config->max_failed_attempts = 3;
     config->min_battery_level = 10;
+    config->max_concurrency = 4;
+    config->probe_timeout_ms = 500;
+    config->max_log_size = 1024;
+    config->timer_slack = 30;
+    config->stale_mount_timeout_ms = 2000;
+    config->dns_cache_ttl = 300;
+    config->mount_timeout = 30;
     config->enable_notifications = TRUE;
+    config->event_driven = TRUE;
+    config->adaptive_schedule = FALSE;
+    config->unmount_on_leave = TRUE;
+    config->unmount_on_suspend = TRUE;
+    config->lean_memory = FALSE;
+    config->shared_probe = TRUE;
 }
 
+// Parsing is shared with nas-monitord (libnasmon-config), so the GUI shows
+// exactly what the daemon will act on
 static gboolean load_config(AppData *app) {
-    FILE *file = fopen(app->config.config_path, "r");
-    if (!file) {
-        set_defaults(&app->config);
+    MonitorConfig parsed;
+    
+    set_defaults(&app->config);
+    config_set_defaults(&parsed);
+    if (config_load(&parsed, app->config.config_path) < 0) {
         return FALSE;
     }
     
-    char line[MAX_LINE];
-    char section[64] = "";
+    GString *issues = g_string_new(NULL);
+    for (int i = 0; i < parsed.issue_count; i++) {
+        g_string_append_printf(issues, "Line %d: %s\n",
+                               parsed.issues[i].line, parsed.issues[i].message);
+    }
     
-    set_defaults(&app->config);
+    char *networks = config_join_networks(&parsed);
+    if (networks) {
+        g_free(app->config.home_networks);
+        app->config.home_networks = g_strdup(networks);
+        free(networks);
+    }
     
-    while (fgets(line, sizeof(line), file)) {
-        // Remove trailing newline
-        char *newline = strchr(line, '\n');
-        if (newline) *newline = '\0';
-        
-        // Skip comments and empty lines
-        if (line[0] == '#' || line[0] == '\0' || strspn(line, " \t") == strlen(line)) {
+    // Built up front and spliced in once, so the list box rebuilds one time
+    GPtrArray *items = g_ptr_array_new_with_free_func(g_object_unref);
+    for (int i = 0; i < parsed.device_count; i++) {
+        g_ptr_array_add(items, nas_device_item_new(parsed.devices[i].spec));
+    }
+    g_list_store_splice(app->config.nas_devices, 0, 0, items->pdata, items->len);
+    g_ptr_array_free(items, TRUE);
+    
+    app->config.home_ac_interval = parsed.home_ac_interval;
+    app->config.home_battery_interval = parsed.home_battery_interval;
+    app->config.away_ac_interval = parsed.away_ac_interval;
+    app->config.away_battery_interval = parsed.away_battery_interval;
+    app->config.min_check_interval = parsed.min_check_interval;
+    app->config.max_failed_attempts = parsed.max_failed_attempts;
+    app->config.min_battery_level = parsed.min_battery_level;
+    app->config.max_concurrency = parsed.max_concurrency;
+    app->config.probe_timeout_ms = parsed.probe_timeout_ms;
+    app->config.max_log_size = parsed.max_log_size;
+    app->config.timer_slack = parsed.timer_slack;
+    app->config.stale_mount_timeout_ms = parsed.stale_mount_timeout_ms;
+    app->config.dns_cache_ttl = parsed.dns_cache_ttl;
+    app->config.mount_timeout = parsed.mount_timeout;
+    app->config.enable_notifications = parsed.enable_notifications;
+    app->config.event_driven = parsed.event_driven;
+    app->config.adaptive_schedule = parsed.adaptive_schedule;
+    app->config.unmount_on_leave = parsed.unmount_on_leave;
+    app->config.unmount_on_suspend = parsed.unmount_on_suspend;
+    app->config.lean_memory = parsed.lean_memory;
+    app->config.shared_probe = parsed.shared_probe;
+    
+    // Take over the profiles and keys we have no widgets for
+    app->config.profiles = parsed.profiles;
+    app->config.profile_count = parsed.profile_count;
+    parsed.profiles = NULL;
+    parsed.profile_count = 0;
+    app->config.mount_timeouts = parsed.mount_timeouts;
+    app->config.mount_timeout_count = parsed.mount_timeout_count;
+    parsed.mount_timeouts = NULL;
+    parsed.mount_timeout_count = 0;
+    app->config.extra = parsed.extra;
+    app->config.extra_count = parsed.extra_count;
+    parsed.extra = NULL;
+    parsed.extra_count = 0;
+    config_free(&parsed);
+    
+    app->load_issues = issues->len ? g_string_free(issues, FALSE) : NULL;
+    if (!app->load_issues) {
+        g_string_free(issues, TRUE);
+    }
+    return TRUE;
+}
+
+static gboolean is_written_section(const char *section) {
+    return strcmp(section, "networks") == 0 || strcmp(section, "nas_devices") == 0 ||
+           strcmp(section, "intervals") == 0 || strcmp(section, "behavior") == 0 ||
+           strcmp(section, "mount_timeouts") == 0 || g_str_has_prefix(section, "profile:");
+}
+
+static void write_extra(FILE *file, const Config *config, const char *section) {
+    for (int i = 0; i < config->extra_count; i++) {
+        if (strcmp(config->extra[i].section, section) == 0) {
+            fprintf(file, "%s=%s\n", config->extra[i].key, config->extra[i].value);
+        }
+    }
+}
+
+// Sections this GUI does not write itself, each once, in file order
+static void write_other_sections(FILE *file, const Config *config) {
+    for (int i = 0; i < config->extra_count; i++) {
+        const char *section = config->extra[i].section;
+        if (section[0] == '\0' || is_written_section(section)) {
             continue;
         }
         
-        // Check for section headers
-        if (line[0] == '[' && line[strlen(line)-1] == ']') {
-            strncpy(section, line + 1, sizeof(section) - 1);
-            section[strlen(section) - 1] = '\0';
+        gboolean seen = FALSE;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = strcmp(config->extra[j].section, section) == 0;
+        }
+        if (!seen) {
+            fprintf(file, "\n[%s]\n", section);
+            write_extra(file, config, section);
+        }
+    }
+}
+
+static gboolean has_device(AppData *app, const char *spec) {
+    GListModel *devices = G_LIST_MODEL(app->config.nas_devices);
+    gboolean found = FALSE;
+    for (guint i = 0; i < g_list_model_get_n_items(devices) && !found; i++) {
+        NasDeviceItem *item = g_list_model_get_item(devices, i);
+        found = strcmp(item->spec, spec) == 0;
+        g_object_unref(item);
+    }
+    return found;
+}
+
+static void write_list(FILE *file, const char *key, char **items, int count) {
+    if (count == 0) {
+        return;
+    }
+    fprintf(file, "%s=", key);
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s%s", i ? "," : "", items[i]);
+    }
+    fprintf(file, "\n");
+}
+
+// Written back as loaded, minus shares removed from the list since; a
+// profile left with none of its shares is dropped, as the daemon would
+static void write_profiles(FILE *file, AppData *app) {
+    for (int i = 0; i < app->config.profile_count; i++) {
+        const NetworkProfile *profile = &app->config.profiles[i];
+        
+        GPtrArray *devices = g_ptr_array_new();
+        for (int d = 0; d < profile->device_count; d++) {
+            if (has_device(app, profile->devices[d])) {
+                g_ptr_array_add(devices, profile->devices[d]);
+            }
+        }
+        if (profile->device_count > 0 && devices->len == 0) {
+            g_ptr_array_free(devices, TRUE);
             continue;
         }
         
-        // Parse key-value pairs
-        char *equals = strchr(line, '=');
-        if (equals) {
-            *equals = '\0';
-            char *key = line;
-            char *value = equals + 1;
-            
-            // Trim whitespace
-            while (*key == ' ' || *key == '\t') key++;
-            while (*value == ' ' || *value == '\t') value++;
-            
-            if (strcmp(key, "home_networks") == 0) {
-                strncpy(app->config.home_networks, value, MAX_LINE - 1);
-            } else if (strcmp(key, "home_ac_interval") == 0) {
-                app->config.home_ac_interval = atoi(value);
-            } else if (strcmp(key, "home_battery_interval") == 0) {
-                app->config.home_battery_interval = atoi(value);
-            } else if (strcmp(key, "away_ac_interval") == 0) {
-                app->config.away_ac_interval = atoi(value);
-            } else if (strcmp(key, "away_battery_interval") == 0) {
-                app->config.away_battery_interval = atoi(value);
-            } else if (strcmp(key, "max_failed_attempts") == 0) {
-                app->config.max_failed_attempts = atoi(value);
-            } else if (strcmp(key, "min_battery_level") == 0) {
-                app->config.min_battery_level = atoi(value);
-            } else if (strcmp(key, "enable_notifications") == 0) {
-                app->config.enable_notifications = (strcmp(value, "true") == 0);
+        char *section = g_strdup_printf("profile:%s", profile->name);
+        fprintf(file, "\n[%s]\n", section);
+        if (profile->ssid) {
+            fprintf(file, "ssid=%s\n", profile->ssid);
+        }
+        write_list(file, "connection", profile->connections, profile->connection_count);
+        if (profile->subnet_count > 0) {
+            fprintf(file, "subnet=");
+            for (int s = 0; s < profile->subnet_count; s++) {
+                fprintf(file, "%s%s", s ? "," : "", profile->subnets[s].text);
             }
-        } else if (strcmp(section, "nas_devices") == 0 && 
-                   strstr(line, "/") && app->config.nas_count < MAX_NAS_DEVICES) {
-            // NAS device entry
-            strncpy(app->config.nas_devices[app->config.nas_count], line, MAX_LINE - 1);
-            app->config.nas_count++;
+            fprintf(file, "\n");
+        }
+        write_list(file, "bssid", profile->bssids, profile->bssid_count);
+        write_list(file, "gateway_mac", profile->gateway_macs, profile->gateway_mac_count);
+        write_list(file, "devices", (char **)devices->pdata, (int)devices->len);
+        if (profile->home_ac_interval) {
+            fprintf(file, "home_ac_interval=%d\n", profile->home_ac_interval);
+        }
+        if (profile->home_battery_interval) {
+            fprintf(file, "home_battery_interval=%d\n", profile->home_battery_interval);
         }
+        write_extra(file, &app->config, section);
+        g_free(section);
+        g_ptr_array_free(devices, TRUE);
     }
-    
-    fclose(file);
-    return TRUE;
 }
 
+// Likewise without the shares removed from the list
+static void write_mount_timeouts(FILE *file, AppData *app) {
+    gboolean header = FALSE;
+    for (int i = 0; i < app->config.mount_timeout_count; i++) {
+        const MountTimeout *timeout = &app->config.mount_timeouts[i];
+        if (!has_device(app, timeout->spec)) {
+            continue;
+        }
+        if (!header) {
+            fprintf(file, "\n[mount_timeouts]\n");
+            fprintf(file, "# host/share=seconds, in place of mount_timeout\n");
+            header = TRUE;
+        }
+        fprintf(file, "%s=%d\n", timeout->spec, timeout->seconds);
+    }
+}
+
+static void show_save_error(AppData *app) {
+    char error_msg[512];
+    snprintf(error_msg, sizeof(error_msg), 
+            "Failed to save configuration: %s", strerror(errno));
+    show_error(app->window, error_msg);
+}
+
+// Writes a temp file next to the config and renames it into place, so a
+// reader (the daemon reloads on every change) only ever sees a complete
+// old or new file, even if we crash or the disk fills up mid-write
 static gboolean save_config(AppData *app) {
-    FILE *file = fopen(app->config.config_path, "w");
-    if (!file) {
-        char error_msg[512];
-        snprintf(error_msg, sizeof(error_msg), 
-                "Failed to save configuration: %s", strerror(errno));
-        show_error(app->window, error_msg);
+    char temp_path[MAX_PATH + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", app->config.config_path);
+    
+    // mkstemp creates the file 0600; it is never readable by others
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        show_save_error(app);
         return FALSE;
     }
     
-    // Set restrictive permissions
-    chmod(app->config.config_path, 0600);
+    FILE *file = fdopen(fd, "w");
+    if (!file) {
+        show_save_error(app);
+        close(fd);
+        unlink(temp_path);
+        return FALSE;
+    }
     
     fprintf(file, "# NAS Monitor Configuration File\n\n");
+    write_extra(file, &app->config, "");
     
     fprintf(file, "[networks]\n");
     fprintf(file, "# Comma-separated list of home network SSIDs\n");
-    fprintf(file, "home_networks=%s\n\n", app->config.home_networks);
+    fprintf(file, "home_networks=%s\n", app->config.home_networks);
+    write_extra(file, &app->config, "networks");
     
-    fprintf(file, "[nas_devices]\n");
+    fprintf(file, "\n[nas_devices]\n");
     fprintf(file, "# Format: host/share (one per line)\n");
-    for (int i = 0; i < app->config.nas_count; i++) {
-        fprintf(file, "%s\n", app->config.nas_devices[i]);
+    GListModel *devices = G_LIST_MODEL(app->config.nas_devices);
+    for (guint i = 0; i < g_list_model_get_n_items(devices); i++) {
+        NasDeviceItem *item = g_list_model_get_item(devices, i);
+        fprintf(file, "%s\n", item->spec);
+        g_object_unref(item);
     }
+    write_extra(file, &app->config, "nas_devices");
     
     fprintf(file, "\n[intervals]\n");
     fprintf(file, "# Check intervals in seconds\n");
@@ -200,14 +445,45 @@ static gboolean save_config(AppData *app) {
     fprintf(file, "home_battery_interval=%d\n", app->config.home_battery_interval);
     fprintf(file, "away_ac_interval=%d\n", app->config.away_ac_interval);
     fprintf(file, "away_battery_interval=%d\n", app->config.away_battery_interval);
+    fprintf(file, "min_check_interval=%d\n", app->config.min_check_interval);
+    write_extra(file, &app->config, "intervals");
     
     fprintf(file, "\n[behavior]\n");
     fprintf(file, "max_failed_attempts=%d\n", app->config.max_failed_attempts);
     fprintf(file, "min_battery_level=%d\n", app->config.min_battery_level);
+    fprintf(file, "max_concurrency=%d\n", app->config.max_concurrency);
+    fprintf(file, "probe_timeout_ms=%d\n", app->config.probe_timeout_ms);
+    fprintf(file, "max_log_size=%d\n", app->config.max_log_size);
+    fprintf(file, "timer_slack=%d\n", app->config.timer_slack);
+    fprintf(file, "stale_mount_timeout_ms=%d\n", app->config.stale_mount_timeout_ms);
+    fprintf(file, "dns_cache_ttl=%d\n", app->config.dns_cache_ttl);
+    fprintf(file, "mount_timeout=%d\n", app->config.mount_timeout);
     fprintf(file, "enable_notifications=%s\n", 
             app->config.enable_notifications ? "true" : "false");
-    
-    fclose(file);
+    fprintf(file, "event_driven=%s\n",
+            app->config.event_driven ? "true" : "false");
+    fprintf(file, "adaptive_schedule=%s\n",
+            app->config.adaptive_schedule ? "true" : "false");
+    fprintf(file, "unmount_on_leave=%s\n",
+            app->config.unmount_on_leave ? "true" : "false");
+    fprintf(file, "unmount_on_suspend=%s\n",
+            app->config.unmount_on_suspend ? "true" : "false");
+    fprintf(file, "lean_memory=%s\n",
+            app->config.lean_memory ? "true" : "false");
+    fprintf(file, "shared_probe=%s\n",
+            app->config.shared_probe ? "true" : "false");
+    write_extra(file, &app->config, "behavior");
+    write_profiles(file, app);
+    write_mount_timeouts(file, app);
+    write_other_sections(file, &app->config);
+    
+    gboolean ok = fflush(file) == 0 && !ferror(file) && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, app->config.config_path) < 0) {
+        show_save_error(app);
+        unlink(temp_path);
+        return FALSE;
+    }
     
     gtk_label_set_text(GTK_LABEL(app->status_label), 
                        "Configuration saved successfully");
@@ -226,35 +502,54 @@ static void update_ui_from_config(AppData *app) {
                               app->config.away_ac_interval);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->away_battery_spin), 
                               app->config.away_battery_interval);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->min_interval_spin), 
+                              app->config.min_check_interval);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->max_attempts_spin), 
                               app->config.max_failed_attempts);
     gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->min_battery_spin), 
                               app->config.min_battery_level);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->max_concurrency_spin), 
+                              app->config.max_concurrency);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->probe_timeout_spin), 
+                              app->config.probe_timeout_ms);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->max_log_size_spin), 
+                              app->config.max_log_size);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->timer_slack_spin), 
+                              app->config.timer_slack);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->stale_timeout_spin), 
+                              app->config.stale_mount_timeout_ms);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->dns_cache_spin), 
+                              app->config.dns_cache_ttl);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(app->mount_timeout_spin),
+                              app->config.mount_timeout);
     
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->notifications_check),
                                  app->config.enable_notifications);
-    
-    // Clear and repopulate NAS list
-    GList *children = gtk_container_get_children(GTK_CONTAINER(app->nas_listbox));
-    for (GList *iter = children; iter != NULL; iter = g_list_next(iter)) {
-        gtk_widget_destroy(GTK_WIDGET(iter->data));
-    }
-    g_list_free(children);
-    
-    for (int i = 0; i < app->config.nas_count; i++) {
-        GtkWidget *row = gtk_list_box_row_new();
-        GtkWidget *label = gtk_label_new(app->config.nas_devices[i]);
-        gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-        gtk_container_add(GTK_CONTAINER(row), label);
-        gtk_list_box_insert(GTK_LIST_BOX(app->nas_listbox), row, -1);
-    }
-    
-    gtk_widget_show_all(app->nas_listbox);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->event_driven_check),
+                                 app->config.event_driven);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->adaptive_check),
+                                 app->config.adaptive_schedule);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->unmount_check),
+                                 app->config.unmount_on_leave);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->suspend_check),
+                                 app->config.unmount_on_suspend);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->lean_check),
+                                 app->config.lean_memory);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->shared_probe_check),
+                                 app->config.shared_probe);
+    // The NAS list follows app->config.nas_devices through its model
+}
+
+static GtkWidget *create_device_row(gpointer object, gpointer user_data __attribute__((unused))) {
+    GtkWidget *label = gtk_label_new(NAS_DEVICE_ITEM(object)->spec);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_widget_show(label);
+    return label;
 }
 
 static void update_config_from_ui(AppData *app) {
-    strncpy(app->config.home_networks, 
-            gtk_entry_get_text(GTK_ENTRY(app->networks_entry)), MAX_LINE - 1);
+    g_free(app->config.home_networks);
+    app->config.home_networks = g_strdup(gtk_entry_get_text(GTK_ENTRY(app->networks_entry)));
     
     app->config.home_ac_interval = gtk_spin_button_get_value_as_int(
         GTK_SPIN_BUTTON(app->home_ac_spin));
@@ -264,13 +559,41 @@ static void update_config_from_ui(AppData *app) {
         GTK_SPIN_BUTTON(app->away_ac_spin));
     app->config.away_battery_interval = gtk_spin_button_get_value_as_int(
         GTK_SPIN_BUTTON(app->away_battery_spin));
+    app->config.min_check_interval = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->min_interval_spin));
     app->config.max_failed_attempts = gtk_spin_button_get_value_as_int(
         GTK_SPIN_BUTTON(app->max_attempts_spin));
     app->config.min_battery_level = gtk_spin_button_get_value_as_int(
         GTK_SPIN_BUTTON(app->min_battery_spin));
+    app->config.max_concurrency = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->max_concurrency_spin));
+    app->config.probe_timeout_ms = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->probe_timeout_spin));
+    app->config.max_log_size = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->max_log_size_spin));
+    app->config.timer_slack = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->timer_slack_spin));
+    app->config.stale_mount_timeout_ms = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->stale_timeout_spin));
+    app->config.dns_cache_ttl = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->dns_cache_spin));
+    app->config.mount_timeout = gtk_spin_button_get_value_as_int(
+        GTK_SPIN_BUTTON(app->mount_timeout_spin));
     
     app->config.enable_notifications = gtk_toggle_button_get_active(
         GTK_TOGGLE_BUTTON(app->notifications_check));
+    app->config.event_driven = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->event_driven_check));
+    app->config.adaptive_schedule = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->adaptive_check));
+    app->config.unmount_on_leave = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->unmount_check));
+    app->config.unmount_on_suspend = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->suspend_check));
+    app->config.lean_memory = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->lean_check));
+    app->config.shared_probe = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(app->shared_probe_check));
 }
 
 static void on_add_nas_clicked(GtkButton *button __attribute__((unused)), AppData *app) {
@@ -294,11 +617,10 @@ static void on_add_nas_clicked(GtkButton *button __attribute__((unused)), AppDat
     
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
         const char *text = gtk_entry_get_text(GTK_ENTRY(entry));
-        if (strlen(text) > 0 && strstr(text, "/") && 
-            app->config.nas_count < MAX_NAS_DEVICES) {
-            strncpy(app->config.nas_devices[app->config.nas_count], text, MAX_LINE - 1);
-            app->config.nas_count++;
-            update_ui_from_config(app);
+        if (strlen(text) > 0 && strstr(text, "/") && !has_device(app, text)) {
+            NasDeviceItem *item = nas_device_item_new(text);
+            g_list_store_append(app->config.nas_devices, item);
+            g_object_unref(item);
         }
     }
     
@@ -312,31 +634,252 @@ static void on_remove_nas_clicked(GtkButton *button __attribute__((unused)), App
         return;
     }
     
-    int index = gtk_list_box_row_get_index(selected);
+    // Rows are created from the model, so row index == item index
+    g_list_store_remove(app->config.nas_devices, gtk_list_box_row_get_index(selected));
+}
+
+static char *get_string_property(GDBusProxy *proxy, const char *name) {
+    GVariant *value = proxy ? g_dbus_proxy_get_cached_property(proxy, name) : NULL;
+    if (!value) {
+        return NULL;
+    }
+    char *text = g_variant_dup_string(value, NULL);
+    g_variant_unref(value);
+    return text;
+}
+
+static void render_service_status(AppData *app) {
+    char *state = get_string_property(app->unit, "ActiveState");
+    char *sub_state = get_string_property(app->unit, "SubState");
+    GString *text = g_string_new("Service: ");
     
-    // Remove from config array
-    for (int i = index; i < app->config.nas_count - 1; i++) {
-        strcpy(app->config.nas_devices[i], app->config.nas_devices[i + 1]);
+    if (!state) {
+        g_string_append(text, app->manager ? "checking..." : "status unavailable");
+    } else {
+        g_string_append_printf(text, "%s (%s)", state, sub_state ? sub_state : "unknown");
+        
+        GVariant *pid = app->service ? g_dbus_proxy_get_cached_property(app->service, "MainPID") : NULL;
+        if (pid) {
+            if (g_variant_get_uint32(pid) != 0) {
+                g_string_append_printf(text, ", PID %u", g_variant_get_uint32(pid));
+            }
+            g_variant_unref(pid);
+        }
+        if (strcmp(state, "active") == 0 && app->memory != G_MAXUINT64) {
+            g_string_append_printf(text, ", %.1f MiB", app->memory / (1024.0 * 1024.0));
+        }
+    }
+    
+    gtk_label_set_text(GTK_LABEL(app->service_label), text->str);
+    g_string_free(text, TRUE);
+    g_free(state);
+    g_free(sub_state);
+}
+
+static void on_memory_read(GObject *source, GAsyncResult *result, gpointer user_data) {
+    AppData *app = user_data;
+    GVariant *reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, NULL);
+    if (!reply) {
+        return;
+    }
+    
+    GVariant *value;
+    g_variant_get(reply, "(v)", &value);
+    if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64)) {
+        app->memory = g_variant_get_uint64(value);
+    }
+    g_variant_unref(value);
+    g_variant_unref(reply);
+    render_service_status(app);
+}
+
+static void refresh_service_status(AppData *app) {
+    render_service_status(app);
+    
+    // systemd does not announce MemoryCurrent changes, so read it whenever
+    // something that is announced changes instead of polling
+    if (app->service) {
+        g_dbus_proxy_call(app->service, "org.freedesktop.DBus.Properties.Get",
+                          g_variant_new("(ss)", SYSTEMD_NAME ".Service", "MemoryCurrent"),
+                          G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_memory_read, app);
+    }
+}
+
+static void on_unit_properties_changed(GDBusProxy *proxy __attribute__((unused)),
+                                       GVariant *changed __attribute__((unused)),
+                                       GStrv invalidated __attribute__((unused)),
+                                       AppData *app) {
+    refresh_service_status(app);
+}
+
+static void set_busy(AppData *app, gboolean busy) {
+    if (busy) {
+        gtk_spinner_start(GTK_SPINNER(app->service_spinner));
+    } else {
+        gtk_spinner_stop(GTK_SPINNER(app->service_spinner));
+    }
+    gtk_widget_set_sensitive(app->save_button, !busy);
+    gtk_widget_set_sensitive(app->restart_button, !busy);
+}
+
+static void finish_job(AppData *app, const char *message) {
+    g_clear_pointer(&app->pending_job, g_free);
+    set_busy(app, FALSE);
+    gtk_label_set_text(GTK_LABEL(app->status_label), message);
+}
+
+static void on_manager_signal(GDBusProxy *proxy __attribute__((unused)),
+                              gchar *sender __attribute__((unused)),
+                              gchar *signal, GVariant *params, AppData *app) {
+    if (strcmp(signal, "JobRemoved") != 0 || !app->pending_job) {
+        return;
+    }
+    
+    guint32 id;
+    const char *job, *unit, *result;
+    g_variant_get(params, "(u&o&s&s)", &id, &job, &unit, &result);
+    if (strcmp(job, app->pending_job) != 0) {
+        return;
+    }
+    
+    if (strcmp(result, "done") == 0) {
+        finish_job(app, app->job_done);
+    } else {
+        char *message = g_strdup_printf("%s (%s)", app->job_failed, result);
+        finish_job(app, message);
+        g_free(message);
+    }
+}
+
+static void on_job_queued(GObject *source, GAsyncResult *result, gpointer user_data) {
+    AppData *app = user_data;
+    GError *error = NULL;
+    GVariant *reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, &error);
+    
+    if (!reply) {
+        char *message = g_strdup_printf("%s: %s", app->job_failed, error->message);
+        finish_job(app, message);
+        g_free(message);
+        g_error_free(error);
+        return;
+    }
+    
+    // Completion arrives later as JobRemoved for this path
+    const char *job;
+    g_variant_get(reply, "(&o)", &job);
+    app->pending_job = g_strdup(job);
+    g_variant_unref(reply);
+}
+
+// Queues a systemd job for the service; the window stays responsive while
+// the old daemon stops, and the result is reported from JobRemoved
+static void start_job(AppData *app, const char *method, const char *progress,
+                      const char *done, const char *failed) {
+    app->job_done = done;
+    app->job_failed = failed;
+    set_busy(app, TRUE);
+    gtk_label_set_text(GTK_LABEL(app->status_label), progress);
+    
+    g_dbus_proxy_call(app->manager, method, g_variant_new("(ss)", SERVICE_NAME, "replace"),
+                      G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_job_queued, app);
+}
+
+static void on_unit_proxy_ready(GObject *source __attribute__((unused)),
+                                GAsyncResult *result, gpointer user_data) {
+    AppData *app = user_data;
+    GDBusProxy *proxy = g_dbus_proxy_new_for_bus_finish(result, NULL);
+    if (!proxy) {
+        return;
     }
-    app->config.nas_count--;
     
-    update_ui_from_config(app);
+    if (strcmp(g_dbus_proxy_get_interface_name(proxy), SYSTEMD_NAME ".Unit") == 0) {
+        app->unit = proxy;
+    } else {
+        app->service = proxy;
+    }
+    g_signal_connect(proxy, "g-properties-changed",
+                     G_CALLBACK(on_unit_properties_changed), app);
+    refresh_service_status(app);
+}
+
+static void on_unit_loaded(GObject *source, GAsyncResult *result, gpointer user_data) {
+    AppData *app = user_data;
+    GVariant *reply = g_dbus_proxy_call_finish(G_DBUS_PROXY(source), result, NULL);
+    if (!reply) {
+        g_clear_object(&app->manager);
+        render_service_status(app);
+        return;
+    }
+    
+    const char *path;
+    g_variant_get(reply, "(&o)", &path);
+    
+    // ActiveState lives on the Unit interface, MainPID/MemoryCurrent on Service
+    static const char *const interfaces[] = { SYSTEMD_NAME ".Unit", SYSTEMD_NAME ".Service" };
+    for (int i = 0; i < 2; i++) {
+        g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION, G_DBUS_PROXY_FLAGS_NONE, NULL,
+                                 SYSTEMD_NAME, path, interfaces[i], NULL,
+                                 on_unit_proxy_ready, app);
+    }
+    g_variant_unref(reply);
+}
+
+static void on_manager_ready(GObject *source __attribute__((unused)),
+                             GAsyncResult *result, gpointer user_data) {
+    AppData *app = user_data;
+    app->manager = g_dbus_proxy_new_for_bus_finish(result, NULL);
+    if (!app->manager) {
+        render_service_status(app);
+        return;
+    }
+    
+    g_signal_connect(app->manager, "g-signal", G_CALLBACK(on_manager_signal), app);
+    
+    // Unit change signals are only broadcast while a client is subscribed
+    g_dbus_proxy_call(app->manager, "Subscribe", NULL, G_DBUS_CALL_FLAGS_NONE,
+                      -1, NULL, NULL, NULL);
+    g_dbus_proxy_call(app->manager, "LoadUnit", g_variant_new("(s)", SERVICE_NAME),
+                      G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_unit_loaded, app);
+    render_service_status(app);
+}
+
+static void connect_systemd(AppData *app) {
+    app->memory = G_MAXUINT64;
+    
+    // The manager has hundreds of properties we never read
+    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                             NULL, SYSTEMD_NAME, SYSTEMD_PATH, SYSTEMD_NAME ".Manager",
+                             NULL, on_manager_ready, app);
 }
 
 static void on_save_clicked(GtkButton *button __attribute__((unused)), AppData *app) {
     update_config_from_ui(app);
-    save_config(app);
+    if (!save_config(app)) {
+        return;
+    }
+
+    // The native daemon also notices the write itself; the shell fallback
+    // only re-reads its config on SIGHUP, which ExecReload sends.
+    char *state = get_string_property(app->unit, "ActiveState");
+    if (app->manager && state && strcmp(state, "active") == 0) {
+        start_job(app, "ReloadUnit", "Configuration saved, reloading service...",
+                  "Configuration saved and applied",
+                  "Configuration saved, but reloading the service failed");
+    } else if (state) {
+        gtk_label_set_text(GTK_LABEL(app->status_label),
+                           "Configuration saved (service not running)");
+    }
+    g_free(state);
 }
 
 static void on_restart_service_clicked(GtkButton *button __attribute__((unused)), AppData *app) {
-    int result = system("systemctl --user restart nas-monitor.service 2>/dev/null");
-    if (result == 0) {
-        gtk_label_set_text(GTK_LABEL(app->status_label), 
-                           "Service restarted successfully");
-    } else {
-        gtk_label_set_text(GTK_LABEL(app->status_label), 
-                           "Failed to restart service");
+    if (!app->manager) {
+        gtk_label_set_text(GTK_LABEL(app->status_label),
+                           "systemd user manager not available");
+        return;
     }
+    start_job(app, "RestartUnit", "Restarting service...",
+              "Service restarted successfully", "Failed to restart service");
 }
 
 static void create_ui(AppData *app) {
@@ -377,6 +920,9 @@ static void create_ui(AppData *app) {
     gtk_widget_set_size_request(scrolled, -1, 200);
     
     app->nas_listbox = gtk_list_box_new();
+    gtk_list_box_bind_model(GTK_LIST_BOX(app->nas_listbox),
+                            G_LIST_MODEL(app->config.nas_devices),
+                            create_device_row, NULL, NULL);
     gtk_container_add(GTK_CONTAINER(scrolled), app->nas_listbox);
     gtk_box_pack_start(GTK_BOX(nas_box), scrolled, TRUE, TRUE, 0);
     
@@ -420,17 +966,73 @@ static void create_ui(AppData *app) {
     app->away_battery_spin = gtk_spin_button_new_with_range(60, 3600, 60);
     gtk_grid_attach(GTK_GRID(grid), app->away_battery_spin, 1, row++, 1, 1);
     
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Shortest Adaptive Interval (sec):"), 0, row, 1, 1);
+    app->min_interval_spin = gtk_spin_button_new_with_range(1, 3600, 5);
+    gtk_grid_attach(GTK_GRID(grid), app->min_interval_spin, 1, row++, 1, 1);
+    
     gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Max Failed Attempts:"), 0, row, 1, 1);
     app->max_attempts_spin = gtk_spin_button_new_with_range(1, 10, 1);
     gtk_grid_attach(GTK_GRID(grid), app->max_attempts_spin, 1, row++, 1, 1);
     
     gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Min Battery Level (%):"), 0, row, 1, 1);
-    app->min_battery_spin = gtk_spin_button_new_with_range(5, 50, 5);
+    app->min_battery_spin = gtk_spin_button_new_with_range(0, 100, 5);
     gtk_grid_attach(GTK_GRID(grid), app->min_battery_spin, 1, row++, 1, 1);
     
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Max Parallel Mounts:"), 0, row, 1, 1);
+    app->max_concurrency_spin = gtk_spin_button_new_with_range(1, 16, 1);
+    gtk_grid_attach(GTK_GRID(grid), app->max_concurrency_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Probe Timeout (ms):"), 0, row, 1, 1);
+    app->probe_timeout_spin = gtk_spin_button_new_with_range(100, 5000, 100);
+    gtk_grid_attach(GTK_GRID(grid), app->probe_timeout_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Max Log Size (KiB):"), 0, row, 1, 1);
+    app->max_log_size_spin = gtk_spin_button_new_with_range(64, 65536, 64);
+    gtk_grid_attach(GTK_GRID(grid), app->max_log_size_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Timer Slack (sec):"), 0, row, 1, 1);
+    app->timer_slack_spin = gtk_spin_button_new_with_range(1, 300, 1);
+    gtk_grid_attach(GTK_GRID(grid), app->timer_slack_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Stale Mount Timeout (ms):"), 0, row, 1, 1);
+    app->stale_timeout_spin = gtk_spin_button_new_with_range(500, 30000, 500);
+    gtk_grid_attach(GTK_GRID(grid), app->stale_timeout_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Address Cache Lifetime (sec):"), 0, row, 1, 1);
+    app->dns_cache_spin = gtk_spin_button_new_with_range(1, 86400, 60);
+    gtk_grid_attach(GTK_GRID(grid), app->dns_cache_spin, 1, row++, 1, 1);
+    
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Mount Timeout (sec):"), 0, row, 1, 1);
+    app->mount_timeout_spin = gtk_spin_button_new_with_range(1, 3600, 5);
+    gtk_grid_attach(GTK_GRID(grid), app->mount_timeout_spin, 1, row++, 1, 1);
+    
     app->notifications_check = gtk_check_button_new_with_label("Enable Notifications");
     gtk_grid_attach(GTK_GRID(grid), app->notifications_check, 0, row++, 2, 1);
     
+    app->event_driven_check = gtk_check_button_new_with_label(
+        "React immediately to network and power changes");
+    gtk_grid_attach(GTK_GRID(grid), app->event_driven_check, 0, row++, 2, 1);
+    
+    app->adaptive_check = gtk_check_button_new_with_label(
+        "Learn when each NAS is usually online and adapt the check interval");
+    gtk_grid_attach(GTK_GRID(grid), app->adaptive_check, 0, row++, 2, 1);
+    
+    app->unmount_check = gtk_check_button_new_with_label(
+        "Unmount shares when leaving the network they are on");
+    gtk_grid_attach(GTK_GRID(grid), app->unmount_check, 0, row++, 2, 1);
+    
+    app->suspend_check = gtk_check_button_new_with_label(
+        "Unmount shares before the computer suspends");
+    gtk_grid_attach(GTK_GRID(grid), app->suspend_check, 0, row++, 2, 1);
+    
+    app->lean_check = gtk_check_button_new_with_label(
+        "Keep the native daemon's memory use low (applies after a restart)");
+    gtk_grid_attach(GTK_GRID(grid), app->lean_check, 0, row++, 2, 1);
+    
+    app->shared_probe_check = gtk_check_button_new_with_label(
+        "Share NAS probes with other users through the system probe service");
+    gtk_grid_attach(GTK_GRID(grid), app->shared_probe_check, 0, row++, 2, 1);
+    
     gtk_box_pack_start(GTK_BOX(settings_box), grid, FALSE, FALSE, 0);
     
     gtk_notebook_append_page(GTK_NOTEBOOK(notebook), settings_box, 
@@ -443,20 +1045,29 @@ static void create_ui(AppData *app) {
     GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     gtk_container_set_border_width(GTK_CONTAINER(button_box), 10);
     
-    GtkWidget *save_button = gtk_button_new_with_label("Save Configuration");
-    GtkWidget *restart_button = gtk_button_new_with_label("Restart Service");
+    app->save_button = gtk_button_new_with_label("Save Configuration");
+    app->restart_button = gtk_button_new_with_label("Restart Service");
     
-    gtk_box_pack_start(GTK_BOX(button_box), save_button, TRUE, TRUE, 0);
-    gtk_box_pack_start(GTK_BOX(button_box), restart_button, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), app->save_button, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), app->restart_button, TRUE, TRUE, 0);
     
-    g_signal_connect(save_button, "clicked", G_CALLBACK(on_save_clicked), app);
-    g_signal_connect(restart_button, "clicked", G_CALLBACK(on_restart_service_clicked), app);
+    g_signal_connect(app->save_button, "clicked", G_CALLBACK(on_save_clicked), app);
+    g_signal_connect(app->restart_button, "clicked", G_CALLBACK(on_restart_service_clicked), app);
+    
+    // Live service state, driven by systemd's PropertiesChanged signals
+    GtkWidget *service_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    app->service_spinner = gtk_spinner_new();
+    app->service_label = gtk_label_new("Service: checking...");
+    gtk_box_pack_start(GTK_BOX(service_box), app->service_spinner, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(service_box), app->service_label, FALSE, FALSE, 0);
+    gtk_container_set_border_width(GTK_CONTAINER(service_box), 5);
     
     // Status label
     app->status_label = gtk_label_new("");
     
     // Add button box and status to main container
     gtk_box_pack_start(GTK_BOX(main_box), button_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(main_box), service_box, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(main_box), app->status_label, FALSE, FALSE, 5);
     
     // Add main container to window (this is the only child of the window)
@@ -474,8 +1085,15 @@ int main(int argc, char *argv[]) {
     load_config(&app);
     create_ui(&app);
     update_ui_from_config(&app);
+    connect_systemd(&app);
     
     gtk_widget_show_all(app.window);
+    if (app.load_issues) {
+        char *message = g_strdup_printf("Problems in %s:\n\n%s",
+                                        app.config.config_path, app.load_issues);
+        show_error(app.window, message);
+        g_free(message);
+    }
     gtk_main();
     
     return 0;
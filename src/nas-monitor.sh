@@ -5,48 +5,132 @@
 
 CONFIG_FILE="$HOME/.config/nas-monitor/config.conf"
 LOG_FILE="$HOME/.local/share/nas-monitor.log"
-LOCK_FILE="/tmp/nas-monitor-$USER.lock"
+# Shared with nas-monitord, so only one of the two runs at a time
+if [ -n "${XDG_RUNTIME_DIR:-}" ]; then
+    LOCK_FILE="$XDG_RUNTIME_DIR/nas-monitor.lock"
+else
+    LOCK_FILE="/tmp/nas-monitor-$USER.lock"
+fi
 
 # Global variables
 declare -a HOME_NETWORKS
 declare -a NAS_DEVICES
-HOME_AC_INTERVAL=15
-HOME_BATTERY_INTERVAL=60
-AWAY_AC_INTERVAL=180
-AWAY_BATTERY_INTERVAL=600
-MIN_BATTERY_LEVEL=10
-ENABLE_NOTIFICATIONS=true
+declare -A HOME_NETWORK_SET     # "+ssid" -> 1
+declare -A MOUNT_TIMEOUTS       # host/share -> seconds, from [mount_timeouts]
+MAX_BACKOFF=1800
+
+# Everything config.conf sets, back to the defaults; runs before every
+# load, as nas-monitord's does with config_set_defaults(), so a key that
+# was removed from the file does not keep its old value
+set_config_defaults() {
+    HOME_NETWORKS=()
+    NAS_DEVICES=()
+    HOME_NETWORK_SET=()
+    MOUNT_TIMEOUTS=()
+    HOME_AC_INTERVAL=15
+    HOME_BATTERY_INTERVAL=60
+    AWAY_AC_INTERVAL=180
+    AWAY_BATTERY_INTERVAL=600
+    MIN_BATTERY_LEVEL=10
+    MAX_FAILED_ATTEMPTS=3
+    PROBE_TIMEOUT_MS=500
+    STALE_MOUNT_TIMEOUT_MS=2000
+    MOUNT_TIMEOUT=30
+    UNMOUNT_ON_LEAVE=true
+    UNMOUNT_ON_SUSPEND=true
+    MAX_LOG_SIZE=1024  # KiB
+    ENABLE_NOTIFICATIONS=true
+}
+set_config_defaults
 
 # Runtime state
 declare -A FAILED_ATTEMPTS
+declare -A HOST_DOWN
+declare -A RETRY_AFTER
 CURRENT_NETWORK=""
 IS_HOME_NETWORK=false
 ON_AC_POWER=false
 LAST_STATUS_LOG=0
+RELOAD_REQUESTED=false
+SUSPEND_REQUESTED=false
+RESUMED=false
+SLEEP_WATCH_PID=""
+INHIBITOR_PID=""
+RESUME_WINDOW=90        # seconds of quick checks after resume
+RESUME_DELAYS=(1 2 2 3 5 5 10)  # their spacing; the last one repeats
+RESUME_UNTIL=0          # SECONDS value; 0 outside a resume burst
+RESUME_CHECKS=0
+PENDING_SHARES=0        # listed shares left unmounted by the last cycle
+
+# Timestamps in-process with printf %T, keeps one descriptor open, and
+# writes each burst of lines in one go once output pauses (or at 4 KiB)
+log_writer() {
+    local line buffer="" size log_fd
+    local -a wait_opt
+    
+    exec {log_fd}>>"$LOG_FILE"
+    size=$(stat -c %s "$LOG_FILE" 2>/dev/null || echo 0)
+    
+    while true; do
+        # Only wait with a timeout while lines are pending; idle reads block
+        wait_opt=()
+        [ -n "$buffer" ] && wait_opt=(-t 0.2)
+        
+        if IFS= read -r "${wait_opt[@]}" line; then
+            printf -v line '%(%Y-%m-%d %H:%M:%S)T: %s\n' -1 "$line"
+            buffer+="$line"
+            [ ${#buffer} -lt 4096 ] && continue
+        elif [ $? -le 128 ]; then
+            # EOF: write what is left and stop
+            printf '%s' "$buffer" >&"$log_fd"
+            break
+        fi
+        
+        printf '%s' "$buffer" >&"$log_fd"
+        size=$((size + ${#buffer}))
+        buffer=""
+        
+        # Size-based rotation keeps a single previous generation
+        if [ "$size" -gt $((MAX_LOG_SIZE * 1024)) ]; then
+            exec {log_fd}>&-
+            mv -f "$LOG_FILE" "$LOG_FILE.1"
+            exec {log_fd}>>"$LOG_FILE"
+            size=0
+        fi
+    done
+}
 
+# Once per run: helpers that outlive a check inherit the writer through
+# stdout, so a second writer would not replace the first but run next to it
 setup_logging() {
     mkdir -p "$(dirname "$LOG_FILE")"
-    exec 1> >(while IFS= read -r line; do echo "$(date '+%Y-%m-%d %H:%M:%S'): $line" >> "$LOG_FILE"; done)
+    exec 1> >(log_writer 9>&-)
     exec 2>&1
 }
 
 cleanup() {
     echo "NAS monitor stopping"
-    rm -f "$LOCK_FILE"
+    [ -n "$SLEEP_WATCH_PID" ] && kill "$SLEEP_WATCH_PID" 2>/dev/null
+    release_sleep_inhibitor
     exit 0
 }
 
+# The flock lives as long as fd 9, i.e. until this script exits however it
+# ends, so there is no stale lock to clean up and no gap between checking
+# for another instance and taking the lock. The file itself stays: removing
+# it would let a newcomer lock a fresh file while the old one is still held.
+# Helpers that outlive a single check are started with 9>&- so that they
+# cannot keep the lock after the script is gone.
 check_lock() {
-    if [ -f "$LOCK_FILE" ]; then
+    if ! { exec 9<>"$LOCK_FILE"; } 2>/dev/null; then
+        echo "WARNING: Cannot open lock file $LOCK_FILE"
+        return
+    fi
+    if ! flock -n 9; then
         local pid
-        pid=$(cat "$LOCK_FILE")
-        if ps -p "$pid" > /dev/null 2>&1; then
-            echo "Another instance is already running (PID: $pid)"
-            exit 1
-        else
-            echo "Removing stale lock file"
-            rm -f "$LOCK_FILE"
-        fi
+        read -r pid < "$LOCK_FILE"
+        echo "Another instance is already running (PID: ${pid:-unknown})"
+        exit 1
     fi
     echo $$ > "$LOCK_FILE"
 }
@@ -61,6 +145,8 @@ load_config() {
     # Parse networks section
     local in_networks=false
     local in_nas=false
+    local in_timeouts=false
+    local in_profile=false
     
     while IFS= read -r line || [ -n "$line" ]; do
         # Skip comments and empty lines
@@ -71,14 +157,44 @@ load_config() {
         if [[ "$line" =~ ^\[networks\]$ ]]; then
             in_networks=true
             in_nas=false
+            in_timeouts=false
+            in_profile=false
             continue
         elif [[ "$line" =~ ^\[nas_devices\]$ ]]; then
             in_networks=false
             in_nas=true
+            in_timeouts=false
+            in_profile=false
+            continue
+        elif [[ "$line" =~ ^\[profile:.*\]$ ]]; then
+            in_networks=false
+            in_nas=false
+            in_timeouts=false
+            in_profile=true
+            echo "WARNING: Ignoring $line: network profiles need nas-monitord"
+            continue
+        elif [[ "$line" =~ ^\[mount_timeouts\]$ ]]; then
+            in_networks=false
+            in_nas=false
+            in_timeouts=true
+            in_profile=false
             continue
         elif [[ "$line" =~ ^\[.*\]$ ]]; then
             in_networks=false
             in_nas=false
+            in_timeouts=false
+            in_profile=false
+        fi
+        
+        # Profile keys never touch the global settings of the same name
+        $in_profile && continue
+        
+        # Per-share mount timeouts, in seconds
+        if $in_timeouts; then
+            if [[ "$line" =~ ^([^=]+)=([0-9]+)$ ]]; then
+                MOUNT_TIMEOUTS["${BASH_REMATCH[1]}"]="${BASH_REMATCH[2]}"
+            fi
+            continue
         fi
         
         # Parse network names
@@ -86,8 +202,8 @@ load_config() {
             IFS=',' read -ra HOME_NETWORKS <<< "${BASH_REMATCH[1]}"
         fi
         
-        # Parse NAS devices
-        if $in_nas && [[ "$line" =~ ^[^=]*\.[^=]*/[^=]*$ ]]; then
+        # Parse NAS devices (same rule as libnasmon-config: host/share)
+        if $in_nas && [[ "$line" =~ ^[^=/][^=]*/[^=]+$ ]]; then
             NAS_DEVICES+=("$line")
         fi
         
@@ -102,6 +218,13 @@ load_config() {
                 away_ac_interval) AWAY_AC_INTERVAL="$value" ;;
                 away_battery_interval) AWAY_BATTERY_INTERVAL="$value" ;;
                 min_battery_level) MIN_BATTERY_LEVEL="$value" ;;
+                max_failed_attempts) MAX_FAILED_ATTEMPTS="$value" ;;
+                probe_timeout_ms) PROBE_TIMEOUT_MS="$value" ;;
+                stale_mount_timeout_ms) STALE_MOUNT_TIMEOUT_MS="$value" ;;
+                mount_timeout) MOUNT_TIMEOUT="$value" ;;
+                unmount_on_leave) UNMOUNT_ON_LEAVE="$value" ;;
+                unmount_on_suspend) UNMOUNT_ON_SUSPEND="$value" ;;
+                max_log_size) MAX_LOG_SIZE="$value" ;;
                 enable_notifications) ENABLE_NOTIFICATIONS="$value" ;;
             esac
         fi
@@ -113,29 +236,77 @@ load_config() {
         exit 1
     fi
     
+    # Keyed with a leading "+" because bash rejects an empty subscript and
+    # wired connections have an empty SSID
+    local network
+    for network in "${HOME_NETWORKS[@]}"; do
+        HOME_NETWORK_SET["+$network"]=1
+    done
+}
+
+log_config() {
     echo "Loaded configuration:"
     echo "  Home networks: ${HOME_NETWORKS[*]}"
     echo "  NAS devices: ${NAS_DEVICES[*]}"
     echo "  Intervals: AC($HOME_AC_INTERVAL) Battery($HOME_BATTERY_INTERVAL) Away-AC($AWAY_AC_INTERVAL) Away-Battery($AWAY_BATTERY_INTERVAL)"
 }
 
-get_current_network() {
-    if command -v nmcli >/dev/null 2>&1; then
-        nmcli -t -f active,ssid dev wifi 2>/dev/null | grep '^yes' | cut -d':' -f2
-    else
-        echo ""  # Assume ethernet if nmcli not available
+# Re-reads the config on SIGHUP (systemctl reload). A file that would make
+# load_config bail out is rejected up front so the old settings stay live;
+# backoff state is kept for shares that are still listed. The log writer
+# keeps the max_log_size it started with.
+reload_config() {
+    if ! (set_config_defaults; load_config); then
+        echo "Configuration reload failed; keeping the previous configuration"
+        return 1
     fi
+    
+    set_config_defaults
+    load_config
+    log_config
+    echo "Configuration reloaded"
 }
 
-is_home_network() {
-    local current_network="$1"
+# Waits for NetworkManager and gvfs to own their D-Bus names (at most 30s)
+# instead of a fixed delay; gdbus before GLib 2.68 has no "wait"
+wait_for_session() {
+    if ! gdbus help 2>&1 | grep -qw wait; then
+        sleep 10
+        return
+    fi
     
-    for network in "${HOME_NETWORKS[@]}"; do
-        if [[ "$current_network" == "$network" ]]; then
-            return 0
-        fi
-    done
-    return 1
+    gdbus wait --system --timeout 30 org.freedesktop.NetworkManager 2>/dev/null &
+    local nm_wait=$!
+    gdbus wait --session --timeout 30 --activate org.gtk.vfs.Daemon org.gtk.vfs.Daemon 2>/dev/null &
+    local gvfs_wait=$!
+    
+    wait "$nm_wait" || echo "NetworkManager not on the bus; continuing without it"
+    wait "$gvfs_wait" || echo "gvfs not on the bus; continuing without it"
+}
+
+# Sets CURRENT_NETWORK to the SSID of the active WiFi connection, from
+# NetworkManager's cache (--rescan no), so no scan is ever triggered.
+# nmcli's terse output escapes ':' and '\' inside fields.
+read_current_network() {
+    CURRENT_NETWORK=""
+    command -v nmcli >/dev/null 2>&1 || return  # Assume ethernet if nmcli not available
+    
+    local line
+    line=$(nmcli -t -f active,ssid dev wifi list --rescan no 2>/dev/null | grep -m1 '^yes')
+    [ -n "$line" ] || return
+    line="${line#yes:}"
+    line="${line//\\:/:}"
+    CURRENT_NETWORK="${line//\\\\/\\}"
+}
+
+# Sets IS_HOME_NETWORK from home_networks. Network profiles are left to
+# nas-monitord, whose parser checks them; the shell fallback ignores them.
+check_home_network() {
+    if [ -n "${HOME_NETWORK_SET["+$CURRENT_NETWORK"]}" ]; then
+        IS_HOME_NETWORK=true
+    else
+        IS_HOME_NETWORK=false
+    fi
 }
 
 check_power_source() {
@@ -144,7 +315,7 @@ check_power_source() {
         local adapters
         adapters=$(upower -e | grep -E 'ADP|AC')
         for adapter in $adapters; do
-            if upower -i "$adapter" 2>/dev/null | grep -q "online:.*true"; then
+            if upower -i "$adapter" 2>/dev/null | grep -Eq "online:[[:space:]]*(yes|true)"; then
                 return 0
             fi
         done
@@ -198,12 +369,14 @@ determine_check_interval() {
     local battery_level
     battery_level=$(get_battery_level)
     local base_interval
+    local home_ac=$HOME_AC_INTERVAL
+    local home_battery=$HOME_BATTERY_INTERVAL
     
     if $IS_HOME_NETWORK; then
         if $ON_AC_POWER; then
-            base_interval=$HOME_AC_INTERVAL
+            base_interval=$home_ac
         else
-            base_interval=$HOME_BATTERY_INTERVAL
+            base_interval=$home_battery
         fi
     else
         if $ON_AC_POWER; then
@@ -232,9 +405,174 @@ send_notification() {
     fi
 }
 
+# TCP connect to the SMB port; works where ICMP is filtered and needs no
+# setuid ping. timeout accepts fractional seconds.
+is_host_reachable() {
+    local seconds
+    printf -v seconds '%d.%03d' $((PROBE_TIMEOUT_MS / 1000)) $((PROBE_TIMEOUT_MS % 1000))
+    timeout "$seconds" bash -c ': < "/dev/tcp/$1/445"' _ "$1" 2>/dev/null
+}
+
+# Asks gvfs for the share root's type. A dead server makes this hang until
+# the SMB timeout, so it gets STALE_MOUNT_TIMEOUT_MS; going through gio
+# rather than stat on the FUSE path means being killed actually frees us.
+is_mount_responding() {
+    local seconds
+    printf -v seconds '%d.%03d' $((STALE_MOUNT_TIMEOUT_MS / 1000)) $((STALE_MOUNT_TIMEOUT_MS % 1000))
+    timeout "$seconds" gio info -a standard::type "smb://$1/" >/dev/null 2>&1
+}
+
+# Forced: nothing pending on a share we left or that stopped answering
+# can complete anyway
+unmount_share() {
+    if timeout 10 gio mount -u -f "smb://$1/" >/dev/null 2>&1; then
+        echo "Unmounted $1${2:+ ($2)}"
+    else
+        echo "WARNING: Cannot unmount $1"
+        return 1
+    fi
+}
+
+# After leaving the home networks, unmount the shares: left mounted,
+# anything touching them blocks for the whole SMB timeout
+detach_departed_shares() {
+    local mount_list
+    mount_list=$(gio mount -l 2>/dev/null)
+    
+    for nas_device in "${NAS_DEVICES[@]}"; do
+        if is_share_mounted "$mount_list" "${nas_device%%/*}" "${nas_device#*/}"; then
+            unmount_share "$nas_device" "not used on this network"
+        fi
+    done
+}
+
+# logind waits (up to its InhibitDelayMaxSec) for delay inhibitors before
+# suspending; systemd-inhibit holds one for as long as its child runs
+take_sleep_inhibitor() {
+    [ "$UNMOUNT_ON_SUSPEND" = true ] && [ -z "$INHIBITOR_PID" ] || return 0
+    command -v systemd-inhibit >/dev/null 2>&1 || return 0
+    systemd-inhibit --what=sleep --mode=delay --who="NAS Monitor" \
+        --why="Unmounting network shares" sleep infinity >/dev/null 2>&1 9>&- &
+    INHIBITOR_PID=$!
+}
+
+# Ending the child is what makes systemd-inhibit let go of the lock
+release_sleep_inhibitor() {
+    [ -n "$INHIBITOR_PID" ] || return 0
+    pkill -P "$INHIBITOR_PID" 2>/dev/null || kill "$INHIBITOR_PID" 2>/dev/null
+    INHIBITOR_PID=""
+}
+
+# Turns logind's PrepareForSleep into USR2 (going down) and USR1 (back up)
+# for the main loop. gdbus prints one line per signal, like
+#   /org/freedesktop/login1: org.freedesktop.login1.Manager.PrepareForSleep (true,)
+forward_sleep_signals() {
+    local line
+    while IFS= read -r line; do
+        case "$line" in
+            *".PrepareForSleep (true,)"*) kill -USR2 $$ ;;
+            *".PrepareForSleep (false,)"*) kill -USR1 $$ ;;
+        esac
+    done
+}
+
+watch_sleep() {
+    command -v gdbus >/dev/null 2>&1 || return 0
+    gdbus monitor --system --dest org.freedesktop.login1 \
+        --object-path /org/freedesktop/login1 2>/dev/null 9>&- > >(forward_sleep_signals 9>&-) &
+    SLEEP_WATCH_PID=$!
+}
+
+# Before suspend: the SMB sessions do not survive it, and a mount left
+# behind hangs whatever touches it after resume
+prepare_for_suspend() {
+    echo "Preparing for suspend"
+    RESUME_UNTIL=0
+    if [ "$UNMOUNT_ON_SUSPEND" = true ]; then
+        local mount_list
+        mount_list=$(gio mount -l 2>/dev/null)
+        for nas_device in "${NAS_DEVICES[@]}"; do
+            if is_share_mounted "$mount_list" "${nas_device%%/*}" "${nas_device#*/}"; then
+                unmount_share "$nas_device" "for suspend"
+            fi
+        done
+    fi
+    release_sleep_inhibitor
+}
+
+# Counts and backoffs from before the suspend no longer apply
+start_resume_burst() {
+    echo "Resumed; checking every few seconds until the network settles"
+    for nas_device in "${NAS_DEVICES[@]}"; do
+        reset_backoff "$nas_device"
+    done
+    RESUME_UNTIL=$((SECONDS + RESUME_WINDOW))
+    RESUME_CHECKS=0
+    take_sleep_inhibitor
+}
+
+# Sets NEXT_DELAY: the check interval, or during a resume burst the next
+# short spacing, until every share is back on a home network or the
+# burst's window has gone by
+next_check_delay() {
+    NEXT_DELAY=$CHECK_INTERVAL
+    [ "$RESUME_UNTIL" -gt 0 ] || return 0
+    
+    if { $IS_HOME_NETWORK && [ "$PENDING_SHARES" -eq 0 ]; } || [ "$SECONDS" -ge "$RESUME_UNTIL" ]; then
+        echo "Back to the normal schedule after $RESUME_CHECKS quick checks since resume"
+        RESUME_UNTIL=0
+        return 0
+    fi
+    local step=$RESUME_CHECKS
+    [ "$step" -ge "${#RESUME_DELAYS[@]}" ] && step=$((${#RESUME_DELAYS[@]} - 1))
+    NEXT_DELAY=${RESUME_DELAYS[$step]}
+    ((RESUME_CHECKS++))
+}
+
+reset_backoff() {
+    FAILED_ATTEMPTS["$1"]=0
+    HOST_DOWN["$1"]=false
+    RETRY_AFTER["$1"]=0
+}
+
+# Count a failure; past MAX_FAILED_ATTEMPTS, hold the device back for the
+# check interval doubled per further failure, up to MAX_BACKOFF seconds
+# Failures while the network comes back after resume are not counted
+record_failure() {
+    local mount_key="$1"
+    [ "$RESUME_UNTIL" -gt 0 ] && return
+    local failures=$((${FAILED_ATTEMPTS["$mount_key"]:-0} + 1))
+    FAILED_ATTEMPTS["$mount_key"]=$failures
+    HOST_DOWN["$mount_key"]=$2
+
+    local excess=$((failures - MAX_FAILED_ATTEMPTS))
+    [ "$excess" -lt 0 ] && return
+
+    local delay=$CHECK_INTERVAL
+    while [ "$excess" -ge 0 ] && [ "$delay" -lt "$MAX_BACKOFF" ]; do
+        delay=$((delay * 2))
+        ((excess--))
+    done
+    [ "$delay" -gt "$MAX_BACKOFF" ] && delay=$MAX_BACKOFF
+
+    # Bash's SECONDS counter avoids forking date for every device
+    RETRY_AFTER["$mount_key"]=$((SECONDS + delay))
+    echo "Backing off $mount_key for ${delay}s after $failures failures"
+}
+
+is_share_mounted() {
+    local mount_list="$1"
+    local uri="smb://$2/$3/"
+    
+    # Compare lowercased copies so mixed-case share names still match
+    [[ "${mount_list,,}" == *"${uri,,}"* ]]
+}
+
 check_and_mount_nas() {
     local mounted_count=0
     local attempted_count=0
+    local listed_count=0
+    PENDING_SHARES=0
     
     # Only attempt mounting on home network
     if ! $IS_HOME_NETWORK; then
@@ -249,37 +587,65 @@ check_and_mount_nas() {
         return 0
     fi
     
+    # Snapshot the mount table once per cycle instead of once per device
+    local mount_list
+    mount_list=$(gio mount -l 2>/dev/null)
+    
     for nas_device in "${NAS_DEVICES[@]}"; do
-        local nas_host nas_share
-        nas_host=$(echo "$nas_device" | cut -d'/' -f1)
-        nas_share=$(echo "$nas_device" | cut -d'/' -f2-)
+        local nas_host="${nas_device%%/*}"
+        local nas_share="${nas_device#*/}"
         local mount_key="$nas_device"
         
-        # Check if already mounted
-        if gio mount -l 2>/dev/null | grep -q "$nas_host.*$nas_share"; then
-            FAILED_ATTEMPTS["$mount_key"]=0
-            ((mounted_count++))
+        ((listed_count++))
+        
+        # Check if already mounted (exact, case-insensitive smb://host/share/).
+        # A mount that stopped answering is detached and goes through the
+        # probe and mount below like any unmounted share.
+        if is_share_mounted "$mount_list" "$nas_host" "$nas_share"; then
+            if is_mount_responding "$nas_device"; then
+                reset_backoff "$mount_key"
+                ((mounted_count++))
+                continue
+            fi
+            echo "$nas_device did not answer within ${STALE_MOUNT_TIMEOUT_MS}ms; detaching the stale mount"
+            unmount_share "$nas_device" || continue
+        fi
+        
+        # Known to be failing; leave it alone until the backoff expires
+        if [ "${RETRY_AFTER["$mount_key"]:-0}" -gt "$SECONDS" ]; then
             continue
         fi
         
         ((attempted_count++))
         
         # Check connectivity before mount attempt
-        if ! ping -c 1 -W 3 "$nas_host" >/dev/null 2>&1; then
-            FAILED_ATTEMPTS["$mount_key"]=$((${FAILED_ATTEMPTS["$mount_key"]:-0} + 1))
-            echo "Cannot reach $nas_host (attempt ${FAILED_ATTEMPTS["$mount_key"]})"
+        if ! is_host_reachable "$nas_host"; then
+            echo "Cannot reach $nas_host (attempt $((${FAILED_ATTEMPTS["$mount_key"]:-0} + 1)))"
+            record_failure "$mount_key" true
             continue
         fi
         
-        # Attempt mount
-        if gio mount "smb://$nas_device" >/dev/null 2>&1; then
+        # Host is back: close the breaker opened while it was down
+        if [ "${HOST_DOWN["$mount_key"]:-false}" = true ]; then
+            reset_backoff "$mount_key"
+        fi
+        
+        # Attempt mount; a server that accepts the connection and then
+        # stalls would otherwise hold up every share after it
+        local mount_timeout="${MOUNT_TIMEOUTS["$nas_device"]:-$MOUNT_TIMEOUT}"
+        local status=0
+        timeout -k 5 "$mount_timeout" gio mount "smb://$nas_device" >/dev/null 2>&1 || status=$?
+        if [ "$status" -eq 0 ]; then
             echo "Successfully mounted $nas_device"
             send_notification "NAS Connected" "$nas_device is now available"
-            FAILED_ATTEMPTS["$mount_key"]=0
+            reset_backoff "$mount_key"
             ((mounted_count++))
         else
-            FAILED_ATTEMPTS["$mount_key"]=$((${FAILED_ATTEMPTS["$mount_key"]:-0} + 1))
-            echo "Failed to mount $nas_device (attempt ${FAILED_ATTEMPTS["$mount_key"]})"
+            if [ "$status" -eq 124 ] || [ "$status" -eq 137 ]; then
+                echo "Mounting $nas_device timed out after ${mount_timeout}s"
+            fi
+            echo "Failed to mount $nas_device (attempt $((${FAILED_ATTEMPTS["$mount_key"]:-0} + 1)))"
+            record_failure "$mount_key" false
             
             # Notify on first failure
             if [ "${FAILED_ATTEMPTS["$mount_key"]}" -eq 1 ]; then
@@ -288,6 +654,7 @@ check_and_mount_nas() {
         fi
     done
     
+    PENDING_SHARES=$((listed_count - mounted_count))
     return "$attempted_count"
 }
 
@@ -313,20 +680,68 @@ log_periodic_status() {
 }
 
 main() {
-    echo "Starting power-aware NAS monitor"
-    
-    setup_logging
     check_lock
     trap cleanup EXIT INT TERM
+    trap 'RELOAD_REQUESTED=true' HUP
+    trap 'SUSPEND_REQUESTED=true' USR2
+    trap 'RESUMED=true' USR1
     
+    # Until the log is set up, which needs max_log_size, errors go to the
+    # journal or the terminal
     load_config
+    setup_logging
+    echo "Starting power-aware NAS monitor"
+    log_config
+    
+    wait_for_session
+    if [ -n "${NOTIFY_SOCKET:-}" ] && command -v systemd-notify >/dev/null 2>&1; then
+        systemd-notify --ready --pid=$$
+    fi
+    watch_sleep
+    take_sleep_inhibitor
     
-    # Wait for desktop environment to be ready
-    sleep 10
+    local last_network=""
+    local was_home=false
+    local first_cycle=true
     
     while true; do
+        if $RELOAD_REQUESTED; then
+            RELOAD_REQUESTED=false
+            reload_config
+            [ "$UNMOUNT_ON_SUSPEND" = true ] || release_sleep_inhibitor
+            take_sleep_inhibitor
+        fi
+        
+        if $SUSPEND_REQUESTED; then
+            SUSPEND_REQUESTED=false
+            prepare_for_suspend
+            # Nothing to check until logind says we are back
+            while ! $RESUMED && kill -0 "$SLEEP_WATCH_PID" 2>/dev/null; do
+                sleep 60 &
+                wait $! || kill $! 2>/dev/null
+            done
+        fi
+        if $RESUMED; then
+            RESUMED=false
+            start_resume_burst
+        fi
+        
         # Update current state
-        CURRENT_NETWORK=$(get_current_network)
+        read_current_network
+        check_home_network
+        
+        # A different network means different reachability; retry everything
+        if ! $first_cycle && [ "$CURRENT_NETWORK" != "$last_network" ]; then
+            for nas_device in "${NAS_DEVICES[@]}"; do
+                reset_backoff "$nas_device"
+            done
+        fi
+        if $was_home && ! $IS_HOME_NETWORK && [ "$UNMOUNT_ON_LEAVE" = true ]; then
+            detach_departed_shares
+        fi
+        last_network="$CURRENT_NETWORK"
+        was_home=$IS_HOME_NETWORK
+        first_cycle=false
         
         if check_power_source; then
             ON_AC_POWER=true
@@ -334,12 +749,6 @@ main() {
             ON_AC_POWER=false
         fi
         
-        if is_home_network "$CURRENT_NETWORK"; then
-            IS_HOME_NETWORK=true
-        else
-            IS_HOME_NETWORK=false
-        fi
-        
         # Determine check interval
         CHECK_INTERVAL=$(determine_check_interval)
         
@@ -349,8 +758,11 @@ main() {
         # Attempt NAS mounting
         check_and_mount_nas
         
-        # Sleep until next check
-        sleep "$CHECK_INTERVAL"
+        # Sleep until next check; waiting on it lets SIGHUP and the
+        # suspend/resume signals cut it short
+        next_check_delay
+        sleep "$NEXT_DELAY" &
+        wait $! || kill $! 2>/dev/null
     done
 }
 
@@ -0,0 +1,361 @@
+/*
+ * NAS Monitor Control
+ * Command-line client for nas-monitord's control socket
+ *
+ * Sends one request line and prints the daemon's reply, JSON except for
+ * `metrics`. Plain C with no GLib or GTK, so a call costs a connect and a
+ * round trip; with nas-monitor.socket enabled the first one also starts
+ * the daemon. Device changes go out as a single batch that the daemon
+ * writes to config.conf at once, so a provisioning script adding or
+ * removing hundreds of shares causes one reload:
+ *
+ *   $ nas-monitorctl add < shares.txt
+ *   $ printf '+nas/photos\n-old-nas/backup\n' | nas-monitorctl apply
+ *
+ * Compile with:
+ * gcc -o nas-monitorctl nas-monitorctl.c -std=c99
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef VERSION
+#define VERSION "unknown"
+#endif
+
+#define DEFAULT_TIMEOUT 10      /* seconds; covers a socket-activated start */
+
+/* Exit statuses */
+#define EXIT_REFUSED 1          /* the daemon answered with an error */
+#define EXIT_USAGE 2
+#define EXIT_UNREACHABLE 3      /* no daemon, or it did not answer in time */
+
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static bool buffer_append(Buffer *buffer, const char *data, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity < buffer->length + length + 1) {
+            capacity *= 2;
+        }
+        char *text = realloc(buffer->text, capacity);
+        if (!text) {
+            return false;
+        }
+        buffer->text = text;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->text + buffer->length, data, length);
+    buffer->length += length;
+    buffer->text[buffer->length] = '\0';
+    return true;
+}
+
+static void usage(FILE *out) {
+    fprintf(out,
+            "Usage: nas-monitorctl [OPTION...] COMMAND [ARG...]\n"
+            "\n"
+            "Commands:\n"
+            "  status                  Current state as JSON (the default)\n"
+            "  metrics                 Prometheus text format\n"
+            "  mount [HOST/SHARE...]   Check and mount now; all shares if none given\n"
+            "  unmount [HOST/SHARE...] Unmount and leave alone until mounted again\n"
+            "  reload                  Re-read config.conf\n"
+            "  add [HOST/SHARE...]     Add shares to [nas_devices]\n"
+            "  remove [HOST/SHARE...]  Remove shares from [nas_devices]\n"
+            "  apply [FILE]            Apply +HOST/SHARE and -HOST/SHARE lines\n"
+            "  trace                   Write the trace buffer (--trace)\n"
+            "\n"
+            "add and remove read one share per line when none are given, and apply\n"
+            "reads FILE or standard input; blank lines and # comments are skipped.\n"
+            "\n"
+            "Options:\n"
+            "  -f, --file=FILE       Read add/remove shares from FILE (- for stdin)\n"
+            "  -s, --socket=PATH     Control socket (default $XDG_RUNTIME_DIR/nas-monitor.sock)\n"
+            "  -t, --timeout=SECONDS Give up waiting for the daemon (default %d)\n"
+            "  -V, --version         Show version\n"
+            "  -h, --help            Show this help\n",
+            DEFAULT_TIMEOUT);
+}
+
+// Same rule as init_paths in nas-monitord
+static void default_socket_path(char *path, size_t size) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir) {
+        snprintf(path, size, "%s/nas-monitor.sock", runtime_dir);
+        return;
+    }
+
+    const char *user = getenv("USER");
+    if (!user) {
+        struct passwd *entry = getpwuid(getuid());
+        user = entry ? entry->pw_name : "unknown";
+    }
+    snprintf(path, size, "/tmp/nas-monitor-%s.sock", user);
+}
+
+// Appends one batch entry. Fields are tab-separated on the wire, and a
+// request is one line, so neither can appear inside an entry.
+static bool add_entry(Buffer *request, const char *prefix, const char *entry) {
+    if (strpbrk(entry, "\t\n")) {
+        fprintf(stderr, "nas-monitorctl: tab or newline in \"%s\"\n", entry);
+        return false;
+    }
+    return buffer_append(request, "\t", 1) &&
+           buffer_append(request, prefix, strlen(prefix)) &&
+           buffer_append(request, entry, strlen(entry));
+}
+
+static char *trim(char *text) {
+    while (*text == ' ' || *text == '\t' || *text == '\r') {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' ||
+                          end[-1] == '\n')) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+// Every non-blank, non-comment line of path ("-" or NULL for stdin) as an
+// entry. Returns the number of entries, or -1 on error.
+static int read_entries(Buffer *request, const char *prefix, const char *path) {
+    bool use_stdin = !path || strcmp(path, "-") == 0;
+    FILE *file = use_stdin ? stdin : fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "nas-monitorctl: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    int count = 0;
+    while (getline(&line, &size, file) >= 0) {
+        char *entry = trim(line);
+        if (*entry == '\0' || *entry == '#') {
+            continue;
+        }
+        if (!add_entry(request, prefix, entry)) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    if (count >= 0 && ferror(file)) {
+        fprintf(stderr, "nas-monitorctl: %s: %s\n", use_stdin ? "stdin" : path,
+                strerror(errno));
+        count = -1;
+    }
+
+    free(line);
+    if (!use_stdin) {
+        fclose(file);
+    }
+    return count;
+}
+
+static bool send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// One request, one reply, then the daemon closes the connection
+static int transact(const char *socket_path, int timeout_s, const Buffer *request,
+                    Buffer *reply) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "nas-monitorctl: socket path too long: %s\n", socket_path);
+        return EXIT_USAGE;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "nas-monitorctl: socket: %s\n", strerror(errno));
+        return EXIT_UNREACHABLE;
+    }
+    struct timeval timeout = { .tv_sec = timeout_s };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "nas-monitorctl: cannot reach nas-monitord at %s: %s\n",
+                socket_path, strerror(errno));
+        close(fd);
+        return EXIT_UNREACHABLE;
+    }
+    if (!send_all(fd, request->text, request->length)) {
+        fprintf(stderr, "nas-monitorctl: sending the request: %s\n", strerror(errno));
+        close(fd);
+        return EXIT_UNREACHABLE;
+    }
+    shutdown(fd, SHUT_WR);
+
+    char chunk[4096];
+    for (;;) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "nas-monitorctl: no reply from nas-monitord: %s\n",
+                    errno == EAGAIN ? "timed out" : strerror(errno));
+            close(fd);
+            return EXIT_UNREACHABLE;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (!buffer_append(reply, chunk, (size_t)n)) {
+            fprintf(stderr, "nas-monitorctl: %s\n", strerror(ENOMEM));
+            close(fd);
+            return EXIT_UNREACHABLE;
+        }
+    }
+    close(fd);
+
+    if (reply->length == 0) {
+        fprintf(stderr, "nas-monitorctl: nas-monitord closed the connection without a reply\n");
+        return EXIT_UNREACHABLE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Builds the request line for argv; returns an exit status on failure
+static int build_request(Buffer *request, int argc, char **argv, const char *file) {
+    const char *command = argc > 0 ? argv[0] : "status";
+    bool ok = true;
+
+    if (strcmp(command, "status") == 0 || strcmp(command, "metrics") == 0 ||
+        strcmp(command, "reload") == 0 || strcmp(command, "trace") == 0) {
+        if (argc > 1) {
+            fprintf(stderr, "nas-monitorctl: %s takes no arguments\n", command);
+            return EXIT_USAGE;
+        }
+        ok = buffer_append(request, command, strlen(command));
+    } else if (strcmp(command, "mount") == 0 || strcmp(command, "unmount") == 0) {
+        ok = buffer_append(request, command, strlen(command));
+        for (int i = 1; ok && i < argc; i++) {
+            ok = add_entry(request, "", argv[i]);
+        }
+    } else if (strcmp(command, "add") == 0 || strcmp(command, "remove") == 0) {
+        const char *prefix = command[0] == 'a' ? "+" : "-";
+        ok = buffer_append(request, "devices", 7);
+        for (int i = 1; ok && i < argc; i++) {
+            ok = add_entry(request, prefix, argv[i]);
+        }
+        if (ok && argc == 1) {
+            ok = read_entries(request, prefix, file) >= 0;
+        }
+    } else if (strcmp(command, "apply") == 0) {
+        if (argc > 2) {
+            fprintf(stderr, "nas-monitorctl: apply takes one file\n");
+            return EXIT_USAGE;
+        }
+        // The daemon checks each entry's +/-, so a bad batch is rejected whole
+        ok = buffer_append(request, "devices", 7) &&
+             read_entries(request, "", argc == 2 ? argv[1] : file) >= 0;
+    } else {
+        fprintf(stderr, "nas-monitorctl: unknown command: %s\n", command);
+        usage(stderr);
+        return EXIT_USAGE;
+    }
+
+    if (!ok || !buffer_append(request, "\n", 1)) {
+        return EXIT_USAGE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        { "file",    required_argument, NULL, 'f' },
+        { "socket",  required_argument, NULL, 's' },
+        { "timeout", required_argument, NULL, 't' },
+        { "version", no_argument,       NULL, 'V' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path) + 64] = "";
+    const char *file = NULL;
+    int timeout_s = DEFAULT_TIMEOUT;
+    int option;
+
+    // Options go before the command; "+" leaves everything after it alone
+    while ((option = getopt_long(argc, argv, "+f:s:t:Vh", options, NULL)) != -1) {
+        switch (option) {
+        case 'f':
+            file = optarg;
+            break;
+        case 's':
+            snprintf(socket_path, sizeof(socket_path), "%s", optarg);
+            break;
+        case 't': {
+            char *end;
+            long value = strtol(optarg, &end, 10);
+            if (*end != '\0' || value < 1 || value > 3600) {
+                fprintf(stderr, "nas-monitorctl: --timeout must be 1..3600 seconds\n");
+                return EXIT_USAGE;
+            }
+            timeout_s = (int)value;
+            break;
+        }
+        case 'V':
+            printf("nas-monitorctl %s\n", VERSION);
+            return EXIT_SUCCESS;
+        case 'h':
+            usage(stdout);
+            return EXIT_SUCCESS;
+        default:
+            usage(stderr);
+            return EXIT_USAGE;
+        }
+    }
+    if (!*socket_path) {
+        default_socket_path(socket_path, sizeof(socket_path));
+    }
+
+    Buffer request = { 0 };
+    Buffer reply = { 0 };
+    int status = build_request(&request, argc - optind, argv + optind, file);
+    if (status == EXIT_SUCCESS) {
+        status = transact(socket_path, timeout_s, &request, &reply);
+    }
+    if (status == EXIT_SUCCESS) {
+        fwrite(reply.text, 1, reply.length, stdout);
+        // Errors are the only replies that start with this key
+        if (strncmp(reply.text, "{\"error\"", 8) == 0) {
+            status = EXIT_REFUSED;
+        }
+    }
+
+    free(request.text);
+    free(reply.text);
+    return status;
+}
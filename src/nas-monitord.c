@@ -0,0 +1,2265 @@
+/*
+ * NAS Monitor Daemon
+ * Native replacement for the nas-monitor.sh main loop
+ *
+ * Runs the same power-aware mount cycle as the shell script, but detects
+ * network, power and mount state in-process (D-Bus, sysfs, GIO) instead of
+ * forking nmcli/upower/gio/ping/date on every iteration.
+ *
+ * Cycles run from a GLib main loop. NetworkManager signals and kernel
+ * power_supply uevents (UPower signals where sysfs has no power supplies)
+ * trigger a cycle right away; the configured intervals only act as
+ * a safety-net poll. Within a cycle, devices are grouped by host so one
+ * reachability probe covers all of a host's shares. All hosts are probed
+ * at once with TCP connects to the SMB port, then mounts run concurrently
+ * up to [behavior] max_concurrency. With adaptive_schedule, the poll
+ * interval follows what has been learned about when each share's host
+ * comes and goes (monitor-schedule.c) instead of staying fixed.
+ *
+ * Compile with:
+ * gcc -o nas-monitord nas-monitord.c monitor-*.c `pkg-config --cflags --libs gio-2.0` -std=c99
+ */
+
+#define _GNU_SOURCE
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "monitor-config.h"
+#include "monitor-control.h"
+#include "monitor-events.h"
+#include "monitor-histogram.h"
+#include "monitor-log.h"
+#include "monitor-memory.h"
+#include "monitor-mount.h"
+#include "monitor-network.h"
+#include "monitor-power.h"
+#include "monitor-probe.h"
+#include "monitor-profile.h"
+#include "monitor-queue.h"
+#include "monitor-ready.h"
+#include "monitor-resolve.h"
+#include "monitor-schedule.h"
+#include "monitor-shared.h"
+#include "monitor-sleep.h"
+#include "monitor-trace.h"
+
+#ifndef VERSION
+#define VERSION "unknown"
+#endif
+
+#define MAX_PATH 512
+#define READY_TIMEOUT 30        /* start anyway if NM/gvfs never show up */
+#define STATUS_LOG_INTERVAL 3600
+#define EVENT_SETTLE_MS 100     /* coalesce bursts of NetworkManager signals */
+#define MAX_BACKOFF 1800        /* cap for a failing device's retry interval */
+#define MAX_SLACK_SHARE 4       /* a poll may slip by at most 1/4 of its delay */
+#define TRACE_EVENTS 4096       /* slices kept for --trace */
+#define SUSPEND_UNMOUNT_MS 4000 /* under logind's default InhibitDelayMaxSec of 5s */
+#define UNMOUNT_TIMEOUT_MS 10000 /* as nas-monitor.sh's timeout on gio mount -u */
+#define RESUME_WINDOW 90        /* seconds of quick checks after resume */
+#define LEAN_RESERVE_BASE (128 * 1024)  /* heap kept by lean_memory, before shares */
+
+// Where a share's time goes within a cycle, each with its own histogram
+typedef enum {
+    PHASE_RESOLVE,          /* looking up the host name */
+    PHASE_CONNECT,          /* the SMB port probe, once resolved */
+    PHASE_CHECK,            /* the stale-mount query of a mounted share */
+    PHASE_MOUNT,
+    PHASE_COUNT
+} Phase;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_RESOLVE] = "resolve",
+    [PHASE_CONNECT] = "connect",
+    [PHASE_CHECK] = "check",
+    [PHASE_MOUNT] = "mount",
+};
+
+typedef struct {
+    int failed_attempts;    /* consecutive probe or mount failures */
+    bool host_down;         /* last failure was the host not answering */
+    gint64 retry_after;     /* monotonic seconds; 0 while not backing off */
+    bool needs_mount;       /* not mounted when the current cycle started */
+    bool mounted;           /* as of the last check or mount change */
+    bool off_profile;       /* the current network's profile does not list it */
+    bool held;              /* unmounted on request; not mounted until asked again */
+    bool detach_requested;  /* held while mounted; the next cycle unmounts it */
+    bool checked;           /* found mounted or probed this cycle */
+    bool reachable;         /* if checked: mounted, or the host answered */
+    DeviceHistory *history; /* NULL unless adaptive_schedule is on */
+    unsigned probes;
+    unsigned probe_failures;
+    unsigned mounts;
+    unsigned mount_failures;
+    unsigned stale_mounts;  /* detached after not answering in time */
+    long last_probe_us;     /* -1 until the first probe */
+    long last_mount_us;     /* -1 until the first mount attempt */
+    Histogram phases[PHASE_COUNT];
+} DeviceState;
+
+typedef struct {
+    char *name;
+    int *devices;           /* indices into config.devices */
+    int device_count;
+} HostGroup;
+
+typedef struct {
+    char config_path[MAX_PATH];
+    char log_path[MAX_PATH];
+    char lock_path[MAX_PATH];
+    int lock_fd;            /* holds the instance lock; -1 without one */
+    char socket_path[MAX_PATH];
+    char history_path[MAX_PATH];
+    char address_path[MAX_PATH];
+    MonitorConfig config;
+    DeviceState *devices;
+    HostGroup *hosts;
+    int host_count;
+
+    GDBusConnection *system_bus;
+    GDBusConnection *session_bus;
+    GVolumeMonitor *volume_monitor;
+    MountWatch mounts;
+    GMainLoop *loop;
+    MonitorEvents events;
+    ControlServer control;
+    GFile *config_file;
+    GFileMonitor *config_monitor;
+    guint reload_source;
+    bool reload_pending;    /* config changed mid-cycle; apply when it ends */
+    PowerMonitor power;
+    guint power_source;
+    guint cycle_source;
+    WorkQueue *queue;
+    bool cycle_running;
+    bool cycle_requested;   /* a change event arrived mid-cycle */
+    unsigned cycles;
+    int interval;
+    int next_interval;      /* until the next poll; differs from interval if adaptive */
+    gint64 next_retry;      /* earliest backoff expiry if every device is backing off */
+    bool once;
+    bool started;           /* NM and gvfs were ready (or timed out) */
+    ReadyWatch ready;
+    ScheduleHistory history;    /* loaded once adaptive_schedule is first on */
+    ResolveCache resolve;
+    SharedProbe shared;     /* nas-probed, watched while shared_probe is on */
+    gint64 cycle_started;   /* monotonic microseconds */
+    Histogram cycle_time;
+    TraceBuffer trace;      /* enabled by --trace */
+    char trace_path[MAX_PATH];
+    SleepWatch sleep;
+    bool suspending;        /* between PrepareForSleep(true) and resume */
+    guint suspend_source;   /* lets the suspend go ahead if unmounts hang */
+    gint64 resume_until;    /* monotonic seconds; 0 outside a resume burst */
+    unsigned resume_checks;
+
+    ProfileIndex profiles;
+    NetworkIdentity network;
+    const NetworkProfile *profile;  /* NULL when away */
+    bool is_home_network;
+    bool left_network;      /* the next cycle detaches what the old one had */
+    bool on_ac_power;
+    int battery_level;
+    time_t last_status_log;
+} Monitor;
+
+static void init_paths(Monitor *monitor) {
+    const char *home = getenv("HOME");
+    const char *user = getenv("USER");
+    if (!home) home = "/tmp";
+    if (!user) user = g_get_user_name();
+
+    snprintf(monitor->config_path, MAX_PATH, "%s/.config/nas-monitor/config.conf", home);
+    snprintf(monitor->log_path, MAX_PATH, "%s/.local/share/nas-monitor.log", home);
+    snprintf(monitor->history_path, MAX_PATH, "%s/.local/share/nas-monitor/schedule-history",
+             home);
+    snprintf(monitor->address_path, MAX_PATH, "%s/.local/share/nas-monitor/addresses", home);
+
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir) {
+        snprintf(monitor->socket_path, MAX_PATH, "%s/nas-monitor.sock", runtime_dir);
+        snprintf(monitor->lock_path, MAX_PATH, "%s/nas-monitor.lock", runtime_dir);
+    } else {
+        snprintf(monitor->socket_path, MAX_PATH, "/tmp/nas-monitor-%s.sock", user);
+        snprintf(monitor->lock_path, MAX_PATH, "/tmp/nas-monitor-%s.lock", user);
+    }
+}
+
+// Same lock file as check_lock in nas-monitor.sh, so the script and the
+// native daemon never run side by side. The kernel drops the flock when the
+// process goes away however it ends, so there is no stale lock to detect
+// and no window between checking for one and taking it. The PID inside is
+// only for the message; the file is never removed, since a new instance
+// could otherwise lock a fresh file while another holds the old one.
+static bool acquire_lock(Monitor *monitor) {
+    int fd = open(monitor->lock_path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        monitor_log("WARNING: Cannot open lock file %s: %s",
+                    monitor->lock_path, strerror(errno));
+        return true;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        char pid[16] = "";
+        ssize_t length = pread(fd, pid, sizeof(pid) - 1, 0);
+        if (length > 0) {
+            pid[length] = '\0';
+        }
+        g_strstrip(pid);
+        monitor_log("Another instance is already running (PID: %s)", *pid ? pid : "unknown");
+        close(fd);
+        return false;
+    }
+
+    char pid[16];
+    int length = snprintf(pid, sizeof(pid), "%d\n", (int)getpid());
+    if (ftruncate(fd, 0) < 0 || pwrite(fd, pid, length, 0) != length) {
+        monitor_log("WARNING: Cannot write PID to %s: %s", monitor->lock_path, strerror(errno));
+    }
+    monitor->lock_fd = fd;
+    return true;
+}
+
+static void release_lock(Monitor *monitor) {
+    if (monitor->lock_fd >= 0) {
+        close(monitor->lock_fd);
+        monitor->lock_fd = -1;
+    }
+}
+
+static void group_devices_by_host(Monitor *monitor) {
+    const MonitorConfig *config = &monitor->config;
+    monitor->hosts = g_new0(HostGroup, config->device_count);
+    monitor->host_count = 0;
+
+    for (int i = 0; i < config->device_count; i++) {
+        HostGroup *group = NULL;
+        for (int h = 0; h < monitor->host_count && !group; h++) {
+            if (g_ascii_strcasecmp(monitor->hosts[h].name, config->devices[i].host) == 0) {
+                group = &monitor->hosts[h];
+            }
+        }
+        if (!group) {
+            group = &monitor->hosts[monitor->host_count++];
+            group->name = g_strdup(config->devices[i].host);
+            group->devices = g_new0(int, config->device_count);
+        }
+        group->devices[group->device_count++] = i;
+    }
+}
+
+static void free_host_groups(Monitor *monitor) {
+    for (int h = 0; h < monitor->host_count; h++) {
+        g_free(monitor->hosts[h].name);
+        g_free(monitor->hosts[h].devices);
+    }
+    g_clear_pointer(&monitor->hosts, g_free);
+    monitor->host_count = 0;
+}
+
+static bool read_config(const Monitor *monitor, MonitorConfig *config) {
+    config_set_defaults(config);
+
+    if (config_load(config, monitor->config_path) < 0) {
+        monitor_log("ERROR: Configuration file not found: %s", monitor->config_path);
+        monitor_log("Please create the configuration file first.");
+        return false;
+    }
+
+    for (int i = 0; i < config->issue_count; i++) {
+        monitor_log("WARNING: %s:%d: %s", monitor->config_path,
+                    config->issues[i].line, config->issues[i].message);
+    }
+
+    if (config->device_count == 0) {
+        monitor_log("ERROR: No NAS devices configured");
+        config_free(config);
+        return false;
+    }
+    return true;
+}
+
+static int find_device(const MonitorConfig *config, const char *spec) {
+    for (int i = 0; i < config->device_count; i++) {
+        if (strcmp(config->devices[i].spec, spec) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void init_device_state(DeviceState *state) {
+    memset(state, 0, sizeof(*state));
+    state->last_probe_us = -1;
+    state->last_mount_us = -1;
+}
+
+static void log_config(Monitor *monitor) {
+    GString *networks = g_string_new(NULL);
+    for (int i = 0; i < monitor->config.network_count; i++) {
+        g_string_append_printf(networks, "%s%s", i ? " " : "",
+                               monitor->config.home_networks[i]);
+    }
+    GString *devices = g_string_new(NULL);
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        g_string_append_printf(devices, "%s%s", i ? " " : "",
+                               monitor->config.devices[i].spec);
+    }
+
+    monitor_log("Loaded configuration:");
+    monitor_log("  Home networks: %s", networks->str);
+    monitor_log("  NAS devices: %s", devices->str);
+    for (int i = 0; i < monitor->config.profile_count; i++) {
+        const NetworkProfile *profile = &monitor->config.profiles[i];
+        GString *keys = g_string_new(NULL);
+        if (profile->ssid) {
+            g_string_append_printf(keys, "SSID \"%s\", ", profile->ssid);
+        }
+        monitor_log("  Profile %s: %s%d connections, %d subnets, %d access points, "
+                    "%d gateways, %d of %d shares",
+                    profile->name, keys->str, profile->connection_count,
+                    profile->subnet_count, profile->bssid_count, profile->gateway_mac_count,
+                    profile->device_count ? profile->device_count : monitor->config.device_count,
+                    monitor->config.device_count);
+        g_string_free(keys, TRUE);
+    }
+    monitor_log("  Intervals: AC(%d) Battery(%d) Away-AC(%d) Away-Battery(%d)%s",
+                monitor->config.home_ac_interval, monitor->config.home_battery_interval,
+                monitor->config.away_ac_interval, monitor->config.away_battery_interval,
+                monitor->config.adaptive_schedule ? ", adaptive" : "");
+    monitor_log("  Hosts: %d, max concurrency: %d, probe timeout: %dms, backoff after %d failures",
+                monitor->host_count, monitor->config.max_concurrency,
+                monitor->config.probe_timeout_ms, monitor->config.max_failed_attempts);
+    monitor_log("  Mount timeout: %ds (%d per share), stale mount timeout: %dms%s%s",
+                monitor->config.mount_timeout, monitor->config.mount_timeout_count,
+                monitor->config.stale_mount_timeout_ms,
+                monitor->config.unmount_on_leave ? ", unmount on leave" : "",
+                monitor->config.lean_memory ? ", lean memory" : "");
+
+    g_string_free(networks, TRUE);
+    g_string_free(devices, TRUE);
+}
+
+// Points each share at its learned history; the file is only read once
+// adaptive_schedule is first turned on
+static void attach_history(Monitor *monitor) {
+    bool adaptive = monitor->config.adaptive_schedule;
+    if (adaptive && !monitor->history.devices) {
+        schedule_history_load(&monitor->history, monitor->history_path);
+    }
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        monitor->devices[i].history = adaptive
+            ? schedule_history_get(&monitor->history, monitor->config.devices[i].spec)
+            : NULL;
+    }
+}
+
+// What lean_memory keeps in the heap: the per-share state, its probe and
+// a few KiB for names, jobs and replies, so a cycle's allocations come out
+// of memory that is already there
+static size_t lean_reserve(const MonitorConfig *config) {
+    size_t per_device = sizeof(DeviceState) + sizeof(HostGroup) + sizeof(ProbeHost) + 4096;
+    return LEAN_RESERVE_BASE + (size_t)config->device_count * per_device;
+}
+
+static bool load_config(Monitor *monitor) {
+    if (!read_config(monitor, &monitor->config)) {
+        return false;
+    }
+
+    monitor_log_set_max_size(monitor->config.max_log_size * 1024L);
+    monitor->devices = g_new0(DeviceState, monitor->config.device_count);
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        init_device_state(&monitor->devices[i]);
+    }
+    group_devices_by_host(monitor);
+    profile_index_build(&monitor->profiles, &monitor->config);
+    attach_history(monitor);
+
+    log_config(monitor);
+    return true;
+}
+
+static void send_notification(Monitor *monitor, const char *summary, const char *body) {
+    if (!monitor->config.enable_notifications || !monitor->session_bus) {
+        return;
+    }
+
+    // Fire-and-forget call to the desktop notification daemon
+    g_dbus_connection_call(monitor->session_bus,
+                           "org.freedesktop.Notifications",
+                           "/org/freedesktop/Notifications",
+                           "org.freedesktop.Notifications", "Notify",
+                           g_variant_new("(susssasa{sv}i)", "NAS Monitor", 0,
+                                         "network-server", summary, body,
+                                         NULL, NULL, -1),
+                           NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+static gint64 monotonic_seconds(void) {
+    return g_get_monotonic_time() / G_USEC_PER_SEC;
+}
+
+static void reset_backoff(DeviceState *state) {
+    state->failed_attempts = 0;
+    state->host_down = false;
+    state->retry_after = 0;
+}
+
+// Shares the profile does not list are left alone on its network
+static void apply_profile(Monitor *monitor, const NetworkProfile *profile) {
+    monitor->profile = profile;
+    monitor->is_home_network = profile != NULL;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        monitor->devices[i].off_profile =
+            profile && !profile_includes_device(profile, monitor->config.devices[i].spec);
+    }
+}
+
+// Names a home network in the address file; NULL when away
+static char *profile_address_key(const NetworkProfile *profile) {
+    if (!profile) {
+        return NULL;
+    }
+    return profile->name ? g_strdup_printf("profile:%s", profile->name)
+                         : g_strdup_printf("ssid:%s", profile->ssid);
+}
+
+static void update_state(Monitor *monitor) {
+    NetworkIdentity network;
+    network_identify(monitor->system_bus, monitor->profiles.details, &network);
+    const NetworkProfile *profile = profile_index_match(&monitor->profiles, &network);
+
+    // A different network means different reachability and possibly other
+    // addresses; retry everything. Roaming between access points of the
+    // same profile is not a change.
+    bool first = !monitor->network.ssid;
+    bool changed = !first &&
+        (strcmp(network.ssid, monitor->network.ssid) != 0 || profile != monitor->profile);
+    if (first || changed) {
+        char *key = profile_address_key(profile);
+        resolve_cache_flush(&monitor->resolve, key,
+                            monotonic_seconds() + monitor->config.dns_cache_ttl);
+        g_free(key);
+    }
+    if (changed) {
+        for (int i = 0; i < monitor->config.device_count; i++) {
+            reset_backoff(&monitor->devices[i]);
+            if (monitor->devices[i].history) {
+                schedule_forget_state(monitor->devices[i].history);
+            }
+        }
+    }
+    // Leaving home, or for a profile that lists fewer shares
+    if (monitor->is_home_network && profile != monitor->profile) {
+        monitor->left_network = true;
+    }
+    network_identity_clear(&monitor->network);
+    monitor->network = network;
+    apply_profile(monitor, profile);
+
+    // Not watched from the main loop (--once, polling mode): drain the
+    // uevents that queued up since the last cycle
+    if (!monitor->power_source && monitor->power.uevent_fd >= 0) {
+        power_monitor_handle_uevent(&monitor->power);
+    }
+    const PowerStatus *power = power_monitor_get(&monitor->power);
+    monitor->on_ac_power = power->on_ac;
+    monitor->battery_level = power->battery_level;
+}
+
+static int determine_check_interval(const Monitor *monitor) {
+    const MonitorConfig *config = &monitor->config;
+    int base_interval;
+
+    if (monitor->is_home_network) {
+        const NetworkProfile *profile = monitor->profile;
+        int ac = profile->home_ac_interval ? profile->home_ac_interval
+                                           : config->home_ac_interval;
+        int battery = profile->home_battery_interval ? profile->home_battery_interval
+                                                     : config->home_battery_interval;
+        base_interval = monitor->on_ac_power ? ac : battery;
+    } else {
+        base_interval = monitor->on_ac_power ? config->away_ac_interval
+                                             : config->away_battery_interval;
+    }
+
+    // Adjust interval based on battery level
+    if (!monitor->on_ac_power) {
+        if (monitor->battery_level < 20) {
+            base_interval *= 2;
+        }
+        if (monitor->battery_level < config->min_battery_level) {
+            base_interval *= 4;
+        }
+    }
+
+    return base_interval;
+}
+
+typedef enum {
+    JOB_PROBE,      /* one batch probing every host in probe_hosts */
+    JOB_MOUNT,      /* index is a device */
+    JOB_CHECK,      /* index is a mounted device, mount its GMount */
+    JOB_UNMOUNT     /* likewise */
+} JobKind;
+
+typedef struct {
+    int count;
+    int *hosts;             /* indices into monitor->hosts */
+    ProbeHost *probes;      /* names borrowed from the host groups */
+    int timeout_ms;
+    GDBusConnection *shared;    /* to ask nas-probed on, or NULL */
+    bool from_service;      /* nas-probed answered; its addresses are its own */
+    GError *shared_error;   /* why it did not, logged from the main loop */
+} ProbeBatch;
+
+typedef struct {
+    Monitor *monitor;
+    JobKind kind;
+    int index;
+    ProbeBatch *batch;
+    GMount *mount;          /* referenced; JOB_CHECK and JOB_UNMOUNT */
+    gint64 started;         /* monotonic microseconds */
+} Job;
+
+// Counts a failure and, once max_failed_attempts is reached, holds the
+// device back for the cycle interval doubled per further failure.
+// Failures while the network comes back after resume say nothing about the
+// share and are not counted.
+static void record_failure(Monitor *monitor, int index, bool host_down) {
+    DeviceState *state = &monitor->devices[index];
+    if (monitor->resume_until) {
+        return;
+    }
+    int excess = ++state->failed_attempts - monitor->config.max_failed_attempts;
+    state->host_down = host_down;
+
+    if (excess < 0) {
+        return;
+    }
+
+    int delay = monitor->interval;
+    for (int i = 0; i <= excess && delay < MAX_BACKOFF; i++) {
+        delay *= 2;
+    }
+    delay = MIN(delay, MAX_BACKOFF);
+    state->retry_after = monotonic_seconds() + delay;
+    monitor_log("Backing off %s for %ds after %d failures",
+                monitor->config.devices[index].spec, delay, state->failed_attempts);
+}
+
+static void push_job(Monitor *monitor, JobKind kind, int index, ProbeBatch *batch) {
+    Job *job = g_new0(Job, 1);
+    job->monitor = monitor;
+    job->kind = kind;
+    job->index = index;
+    job->batch = batch;
+    work_queue_push(monitor->queue, job);
+}
+
+static void push_mount_job(Monitor *monitor, JobKind kind, int index, GMount *mount) {
+    Job *job = g_new0(Job, 1);
+    job->monitor = monitor;
+    job->kind = kind;
+    job->index = index;
+    job->mount = g_object_ref(mount);
+    work_queue_push(monitor->queue, job);
+}
+
+static ProbeBatch *probe_batch_new(int capacity, int timeout_ms) {
+    ProbeBatch *batch = g_new0(ProbeBatch, 1);
+    batch->hosts = g_new0(int, capacity);
+    batch->probes = g_new0(ProbeHost, capacity);
+    batch->timeout_ms = timeout_ms;
+    return batch;
+}
+
+static void probe_batch_free(ProbeBatch *batch) {
+    g_clear_object(&batch->shared);
+    g_clear_error(&batch->shared_error);
+    g_free(batch->hosts);
+    g_free(batch->probes);
+    g_free(batch);
+}
+
+// All hosts in one poll set, off the main loop since waiting on lookups blocks
+static void probe_thread(GTask *task, gpointer source G_GNUC_UNUSED,
+                         gpointer task_data, GCancellable *cancellable G_GNUC_UNUSED) {
+    ProbeBatch *batch = task_data;
+    batch->from_service = batch->shared &&
+        shared_probe_run(batch->shared, batch->probes, batch->count, batch->timeout_ms,
+                         &batch->shared_error);
+    if (!batch->from_service) {
+        probe_hosts_reachable(batch->probes, batch->count, batch->timeout_ms);
+    }
+    g_task_return_boolean(task, TRUE);
+}
+
+// Into the share's histogram, and onto its track of the trace
+static void record_phase(Monitor *monitor, int index, Phase phase, gint64 start_us,
+                         gint64 duration_us, bool failed) {
+    histogram_record(&monitor->devices[index].phases[phase], duration_us);
+    trace_record(&monitor->trace, phase_names[phase], index + 1, start_us, duration_us, failed);
+}
+
+static void handle_probe_result(Monitor *monitor, int host_index, const ProbeHost *probe) {
+    const HostGroup *host = &monitor->hosts[host_index];
+    const ProbeTiming *timing = &probe->timing;
+    bool reachable = probe->reachable;
+
+    for (int i = 0; i < host->device_count; i++) {
+        int index = host->devices[i];
+        DeviceState *state = &monitor->devices[index];
+        if (!state->needs_mount) {
+            continue;
+        }
+
+        state->probes++;
+        state->last_probe_us = timing->total_us;
+        // A cache hit has no lookup to time
+        if (probe->looked_up) {
+            record_phase(monitor, index, PHASE_RESOLVE, timing->started_us, timing->resolve_us,
+                         probe->addresses.count == 0);
+        }
+        if (probe->addresses.count > 0) {
+            record_phase(monitor, index, PHASE_CONNECT, timing->started_us + timing->resolve_us,
+                         timing->total_us - timing->resolve_us, !reachable);
+        }
+        state->checked = true;
+        state->reachable = reachable;
+        if (!reachable) {
+            state->probe_failures++;
+        }
+
+        if (reachable) {
+            // Host is back: close the breaker opened while it was down
+            if (state->host_down) {
+                reset_backoff(state);
+            }
+            push_job(monitor, JOB_MOUNT, index, NULL);
+        } else {
+            monitor_log("Cannot reach %s for %s (attempt %d)", host->name,
+                        monitor->config.devices[index].spec, state->failed_attempts + 1);
+            record_failure(monitor, index, true);
+        }
+    }
+}
+
+static void on_probe_done(GObject *source G_GNUC_UNUSED, GAsyncResult *result,
+                          gpointer user_data) {
+    Job *job = user_data;
+    Monitor *monitor = job->monitor;
+    ProbeBatch *batch = g_task_get_task_data(G_TASK(result));
+
+    if (batch->shared_error) {
+        monitor_log("WARNING: Shared probe failed, probed directly: %s",
+                    batch->shared_error->message);
+    }
+    gint64 expires = monotonic_seconds() + monitor->config.dns_cache_ttl;
+    char *network = profile_address_key(monitor->profile);
+    for (int i = 0; i < batch->count; i++) {
+        const ProbeHost *probe = &batch->probes[i];
+        // Addresses nas-probed looked up stay with it
+        if (probe->looked_up && !batch->from_service) {
+            resolve_cache_store(&monitor->resolve, probe->name, &probe->addresses, expires);
+        }
+        if (network && probe->answered >= 0 && !batch->from_service) {
+            resolve_cache_remember(&monitor->resolve, network, probe->name,
+                                   &probe->addresses.address[probe->answered]);
+        }
+        handle_probe_result(monitor, batch->hosts[i], probe);
+    }
+    g_free(network);
+
+    g_free(job);
+    work_queue_done(monitor->queue);
+}
+
+static void on_mount_done(bool success, gpointer user_data) {
+    Job *job = user_data;
+    Monitor *monitor = job->monitor;
+    const NasDevice *device = &monitor->config.devices[job->index];
+    DeviceState *state = &monitor->devices[job->index];
+
+    state->mounts++;
+    state->last_mount_us = (long)(g_get_monotonic_time() - job->started);
+    state->mounted = success;
+    record_phase(monitor, job->index, PHASE_MOUNT, job->started, state->last_mount_us, !success);
+
+    if (success) {
+        monitor_log("Successfully mounted %s", device->spec);
+        char *body = g_strdup_printf("%s is now available", device->spec);
+        send_notification(monitor, "NAS Connected", body);
+        g_free(body);
+        reset_backoff(state);
+    } else {
+        monitor_log("Failed to mount %s (attempt %d)", device->spec, state->failed_attempts + 1);
+        state->mount_failures++;
+        record_failure(monitor, job->index, false);
+
+        // Notify on first failure
+        if (state->failed_attempts == 1) {
+            char *body = g_strdup_printf("Cannot connect to %s", device->spec);
+            send_notification(monitor, "NAS Mount Failed", body);
+            g_free(body);
+        }
+    }
+
+    g_free(job);
+    work_queue_done(monitor->queue);
+}
+
+static void free_mount_job(Job *job) {
+    WorkQueue *queue = job->monitor->queue;
+    g_object_unref(job->mount);
+    g_free(job);
+    work_queue_done(queue);
+}
+
+// A share still wanted here is remounted by the next cycle, once its host
+// answers a probe; the rest only needed to go away.
+static void on_unmount_done(bool success, gpointer user_data) {
+    Job *job = user_data;
+    Monitor *monitor = job->monitor;
+    const NasDevice *device = &monitor->config.devices[job->index];
+    DeviceState *state = &monitor->devices[job->index];
+    bool wanted = monitor->is_home_network && !state->off_profile && !state->held;
+
+    trace_record(&monitor->trace, "unmount", job->index + 1, job->started,
+                 g_get_monotonic_time() - job->started, !success);
+    if (success) {
+        monitor_log("Unmounted %s%s", device->spec,
+                    monitor->suspending ? " for suspend"
+                    : state->held ? " on request"
+                    : wanted ? "" : " (not used on this network)");
+        state->mounted = false;
+        monitor->cycle_requested |= wanted && !monitor->suspending;
+    } else {
+        monitor_log("WARNING: Cannot unmount %s", device->spec);
+    }
+    free_mount_job(job);
+}
+
+static void on_check_done(bool responding, gpointer user_data) {
+    Job *job = user_data;
+    Monitor *monitor = job->monitor;
+    DeviceState *state = &monitor->devices[job->index];
+
+    record_phase(monitor, job->index, PHASE_CHECK, job->started,
+                 g_get_monotonic_time() - job->started, !responding);
+    if (!responding) {
+        monitor_log("%s did not answer within %dms; detaching the stale mount",
+                    monitor->config.devices[job->index].spec,
+                    monitor->config.stale_mount_timeout_ms);
+        state->stale_mounts++;
+        state->reachable = false;
+        push_mount_job(monitor, JOB_UNMOUNT, job->index, job->mount);
+    }
+    free_mount_job(job);
+}
+
+static void start_job(WorkQueue *queue G_GNUC_UNUSED, gpointer item,
+                      gpointer user_data G_GNUC_UNUSED) {
+    Job *job = item;
+    Monitor *monitor = job->monitor;
+
+    job->started = g_get_monotonic_time();
+    switch (job->kind) {
+    case JOB_PROBE: {
+        GTask *task = g_task_new(NULL, NULL, on_probe_done, job);
+        g_task_set_task_data(task, job->batch, (GDestroyNotify)probe_batch_free);
+        g_task_run_in_thread(task, probe_thread);
+        g_object_unref(task);
+        break;
+    }
+    case JOB_MOUNT: {
+        const NasDevice *device = &monitor->config.devices[job->index];
+        mount_device_async(device, config_mount_timeout(&monitor->config, device),
+                           on_mount_done, job);
+        break;
+    }
+    case JOB_CHECK:
+        mount_check_async(job->mount, monitor->config.stale_mount_timeout_ms,
+                          on_check_done, job);
+        break;
+    case JOB_UNMOUNT:
+        mount_unmount_async(job->mount,
+                            monitor->suspending ? SUSPEND_UNMOUNT_MS : UNMOUNT_TIMEOUT_MS,
+                            on_unmount_done, job);
+        break;
+    }
+}
+
+// After leaving a network, unmounts the shares that were on it: left mounted,
+// anything that touches them (a file manager, the indexer) blocks for the
+// whole SMB timeout. Returns false if nothing was queued.
+static bool detach_departed_shares(Monitor *monitor) {
+    if (!monitor->left_network) {
+        return false;
+    }
+    monitor->left_network = false;
+    if (!monitor->config.unmount_on_leave) {
+        return false;
+    }
+
+    const MountTable *mounted = monitor->mounts.table;
+    bool queued = false;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        DeviceState *state = &monitor->devices[i];
+        GMount *mount = mount_table_lookup(mounted, &monitor->config.devices[i]);
+        state->mounted = mount != NULL;
+        if (mount && (!monitor->is_home_network || state->off_profile)) {
+            push_mount_job(monitor, JOB_UNMOUNT, i, mount);
+            state->detach_requested = false;
+            queued = true;
+        }
+    }
+    return queued;
+}
+
+// Shares unmounted through the control socket (nas-monitorctl unmount).
+// Returns false if nothing was queued.
+static bool detach_held_shares(Monitor *monitor) {
+    const MountTable *mounted = monitor->mounts.table;
+    bool queued = false;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        DeviceState *state = &monitor->devices[i];
+        if (!state->detach_requested) {
+            continue;
+        }
+        state->detach_requested = false;
+        GMount *mount = mount_table_lookup(mounted, &monitor->config.devices[i]);
+        state->mounted = mount != NULL;
+        if (mount) {
+            push_mount_job(monitor, JOB_UNMOUNT, i, mount);
+            queued = true;
+        }
+    }
+    return queued;
+}
+
+// Before suspend: the SMB sessions do not survive it, and a mount left
+// behind hangs whatever touches it after resume. Returns false if nothing
+// was mounted.
+static bool detach_for_suspend(Monitor *monitor) {
+    const MountTable *mounted = monitor->mounts.table;
+    bool queued = false;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        GMount *mount = mount_table_lookup(mounted, &monitor->config.devices[i]);
+        monitor->devices[i].mounted = mount != NULL;
+        if (mount) {
+            push_mount_job(monitor, JOB_UNMOUNT, i, mount);
+            queued = true;
+        }
+    }
+    return queued;
+}
+
+// A share was mounted or unmounted (by us, by hand, or gvfs dropped it);
+// this keeps the status reply current, the next cycle does the rest
+static void on_mounts_changed(gpointer user_data) {
+    Monitor *monitor = user_data;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        monitor->devices[i].mounted =
+            mount_table_contains(monitor->mounts.table, &monitor->config.devices[i]);
+    }
+}
+
+// Queues one probe batch covering every host with at least one unmounted
+// device, and a check of each mounted one. Returns false if there is
+// nothing to do this cycle.
+static bool check_and_mount_nas(Monitor *monitor) {
+    const MonitorConfig *config = &monitor->config;
+
+    // Only attempt mounting on home network
+    if (!monitor->is_home_network) {
+        return false;
+    }
+
+    // Skip on very low battery
+    if (!monitor->on_ac_power && monitor->battery_level < config->min_battery_level) {
+        monitor_log("Skipping mount attempts - critical battery level (%d%%)",
+                    monitor->battery_level);
+        return false;
+    }
+
+    // Kept current by the volume monitor's signals; exact lookups
+    const MountTable *mounted = monitor->mounts.table;
+    gint64 now = monotonic_seconds();
+    int eligible = 0;
+    int backing_off = 0;
+    int checks = 0;
+    ProbeBatch *batch = probe_batch_new(monitor->host_count, config->probe_timeout_ms);
+
+    for (int h = 0; h < monitor->host_count; h++) {
+        const HostGroup *host = &monitor->hosts[h];
+        bool host_needed = false;
+
+        for (int i = 0; i < host->device_count; i++) {
+            int index = host->devices[i];
+            DeviceState *state = &monitor->devices[index];
+
+            GMount *mount = mount_table_lookup(mounted, &config->devices[index]);
+            state->mounted = mount != NULL;
+            if (state->off_profile || state->held) {
+                state->needs_mount = false;
+                continue;
+            }
+            eligible++;
+            state->needs_mount = !state->mounted;
+            state->checked = state->reachable = state->mounted;
+            if (!state->needs_mount) {
+                reset_backoff(state);
+                push_mount_job(monitor, JOB_CHECK, index, mount);
+                checks++;
+            } else if (state->retry_after > now) {
+                // Known to be failing; leave it alone until the backoff expires
+                state->needs_mount = false;
+                if (!backing_off++ || state->retry_after < monitor->next_retry) {
+                    monitor->next_retry = state->retry_after;
+                }
+            }
+            host_needed |= state->needs_mount;
+        }
+
+        if (host_needed) {
+            ProbeHost *probe = &batch->probes[batch->count];
+            batch->hosts[batch->count] = h;
+            probe->name = host->name;
+            resolve_cache_lookup(&monitor->resolve, host->name, now, &probe->addresses);
+            batch->count++;
+        }
+    }
+
+    bool queued = batch->count > 0;
+    if (queued && config->shared_probe && monitor->shared.available) {
+        batch->shared = g_object_ref(monitor->shared.bus);
+    }
+    if (queued) {
+        push_job(monitor, JOB_PROBE, 0, batch);
+    } else {
+        probe_batch_free(batch);
+    }
+    queued |= checks > 0;
+
+    // Only worth sleeping past the interval when nothing else needs watching
+    if (backing_off < eligible) {
+        monitor->next_retry = 0;
+    }
+    return queued;
+}
+
+// The per-share phases summed over all shares, then the cycle-wide ones
+typedef struct {
+    const char *name;
+    Histogram histogram;
+} PhaseSummary;
+
+#define SUMMARY_COUNT (PHASE_COUNT + 1)
+
+static void summarize_phases(const Monitor *monitor, PhaseSummary *summary) {
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        summary[p].name = phase_names[p];
+        memset(&summary[p].histogram, 0, sizeof(Histogram));
+        for (int i = 0; i < monitor->config.device_count; i++) {
+            histogram_merge(&summary[p].histogram, &monitor->devices[i].phases[p]);
+        }
+    }
+    summary[PHASE_COUNT] = (PhaseSummary){ "cycle", monitor->cycle_time };
+}
+
+static void log_phase_latency(const Monitor *monitor) {
+    PhaseSummary summary[SUMMARY_COUNT];
+    summarize_phases(monitor, summary);
+
+    GString *line = g_string_new(NULL);
+    for (int p = 0; p < SUMMARY_COUNT; p++) {
+        const Histogram *histogram = &summary[p].histogram;
+        if (!histogram->total) {
+            continue;
+        }
+        g_string_append_printf(line, "%s%s %.1f/%.1f/%.1f (%" G_GUINT64_FORMAT ")",
+                               line->len ? ", " : "", summary[p].name,
+                               histogram_percentile(histogram, 50) / 1000.0,
+                               histogram_percentile(histogram, 99) / 1000.0,
+                               histogram->max_us / 1000.0, histogram->total);
+    }
+    if (line->len) {
+        monitor_log("Latency p50/p99/max ms (count): %s", line->str);
+    }
+    g_string_free(line, TRUE);
+}
+
+static void log_periodic_status(Monitor *monitor, int interval) {
+    time_t now = time(NULL);
+
+    // Log status every hour
+    if (now - monitor->last_status_log <= STATUS_LOG_INTERVAL) {
+        return;
+    }
+
+    char power_status[32];
+    if (monitor->on_ac_power) {
+        snprintf(power_status, sizeof(power_status), "AC Power");
+    } else {
+        snprintf(power_status, sizeof(power_status), "Battery(%d%%)",
+                 monitor->battery_level);
+    }
+
+    if (monitor->profile && monitor->profile->name) {
+        monitor_log("Status: Home(%s, profile %s), %s, Check interval: %ds",
+                    monitor->network.ssid, monitor->profile->name, power_status, interval);
+    } else if (monitor->is_home_network) {
+        monitor_log("Status: Home(%s), %s, Check interval: %ds",
+                    monitor->network.ssid, power_status, interval);
+    } else {
+        monitor_log("Status: Away, %s, Check interval: %ds", power_status, interval);
+    }
+    log_phase_latency(monitor);
+
+    monitor->last_status_log = now;
+}
+
+static void json_append_string(GString *out, const char *value) {
+    g_string_append_c(out, '"');
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            g_string_append_printf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            g_string_append_printf(out, "\\u%04x", *p);
+        } else {
+            g_string_append_c(out, *p);
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+static void json_append_latency(GString *out, const char *key, long latency_us) {
+    if (latency_us < 0) {
+        g_string_append_printf(out, ", \"%s\": null", key);
+    } else {
+        g_string_append_printf(out, ", \"%s\": %.3f", key, latency_us / 1000.0);
+    }
+}
+
+static void json_append_histogram(GString *out, const char *key, const Histogram *histogram) {
+    g_string_append_printf(out, "\"%s\": {\"count\": %" G_GUINT64_FORMAT, key, histogram->total);
+    if (histogram->total) {
+        g_string_append_printf(out, ", \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+                               "\"max_ms\": %.3f",
+                               histogram_percentile(histogram, 50) / 1000.0,
+                               histogram_percentile(histogram, 90) / 1000.0,
+                               histogram_percentile(histogram, 99) / 1000.0,
+                               histogram->max_us / 1000.0);
+    }
+    g_string_append_c(out, '}');
+}
+
+static long retry_in(const DeviceState *state, gint64 now) {
+    return state->retry_after > now ? (long)(state->retry_after - now) : 0;
+}
+
+static char *format_status_json(const Monitor *monitor) {
+    GString *out = g_string_new("{\"version\": ");
+    json_append_string(out, VERSION);
+    g_string_append(out, ", \"network\": ");
+    json_append_string(out, monitor->network.ssid ? monitor->network.ssid : "");
+    // Names and UUIDs, as a profile's connection= key can use either
+    g_string_append(out, ", \"connections\": [");
+    for (guint i = 0; monitor->network.connections && i < monitor->network.connections->len; i++) {
+        if (i) g_string_append(out, ", ");
+        json_append_string(out, g_ptr_array_index(monitor->network.connections, i));
+    }
+    g_string_append(out, "], \"profile\": ");
+    if (monitor->profile && monitor->profile->name) {
+        json_append_string(out, monitor->profile->name);
+    } else {
+        g_string_append(out, "null");
+    }
+    g_string_append_printf(out, ", \"home_network\": %s, \"on_ac_power\": %s, "
+                           "\"battery_level\": %d, \"check_interval\": %d, "
+                           "\"next_interval\": %d, "
+                           "\"cycle_running\": %s, \"cycles\": %u",
+                           monitor->is_home_network ? "true" : "false",
+                           monitor->on_ac_power ? "true" : "false",
+                           monitor->battery_level, monitor->interval, monitor->next_interval,
+                           monitor->cycle_running ? "true" : "false", monitor->cycles);
+    g_string_append(out, ", \"phases\": {");
+    json_append_histogram(out, "cycle", &monitor->cycle_time);
+    g_string_append_printf(out, "}, \"resolve_cache\": {\"hosts\": %u, \"hits\": %u, "
+                           "\"lookups\": %u}",
+                           resolve_cache_size(&monitor->resolve), monitor->resolve.hits,
+                           monitor->resolve.lookups);
+    g_string_append_printf(out, ", \"shared_probe\": %s",
+                           monitor->config.shared_probe && monitor->shared.available
+                               ? "true" : "false");
+    MemoryUsage memory;
+    memory_usage(&memory);
+    g_string_append_printf(out, ", \"memory\": {\"lean\": %s, \"rss_kb\": %ld, "
+                           "\"peak_rss_kb\": %ld, \"heap_bytes\": %zu, "
+                           "\"heap_free_bytes\": %zu, \"mapped_bytes\": %zu, "
+                           "\"mapped_blocks\": %zu}, \"devices\": [",
+                           memory.lean ? "true" : "false", memory.rss_kb, memory.peak_rss_kb,
+                           memory.heap_bytes, memory.heap_free_bytes, memory.mapped_bytes,
+                           memory.mapped_blocks);
+
+    gint64 now = monotonic_seconds();
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        const NasDevice *device = &monitor->config.devices[i];
+        const DeviceState *state = &monitor->devices[i];
+
+        g_string_append(out, i ? ", {\"device\": " : "{\"device\": ");
+        json_append_string(out, device->spec);
+        g_string_append_printf(out, ", \"mounted\": %s, \"held\": %s, \"failed_attempts\": %d, "
+                               "\"retry_in\": %ld, \"probes\": %u, \"probe_failures\": %u, "
+                               "\"mounts\": %u, \"mount_failures\": %u, \"stale_mounts\": %u",
+                               state->mounted ? "true" : "false",
+                               state->held ? "true" : "false", state->failed_attempts,
+                               retry_in(state, now), state->probes, state->probe_failures,
+                               state->mounts, state->mount_failures, state->stale_mounts);
+        json_append_latency(out, "last_probe_ms", state->last_probe_us);
+        json_append_latency(out, "last_mount_ms", state->last_mount_us);
+        g_string_append(out, ", \"phases\": {");
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            if (p) g_string_append(out, ", ");
+            json_append_histogram(out, phase_names[p], &state->phases[p]);
+        }
+        g_string_append(out, "}}");
+    }
+
+    g_string_append(out, "]}\n");
+    return g_string_free(out, FALSE);
+}
+
+// Prometheus label values escape backslash, quote and newline
+static char *label_value(const char *value) {
+    GString *out = g_string_new(NULL);
+    for (const char *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"') {
+            g_string_append_c(out, '\\');
+            g_string_append_c(out, *p);
+        } else if (*p == '\n') {
+            g_string_append(out, "\\n");
+        } else {
+            g_string_append_c(out, *p);
+        }
+    }
+    return g_string_free(out, FALSE);
+}
+
+static void metric_header(GString *out, const char *name, const char *type, const char *help) {
+    g_string_append_printf(out, "# HELP nas_monitor_%s %s\n# TYPE nas_monitor_%s %s\n",
+                           name, help, name, type);
+}
+
+typedef enum {
+    DEVICE_MOUNTED,
+    DEVICE_FAILED_ATTEMPTS,
+    DEVICE_RETRY_IN,
+    DEVICE_PROBES,
+    DEVICE_PROBE_FAILURES,
+    DEVICE_MOUNTS,
+    DEVICE_MOUNT_FAILURES,
+    DEVICE_STALE_MOUNTS,
+    DEVICE_LAST_PROBE,
+    DEVICE_LAST_MOUNT
+} DeviceMetric;
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} device_metrics[] = {
+    [DEVICE_MOUNTED] = { "device_mounted", "gauge", "Share was mounted at the last check" },
+    [DEVICE_FAILED_ATTEMPTS] = { "device_failed_attempts", "gauge", "Consecutive probe or mount failures" },
+    [DEVICE_RETRY_IN] = { "device_backoff_seconds", "gauge", "Seconds until a backed-off share is retried" },
+    [DEVICE_PROBES] = { "device_probes_total", "counter", "Reachability probes of the share's host" },
+    [DEVICE_PROBE_FAILURES] = { "device_probe_failures_total", "counter", "Probes that found the host unreachable" },
+    [DEVICE_MOUNTS] = { "device_mounts_total", "counter", "Mount attempts" },
+    [DEVICE_MOUNT_FAILURES] = { "device_mount_failures_total", "counter", "Failed mount attempts" },
+    [DEVICE_STALE_MOUNTS] = { "device_stale_mounts_total", "counter", "Mounts detached for not answering" },
+    [DEVICE_LAST_PROBE] = { "device_last_probe_seconds", "gauge", "Duration of the last reachability probe" },
+    [DEVICE_LAST_MOUNT] = { "device_last_mount_seconds", "gauge", "Duration of the last mount attempt" },
+};
+
+static char *format_metrics(const Monitor *monitor) {
+    GString *out = g_string_new(NULL);
+
+    metric_header(out, "home_network", "gauge", "Connected to a configured home network");
+    g_string_append_printf(out, "nas_monitor_home_network %d\n", monitor->is_home_network);
+    metric_header(out, "on_ac_power", "gauge", "Running on AC power");
+    g_string_append_printf(out, "nas_monitor_on_ac_power %d\n", monitor->on_ac_power);
+    metric_header(out, "battery_level_percent", "gauge", "Battery charge");
+    g_string_append_printf(out, "nas_monitor_battery_level_percent %d\n", monitor->battery_level);
+    metric_header(out, "check_interval_seconds", "gauge", "Current check interval");
+    g_string_append_printf(out, "nas_monitor_check_interval_seconds %d\n", monitor->interval);
+    metric_header(out, "next_interval_seconds", "gauge", "Sleep before the next poll");
+    g_string_append_printf(out, "nas_monitor_next_interval_seconds %d\n", monitor->next_interval);
+    metric_header(out, "cycles_total", "counter", "Check cycles run");
+    g_string_append_printf(out, "nas_monitor_cycles_total %u\n", monitor->cycles);
+
+    MemoryUsage memory;
+    memory_usage(&memory);
+    metric_header(out, "resident_memory_bytes", "gauge", "Resident set size");
+    g_string_append_printf(out, "nas_monitor_resident_memory_bytes %ld\n", memory.rss_kb * 1024);
+    metric_header(out, "resident_memory_peak_bytes", "gauge", "Largest resident set size since start");
+    g_string_append_printf(out, "nas_monitor_resident_memory_peak_bytes %ld\n",
+                           memory.peak_rss_kb * 1024);
+    metric_header(out, "heap_bytes", "gauge", "malloc heap by state");
+    g_string_append_printf(out, "nas_monitor_heap_bytes{state=\"in_use\"} %zu\n"
+                           "nas_monitor_heap_bytes{state=\"free\"} %zu\n"
+                           "nas_monitor_heap_bytes{state=\"mapped\"} %zu\n",
+                           memory.heap_bytes, memory.heap_free_bytes, memory.mapped_bytes);
+    metric_header(out, "heap_mapped_blocks", "gauge", "Large allocations mapped on their own");
+    g_string_append_printf(out, "nas_monitor_heap_mapped_blocks %zu\n", memory.mapped_blocks);
+
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    PhaseSummary summary[SUMMARY_COUNT];
+    summarize_phases(monitor, summary);
+    metric_header(out, "phase_seconds", "summary", "Duration of each phase of a check, over all shares");
+    for (int p = 0; p < SUMMARY_COUNT; p++) {
+        const Histogram *histogram = &summary[p].histogram;
+        for (size_t q = 0; q < G_N_ELEMENTS(quantiles); q++) {
+            g_string_append_printf(out, "nas_monitor_phase_seconds{phase=\"%s\",quantile=\"%g\"} %g\n",
+                                   summary[p].name, quantiles[q],
+                                   histogram_percentile(histogram, quantiles[q] * 100) / 1e6);
+        }
+        g_string_append_printf(out, "nas_monitor_phase_seconds_sum{phase=\"%s\"} %g\n",
+                               summary[p].name, histogram->sum_us / 1e6);
+        g_string_append_printf(out, "nas_monitor_phase_seconds_count{phase=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                               summary[p].name, histogram->total);
+    }
+
+    gint64 now = monotonic_seconds();
+    for (size_t m = 0; m < G_N_ELEMENTS(device_metrics); m++) {
+        metric_header(out, device_metrics[m].name, device_metrics[m].type, device_metrics[m].help);
+
+        for (int i = 0; i < monitor->config.device_count; i++) {
+            const DeviceState *state = &monitor->devices[i];
+            double value;
+
+            switch ((DeviceMetric)m) {
+            case DEVICE_MOUNTED: value = state->mounted; break;
+            case DEVICE_FAILED_ATTEMPTS: value = state->failed_attempts; break;
+            case DEVICE_RETRY_IN: value = retry_in(state, now); break;
+            case DEVICE_PROBES: value = state->probes; break;
+            case DEVICE_PROBE_FAILURES: value = state->probe_failures; break;
+            case DEVICE_MOUNTS: value = state->mounts; break;
+            case DEVICE_MOUNT_FAILURES: value = state->mount_failures; break;
+            case DEVICE_STALE_MOUNTS: value = state->stale_mounts; break;
+            case DEVICE_LAST_PROBE:
+                if (state->last_probe_us < 0) continue;
+                value = state->last_probe_us / 1e6;
+                break;
+            case DEVICE_LAST_MOUNT:
+                if (state->last_mount_us < 0) continue;
+                value = state->last_mount_us / 1e6;
+                break;
+            default: continue;
+            }
+
+            char *device = label_value(monitor->config.devices[i].spec);
+            g_string_append_printf(out, "nas_monitor_%s{device=\"%s\"} %g\n",
+                                   device_metrics[m].name, device, value);
+            g_free(device);
+        }
+    }
+
+    return g_string_free(out, FALSE);
+}
+
+// Track 0 is the cycle, track i + 1 share i
+static bool write_trace(const Monitor *monitor, GError **error) {
+    int count = monitor->config.device_count + 1;
+    const char **names = g_new(const char *, count);
+    names[0] = "cycle";
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        names[i + 1] = monitor->config.devices[i].spec;
+    }
+
+    bool ok = trace_write(&monitor->trace, monitor->trace_path, names, count, error);
+    g_free(names);
+    return ok;
+}
+
+static char *handle_trace_command(const Monitor *monitor) {
+    if (!trace_enabled(&monitor->trace)) {
+        return g_strdup("{\"error\": \"tracing is off; start nas-monitord with --trace FILE\"}\n");
+    }
+
+    GError *error = NULL;
+    GString *out = g_string_new(NULL);
+    if (write_trace(monitor, &error)) {
+        g_string_append(out, "{\"trace\": ");
+        json_append_string(out, monitor->trace_path);
+        g_string_append_printf(out, ", \"events\": %d}\n", monitor->trace.count);
+    } else {
+        g_string_append(out, "{\"error\": ");
+        json_append_string(out, error->message);
+        g_string_append(out, "}\n");
+        g_error_free(error);
+    }
+    return g_string_free(out, FALSE);
+}
+
+static void schedule_cycle(Monitor *monitor, guint delay_ms);
+static void schedule_poll(Monitor *monitor, gint64 delay_s);
+static bool reload_config(Monitor *monitor);
+static void schedule_reload(Monitor *monitor);
+
+static void json_append_list(GString *out, const char *name, const GPtrArray *items) {
+    g_string_append_printf(out, "\"%s\": [", name);
+    for (guint i = 0; i < items->len; i++) {
+        if (i) g_string_append(out, ", ");
+        json_append_string(out, g_ptr_array_index(items, i));
+    }
+    g_string_append_c(out, ']');
+}
+
+// Shares named by spec, or every share when none is named. Changes nothing
+// if any of them is not configured. Unmounted shares are held: cycles leave
+// them alone until they are asked for again (or the daemon restarts).
+static char *handle_mount_command(Monitor *monitor, char **specs, bool mount) {
+    const MonitorConfig *config = &monitor->config;
+    bool *selected = g_new0(bool, config->device_count);
+    GPtrArray *unknown = g_ptr_array_new();
+
+    for (char **spec = specs; *spec; spec++) {
+        int index = find_device(config, *spec);
+        if (index < 0) {
+            g_ptr_array_add(unknown, *spec);
+        } else {
+            selected[index] = true;
+        }
+    }
+
+    GString *out = g_string_new("{");
+    if (unknown->len) {
+        g_string_append(out, "\"error\": \"not in [nas_devices]\", ");
+        json_append_list(out, "devices", unknown);
+    } else {
+        GPtrArray *done = g_ptr_array_new();
+        for (int i = 0; i < config->device_count; i++) {
+            if (*specs && !selected[i]) {
+                continue;
+            }
+            DeviceState *state = &monitor->devices[i];
+            if (mount) {
+                state->held = false;
+                state->detach_requested = false;
+                reset_backoff(state);
+            } else {
+                state->held = true;
+                state->detach_requested = true;
+            }
+            g_ptr_array_add(done, config->devices[i].spec);
+        }
+        monitor_log("%s requested for %u share(s)", mount ? "Mount" : "Unmount", done->len);
+        json_append_list(out, mount ? "mount" : "unmount", done);
+        // Shares are only mounted at home; says why nothing happens away
+        g_string_append_printf(out, ", \"home_network\": %s",
+                               monitor->is_home_network ? "true" : "false");
+        g_ptr_array_free(done, TRUE);
+        schedule_cycle(monitor, 0);
+    }
+    g_string_append(out, "}\n");
+
+    g_ptr_array_free(unknown, TRUE);
+    g_free(selected);
+    return g_string_free(out, FALSE);
+}
+
+static char *handle_reload_command(Monitor *monitor) {
+    // Same rule as on_reload_idle: the cycle holds indices into the config
+    if (monitor->cycle_running) {
+        monitor->reload_pending = true;
+        return g_strdup("{\"reload\": \"pending\"}\n");
+    }
+    if (!reload_config(monitor)) {
+        return g_strdup("{\"error\": \"configuration not reloaded; see the log\"}\n");
+    }
+    return g_strdup_printf("{\"reload\": \"done\", \"devices\": %d}\n",
+                           monitor->config.device_count);
+}
+
+static bool write_device_changes(Monitor *monitor, const char *text, gsize length,
+                                 GPtrArray *add, GPtrArray *remove, GError **error) {
+    char *edited = config_edit_devices(text, length,
+                                       (const char *const *)add->pdata, (int)add->len,
+                                       (const char *const *)remove->pdata, (int)remove->len);
+    if (!edited) {
+        g_set_error_literal(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                            g_strerror(errno));
+        return false;
+    }
+    // A temp file renamed into place, like the GUI's saves: the watch sees
+    // the whole batch arrive at once
+    bool ok = g_file_set_contents_full(monitor->config_path, edited, -1,
+                                       G_FILE_SET_CONTENTS_CONSISTENT, 0600, error);
+    free(edited);
+    return ok;
+}
+
+// A batch of "+host/share" and "-host/share" entries, applied to the config
+// file in one write and so in one reload. The last entry for a share wins;
+// adding a listed share or removing an unlisted one is not an error, so a
+// provisioning script can send the same batch twice. Anything malformed
+// rejects the whole batch.
+static char *handle_devices_command(Monitor *monitor, char **entries) {
+    GString *out = g_string_new("{");
+    GError *error = NULL;
+    char *text = NULL;
+    gsize length = 0;
+
+    if (!g_file_get_contents(monitor->config_path, &text, &length, &error)) {
+        g_string_append(out, "\"error\": ");
+        json_append_string(out, error->message);
+        g_string_append(out, "}\n");
+        g_error_free(error);
+        return g_string_free(out, FALSE);
+    }
+
+    MonitorConfig config;
+    config_set_defaults(&config);
+    config_parse(&config, text, length);
+    int listed = config.device_count;
+
+    // Each share's last entry, in the order shares first appear
+    GHashTable *last = g_hash_table_new(g_str_hash, g_str_equal);
+    GPtrArray *specs = g_ptr_array_new();
+    GPtrArray *invalid = g_ptr_array_new();
+    for (char **entry = entries; *entry; entry++) {
+        char op = **entry;
+        char *spec = op ? g_strstrip(*entry + 1) : *entry;
+        if ((op != '+' && op != '-') || *spec == '\0') {
+            g_ptr_array_add(invalid, *entry);
+            continue;
+        }
+        if (!g_hash_table_contains(last, spec)) {
+            g_ptr_array_add(specs, spec);
+        }
+        g_hash_table_insert(last, spec, *entry);
+    }
+
+    GPtrArray *add = g_ptr_array_new();
+    GPtrArray *remove = g_ptr_array_new();
+    GPtrArray *unchanged = g_ptr_array_new();
+    for (guint i = 0; i < specs->len; i++) {
+        char *spec = g_ptr_array_index(specs, i);
+        const char *entry = g_hash_table_lookup(last, spec);
+        bool listed_now = find_device(&config, spec) >= 0;
+
+        if (entry[0] == '-') {
+            g_ptr_array_add(listed_now ? remove : unchanged, spec);
+        } else if (listed_now) {
+            g_ptr_array_add(unchanged, spec);
+        } else if (config_add_device(&config, spec)) {
+            g_ptr_array_add(add, spec);
+        } else {
+            g_ptr_array_add(invalid, (gpointer)entry);
+        }
+    }
+    int remaining = listed + (int)add->len - (int)remove->len;
+
+    bool changed = add->len > 0 || remove->len > 0;
+    if (invalid->len) {
+        g_string_append(out, "\"error\": \"expected +host/share or -host/share\", ");
+        json_append_list(out, "entries", invalid);
+    } else if (changed && remaining == 0) {
+        g_string_append(out, "\"error\": \"that would leave no NAS devices\"");
+    } else if (changed && !write_device_changes(monitor, text, length, add, remove, &error)) {
+        g_string_append(out, "\"error\": ");
+        json_append_string(out, error->message);
+        g_error_free(error);
+    } else {
+        if (changed) {
+            monitor_log("Devices changed on request: %u added, %u removed",
+                        add->len, remove->len);
+            // Without a watch nothing else notices the new file
+            if (!monitor->config_monitor) {
+                schedule_reload(monitor);
+            }
+        }
+        json_append_list(out, "added", add);
+        g_string_append(out, ", ");
+        json_append_list(out, "removed", remove);
+        g_string_append(out, ", ");
+        json_append_list(out, "unchanged", unchanged);
+        g_string_append_printf(out, ", \"reload\": %s", changed ? "true" : "false");
+    }
+    g_string_append(out, "}\n");
+
+    g_ptr_array_free(add, TRUE);
+    g_ptr_array_free(remove, TRUE);
+    g_ptr_array_free(unchanged, TRUE);
+    g_ptr_array_free(invalid, TRUE);
+    g_ptr_array_free(specs, TRUE);
+    g_hash_table_destroy(last);
+    config_free(&config);
+    g_free(text);
+    return g_string_free(out, FALSE);
+}
+
+// Arguments follow the command name, separated by tabs: share names may
+// contain spaces
+static char *handle_control_command(const char *command, gpointer user_data) {
+    Monitor *monitor = user_data;
+    gchar **args = g_strsplit(command, "\t", -1);
+    const char *name = args[0] ? args[0] : "";
+    char *reply;
+
+    if (*name == '\0' || strcmp(name, "status") == 0) {
+        reply = format_status_json(monitor);
+    } else if (strcmp(name, "metrics") == 0) {
+        reply = format_metrics(monitor);
+    } else if (strcmp(name, "trace") == 0) {
+        reply = handle_trace_command(monitor);
+    } else if (strcmp(name, "mount") == 0 || strcmp(name, "unmount") == 0) {
+        reply = handle_mount_command(monitor, args + 1, name[0] == 'm');
+    } else if (strcmp(name, "reload") == 0) {
+        reply = handle_reload_command(monitor);
+    } else if (strcmp(name, "devices") == 0) {
+        reply = handle_devices_command(monitor, args + 1);
+    } else {
+        GString *out = g_string_new("{\"error\": \"unknown command\", \"command\": ");
+        json_append_string(out, name);
+        g_string_append(out, "}\n");
+        reply = g_string_free(out, FALSE);
+    }
+
+    g_strfreev(args);
+    return reply;
+}
+
+// One line for `systemctl --user status`; a no-op outside systemd
+static void notify_status(const Monitor *monitor) {
+    int mounted = 0;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        if (monitor->devices[i].mounted) mounted++;
+    }
+
+    char status[128];
+    snprintf(status, sizeof(status), "STATUS=%s, %d of %d shares mounted, checking every %ds",
+             monitor->is_home_network ? "Home" : "Away", mounted,
+             monitor->config.device_count, monitor->next_interval);
+    ready_notify(status);
+}
+
+// Feeds this cycle's findings to the schedule history and returns how long
+// to sleep: the soonest any share still being watched is worth a look,
+// between min_check_interval and the away interval. Only shares that are
+// mounted or need mounting count; backed-off ones wait for next_retry.
+static int adaptive_interval(Monitor *monitor) {
+    const MonitorConfig *config = &monitor->config;
+    int base = monitor->interval;
+    if (!config->adaptive_schedule || !monitor->is_home_network) {
+        return base;
+    }
+
+    int ceiling = MAX(base, monitor->on_ac_power ? config->away_ac_interval
+                                                 : config->away_battery_interval);
+    // Checking sooner than configured costs battery; not when it is low
+    int floor = !monitor->on_ac_power && monitor->battery_level < 20
+        ? base : MIN(base, config->min_check_interval);
+    time_t now = time(NULL);
+    gint64 now_monotonic = monotonic_seconds();
+    int interval = ceiling;
+    bool watching = false;
+
+    for (int i = 0; i < config->device_count; i++) {
+        DeviceState *state = &monitor->devices[i];
+        if (state->off_profile || state->held || !state->history) {
+            continue;
+        }
+        if (state->checked) {
+            schedule_observe(&monitor->history, state->history, state->reachable, now);
+        }
+        if (state->retry_after > now_monotonic) {
+            continue;
+        }
+        interval = MIN(interval, schedule_next_check(state->history, now, base, floor, ceiling));
+        watching = true;
+    }
+
+    schedule_history_save(&monitor->history, false);
+    return watching ? interval : base;
+}
+
+// Spacing of the checks after resume, while WiFi reassociates and DHCP
+// runs; the last one repeats until the burst ends
+static const guint resume_delays_ms[] = { 1000, 2000, 2000, 3000, 5000, 5000, 10000 };
+
+static bool shares_mounted(const Monitor *monitor) {
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        const DeviceState *state = &monitor->devices[i];
+        if (!state->off_profile && !state->held && !state->mounted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Delay until the next check of a resume burst, or 0 once it is over: every
+// share is back on a home network, or RESUME_WINDOW has gone by.
+static guint resume_burst_delay(Monitor *monitor) {
+    if (!monitor->resume_until) {
+        return 0;
+    }
+    if ((monitor->is_home_network && shares_mounted(monitor)) ||
+        monotonic_seconds() >= monitor->resume_until) {
+        monitor_log("Back to the normal schedule after %u quick checks since resume",
+                    monitor->resume_checks);
+        monitor->resume_until = 0;
+        return 0;
+    }
+    guint step = MIN(monitor->resume_checks, G_N_ELEMENTS(resume_delays_ms) - 1);
+    monitor->resume_checks++;
+    return resume_delays_ms[step];
+}
+
+// The shares are detached (or gave up on): let the suspend go ahead
+static void allow_suspend(Monitor *monitor) {
+    if (monitor->suspend_source) {
+        g_source_remove(monitor->suspend_source);
+        monitor->suspend_source = 0;
+    }
+    sleep_watch_release(&monitor->sleep);
+}
+
+static void finish_cycle(Monitor *monitor) {
+    monitor->cycle_running = false;
+    gint64 elapsed = g_get_monotonic_time() - monitor->cycle_started;
+    histogram_record(&monitor->cycle_time, elapsed);
+    trace_record(&monitor->trace, "cycle", 0, monitor->cycle_started, elapsed, false);
+    // What a share did while the network was still coming back after resume
+    // says nothing about when it is usually around
+    monitor->next_interval = monitor->resume_until ? monitor->interval
+                                                   : adaptive_interval(monitor);
+
+    // Everything the cycle logged goes out in one write
+    monitor_log_flush();
+    memory_trim();
+
+    if (monitor->once) {
+        g_main_loop_quit(monitor->loop);
+    } else if (monitor->suspending) {
+        // The cycle was caught by the suspend; the unmounts queued behind it
+        allow_suspend(monitor);
+    } else if (monitor->cycle_requested) {
+        // State changed while probes/mounts were in flight
+        monitor->cycle_requested = false;
+        schedule_cycle(monitor, EVENT_SETTLE_MS);
+    } else {
+        guint burst_delay = resume_burst_delay(monitor);
+        if (burst_delay) {
+            schedule_cycle(monitor, burst_delay);
+        } else {
+            // Next safety-net poll; change events may pull it forward
+            gint64 delay = monitor->next_interval;
+            if (monitor->next_retry) {
+                delay = MAX(delay, monitor->next_retry - monotonic_seconds());
+            }
+            schedule_poll(monitor, delay);
+        }
+    }
+
+    notify_status(monitor);
+
+    if (monitor->reload_pending && !monitor->once) {
+        monitor->reload_pending = false;
+        reload_config(monitor);
+    }
+}
+
+static void on_queue_idle(WorkQueue *queue G_GNUC_UNUSED, gpointer user_data) {
+    Monitor *monitor = user_data;
+
+    // Only the unmounts before suspend were queued
+    if (!monitor->cycle_running) {
+        if (monitor->suspending) {
+            allow_suspend(monitor);
+        }
+        return;
+    }
+    finish_cycle(monitor);
+}
+
+static gboolean run_cycle(gpointer user_data) {
+    Monitor *monitor = user_data;
+    monitor->cycle_source = 0;
+
+    if (monitor->cycle_running) {
+        monitor->cycle_requested = true;
+        return G_SOURCE_REMOVE;
+    }
+
+    monitor->cycle_started = g_get_monotonic_time();
+    update_state(monitor);
+    monitor->interval = determine_check_interval(monitor);
+    monitor->next_retry = 0;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        monitor->devices[i].checked = false;
+    }
+    log_periodic_status(monitor, monitor->interval);
+
+    monitor->cycle_running = true;
+    monitor->cycles++;
+    work_queue_set_limit(monitor->queue, monitor->config.max_concurrency);
+    bool queued = detach_departed_shares(monitor);
+    queued |= detach_held_shares(monitor);
+    if (!check_and_mount_nas(monitor) && !queued) {
+        finish_cycle(monitor);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_cycle(Monitor *monitor, guint delay_ms) {
+    // Events and reloads before readiness would only mount into a session
+    // that cannot take it yet; the first cycle runs from on_session_ready.
+    // Nothing runs between suspend and resume.
+    if (!monitor->started || monitor->suspending) {
+        return;
+    }
+    if (monitor->cycle_source) {
+        g_source_remove(monitor->cycle_source);
+    }
+    monitor->cycle_source = g_timeout_add(delay_ms, run_cycle, monitor);
+}
+
+// Window sizes shared by convention, so timers that round the same way
+// (systemd's minute-aligned ones among them) come due together
+static const int slack_windows[] = { 60, 30, 15, 10, 5, 2, 1 };
+
+// Lets a poll run late by up to timer_slack (and a quarter of its delay):
+// it is moved to the next wall-clock multiple of the largest standard
+// window that fits, so the CPU wakes once for several timers.
+static guint aligned_poll_delay(const Monitor *monitor, gint64 delay_s) {
+    gint64 allowed = MIN(monitor->config.timer_slack, delay_s / MAX_SLACK_SHARE);
+    int window = 1;
+    for (size_t i = 0; i < G_N_ELEMENTS(slack_windows); i++) {
+        if (slack_windows[i] <= allowed) {
+            window = slack_windows[i];
+            break;
+        }
+    }
+
+    gint64 due = g_get_real_time() / G_USEC_PER_SEC + delay_s;
+    gint64 aligned = (due + window - 1) / window * window;
+    return (guint)(delay_s + aligned - due);
+}
+
+// Unlike schedule_cycle, for whole-second delays: g_timeout_add_seconds
+// fires at the same offset within the second as every other such timer in
+// the session, which together with the window above coalesces wakeups.
+static void schedule_poll(Monitor *monitor, gint64 delay_s) {
+    if (!monitor->started || monitor->suspending) {
+        return;
+    }
+    if (monitor->cycle_source) {
+        g_source_remove(monitor->cycle_source);
+    }
+    monitor->cycle_source = g_timeout_add_seconds(aligned_poll_delay(monitor, delay_s),
+                                                  run_cycle, monitor);
+}
+
+// Battery bands at which determine_check_interval changes its answer
+static int battery_band(const Monitor *monitor, int level) {
+    if (level < monitor->config.min_battery_level) return 2;
+    if (level < 20) return 1;
+    return 0;
+}
+
+static void on_state_event(MonitorEventKind kind, int value, gpointer user_data) {
+    Monitor *monitor = user_data;
+
+    switch (kind) {
+    case MONITOR_EVENT_NETWORK:
+    case MONITOR_EVENT_POWER:
+        schedule_cycle(monitor, EVENT_SETTLE_MS);
+        break;
+    case MONITOR_EVENT_BATTERY:
+        // Percentage ticks every percent; only a band change matters
+        if (!monitor->on_ac_power &&
+            battery_band(monitor, value) != battery_band(monitor, monitor->battery_level)) {
+            schedule_cycle(monitor, EVENT_SETTLE_MS);
+        }
+        break;
+    }
+}
+
+static gboolean on_suspend_timeout(gpointer user_data) {
+    Monitor *monitor = user_data;
+    monitor->suspend_source = 0;
+    monitor_log("WARNING: Shares still unmounting; letting the suspend go ahead");
+    monitor_log_flush();
+    sleep_watch_release(&monitor->sleep);
+    return G_SOURCE_REMOVE;
+}
+
+// Before suspend: no more cycles, and every share is detached while logind
+// waits on our inhibitor. After resume: a check right away, then more on a
+// short spacing until the network settles (see resume_burst_delay). Counts
+// and backoffs from before the suspend no longer apply.
+static void on_sleep(bool suspending, gpointer user_data) {
+    Monitor *monitor = user_data;
+
+    if (suspending) {
+        monitor_log("Preparing for suspend");
+        monitor->suspending = true;
+        monitor->resume_until = 0;
+        if (monitor->cycle_source) {
+            g_source_remove(monitor->cycle_source);
+            monitor->cycle_source = 0;
+        }
+        bool queued = monitor->started && monitor->config.unmount_on_suspend &&
+                      detach_for_suspend(monitor);
+        if (queued || monitor->cycle_running) {
+            monitor->suspend_source = g_timeout_add(SUSPEND_UNMOUNT_MS, on_suspend_timeout,
+                                                    monitor);
+        } else {
+            sleep_watch_release(&monitor->sleep);
+        }
+        monitor_log_flush();
+        return;
+    }
+
+    monitor_log("Resumed; checking every few seconds until the network settles");
+    monitor->suspending = false;
+    // Not released here: if the suspend was cancelled in time, the
+    // inhibitor is still held and stays for the next one
+    if (monitor->suspend_source) {
+        g_source_remove(monitor->suspend_source);
+        monitor->suspend_source = 0;
+    }
+    monitor->cycle_requested = false;
+    for (int i = 0; i < monitor->config.device_count; i++) {
+        reset_backoff(&monitor->devices[i]);
+    }
+    monitor->resume_until = monotonic_seconds() + RESUME_WINDOW;
+    monitor->resume_checks = 0;
+    schedule_cycle(monitor, 0);
+}
+
+// Kernel power_supply uevent: adapter (un)plugged or a capacity update
+static gboolean on_power_uevent(int fd G_GNUC_UNUSED, GIOCondition condition G_GNUC_UNUSED,
+                                gpointer user_data) {
+    Monitor *monitor = user_data;
+
+    if (power_monitor_handle_uevent(&monitor->power)) {
+        const PowerStatus *power = power_monitor_get(&monitor->power);
+        if (power->on_ac != monitor->on_ac_power) {
+            on_state_event(MONITOR_EVENT_POWER, 0, monitor);
+        } else {
+            on_state_event(MONITOR_EVENT_BATTERY, power->battery_level, monitor);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void start_event_sources(Monitor *monitor) {
+    bool sysfs_events = monitor->power.uevent_fd >= 0;
+    events_subscribe(&monitor->events, monitor->system_bus, !sysfs_events,
+                     on_state_event, monitor);
+    if (sysfs_events) {
+        monitor->power_source = g_unix_fd_add(monitor->power.uevent_fd, G_IO_IN,
+                                              on_power_uevent, monitor);
+    }
+    if (monitor->system_bus) {
+        monitor_log("Event-driven mode: reacting to NetworkManager/%s changes",
+                    sysfs_events ? "power_supply" : "UPower");
+    }
+}
+
+static void stop_event_sources(Monitor *monitor) {
+    events_unsubscribe(&monitor->events);
+    if (monitor->power_source) {
+        g_source_remove(monitor->power_source);
+        monitor->power_source = 0;
+    }
+}
+
+// Anything that feeds determine_check_interval or the home-network test
+static bool schedule_inputs_changed(const MonitorConfig *old, const MonitorConfig *new) {
+    if (old->home_ac_interval != new->home_ac_interval ||
+        old->home_battery_interval != new->home_battery_interval ||
+        old->away_ac_interval != new->away_ac_interval ||
+        old->away_battery_interval != new->away_battery_interval ||
+        old->min_battery_level != new->min_battery_level ||
+        old->network_count != new->network_count) {
+        return true;
+    }
+    // Not compared field by field; reloads are rare and a cycle is cheap
+    if (old->profile_count || new->profile_count) {
+        return true;
+    }
+    for (int i = 0; i < old->network_count; i++) {
+        if (strcmp(old->home_networks[i], new->home_networks[i]) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Re-reads the config file and swaps it in. Shares that are still listed
+// keep their state (failure count, backoff, counters); only added shares
+// start fresh. Must not run while a cycle holds indices into the config.
+// Returns false if the file could not be used and nothing changed.
+static bool reload_config(Monitor *monitor) {
+    MonitorConfig config;
+    if (!read_config(monitor, &config)) {
+        monitor_log("Keeping the previous configuration");
+        return false;
+    }
+
+    DeviceState *devices = g_new0(DeviceState, config.device_count);
+    int kept = 0;
+    for (int i = 0; i < config.device_count; i++) {
+        int old = find_device(&monitor->config, config.devices[i].spec);
+        if (old >= 0) {
+            devices[i] = monitor->devices[old];
+            kept++;
+        } else {
+            init_device_state(&devices[i]);
+        }
+    }
+
+    int added = config.device_count - kept;
+    int removed = monitor->config.device_count - kept;
+    bool reschedule = added > 0 || schedule_inputs_changed(&monitor->config, &config);
+    bool was_event_driven = monitor->config.event_driven;
+    bool delayed_suspend = monitor->config.unmount_on_suspend;
+    bool lean = monitor->config.lean_memory;
+    bool shared_probe = monitor->config.shared_probe;
+
+    free_host_groups(monitor);
+    profile_index_clear(&monitor->profiles);
+    g_free(monitor->devices);
+    config_free(&monitor->config);
+    monitor->config = config;
+    monitor->devices = devices;
+    group_devices_by_host(monitor);
+    attach_history(monitor);
+
+    // The old profile pointer went with the old config
+    profile_index_build(&monitor->profiles, &monitor->config);
+    apply_profile(monitor, monitor->network.ssid
+                               ? profile_index_match(&monitor->profiles, &monitor->network)
+                               : NULL);
+
+    monitor_log_set_max_size(monitor->config.max_log_size * 1024L);
+    if (monitor->config.event_driven != was_event_driven) {
+        if (monitor->config.event_driven) {
+            start_event_sources(monitor);
+        } else {
+            stop_event_sources(monitor);
+        }
+    }
+    if (monitor->config.unmount_on_suspend != delayed_suspend) {
+        sleep_watch_stop(&monitor->sleep);
+        sleep_watch_start(&monitor->sleep, monitor->system_bus,
+                          monitor->config.unmount_on_suspend, on_sleep, monitor);
+    }
+
+    if (monitor->config.shared_probe != shared_probe) {
+        if (monitor->config.shared_probe) {
+            shared_probe_watch(&monitor->shared, monitor->system_bus);
+        } else {
+            shared_probe_unwatch(&monitor->shared);
+        }
+    }
+    // The allocator is set up once, before the first thread starts
+    if (monitor->config.lean_memory != lean) {
+        monitor_log("lean_memory takes effect after a restart");
+    }
+
+    // Trace tracks are numbered by device index
+    if (added || removed) {
+        trace_buffer_clear(&monitor->trace);
+    }
+
+    monitor_log("Configuration reloaded: %d added, %d removed, %d unchanged",
+                added, removed, kept);
+    log_config(monitor);
+
+    // New shares or intervals take effect now rather than after the old interval
+    if (reschedule) {
+        schedule_cycle(monitor, EVENT_SETTLE_MS);
+    }
+    monitor_log_flush();
+    return true;
+}
+
+static gboolean on_reload_idle(gpointer user_data) {
+    Monitor *monitor = user_data;
+    monitor->reload_source = 0;
+
+    if (monitor->cycle_running) {
+        monitor->reload_pending = true;
+    } else {
+        reload_config(monitor);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Only complete files are reported (see on_config_changed), so there is
+// nothing to wait for; the idle just folds one save's events together
+static void schedule_reload(Monitor *monitor) {
+    if (!monitor->reload_source) {
+        monitor->reload_source = g_idle_add(on_reload_idle, monitor);
+    }
+}
+
+// Watches the directory rather than the file so saves that rename a copy
+// over config.conf (the GUI always does) are noticed. A rename lands the
+// whole new file at once; in-place edits count once the writer closes the
+// file (CHANGES_DONE_HINT), never on CREATED, when it may still be empty.
+static void on_config_changed(GFileMonitor *file_monitor G_GNUC_UNUSED, GFile *file,
+                              GFile *other, GFileMonitorEvent event, gpointer user_data) {
+    Monitor *monitor = user_data;
+
+    switch (event) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+        if (g_file_equal(file, monitor->config_file)) {
+            schedule_reload(monitor);
+        }
+        break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        if (other && g_file_equal(other, monitor->config_file)) {
+            schedule_reload(monitor);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void watch_config(Monitor *monitor) {
+    GError *error = NULL;
+    monitor->config_file = g_file_new_for_path(monitor->config_path);
+    GFile *dir = g_file_get_parent(monitor->config_file);
+
+    monitor->config_monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES,
+                                                       NULL, &error);
+    if (monitor->config_monitor) {
+        g_signal_connect(monitor->config_monitor, "changed",
+                         G_CALLBACK(on_config_changed), monitor);
+    } else {
+        monitor_log("WARNING: Not watching %s for changes: %s (SIGHUP still reloads)",
+                    monitor->config_path, error->message);
+        g_error_free(error);
+    }
+    g_object_unref(dir);
+}
+
+static gboolean on_reload_signal(gpointer user_data) {
+    schedule_reload(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_session_ready(gpointer user_data) {
+    Monitor *monitor = user_data;
+    monitor->started = true;
+    ready_notify("READY=1\nSTATUS=Running first check");
+    schedule_cycle(monitor, 0);
+}
+
+static gboolean on_quit_signal(gpointer user_data) {
+    Monitor *monitor = user_data;
+    ready_notify("STOPPING=1");
+    g_main_loop_quit(monitor->loop);
+    return G_SOURCE_CONTINUE;
+}
+
+static void cleanup(Monitor *monitor) {
+    monitor_log("NAS monitor stopping");
+
+    control_server_stop(&monitor->control);
+    ready_watch_stop(&monitor->ready);
+    stop_event_sources(monitor);
+    sleep_watch_stop(&monitor->sleep);
+    shared_probe_unwatch(&monitor->shared);
+    if (monitor->suspend_source) {
+        g_source_remove(monitor->suspend_source);
+    }
+    power_monitor_close(&monitor->power);
+    if (monitor->reload_source) {
+        g_source_remove(monitor->reload_source);
+    }
+    g_clear_object(&monitor->config_monitor);
+    g_clear_object(&monitor->config_file);
+    if (monitor->cycle_source) {
+        g_source_remove(monitor->cycle_source);
+    }
+    g_clear_pointer(&monitor->loop, g_main_loop_unref);
+
+    mount_watch_stop(&monitor->mounts);
+    g_clear_object(&monitor->volume_monitor);
+    if (monitor->session_bus) {
+        g_dbus_connection_flush_sync(monitor->session_bus, NULL, NULL);
+    }
+    g_clear_object(&monitor->session_bus);
+    g_clear_object(&monitor->system_bus);
+    network_identity_clear(&monitor->network);
+    g_clear_pointer(&monitor->queue, work_queue_free);
+    if (trace_enabled(&monitor->trace)) {
+        GError *error = NULL;
+        if (!write_trace(monitor, &error)) {
+            monitor_log("WARNING: Cannot write trace: %s", error->message);
+            g_error_free(error);
+        }
+        trace_buffer_free(&monitor->trace);
+    }
+    free_host_groups(monitor);
+    profile_index_clear(&monitor->profiles);
+    g_free(monitor->devices);
+    config_free(&monitor->config);
+    schedule_history_save(&monitor->history, true);
+    schedule_history_free(&monitor->history);
+    resolve_cache_free(&monitor->resolve);
+    // Last, so a successor cannot start before the socket and history are let go
+    release_lock(monitor);
+    monitor_log_close();
+}
+
+int main(int argc, char *argv[]) {
+    Monitor monitor = {0};
+    monitor.lock_fd = -1;
+    monitor.power.uevent_fd = -1;
+    monitor.sleep.inhibitor = -1;
+    char *config_path = NULL;
+    char *log_path = NULL;
+    char *socket_path = NULL;
+    char *trace_path = NULL;
+    gboolean once = FALSE;
+    gboolean show_version = FALSE;
+
+    GOptionEntry entries[] = {
+        { "config", 'c', 0, G_OPTION_ARG_FILENAME, &config_path,
+          "Configuration file (default: ~/.config/nas-monitor/config.conf)", "FILE" },
+        { "log-file", 'l', 0, G_OPTION_ARG_FILENAME, &log_path,
+          "Log file, or - for stderr (default: ~/.local/share/nas-monitor.log)", "FILE" },
+        { "once", 'o', 0, G_OPTION_ARG_NONE, &once,
+          "Run a single check cycle right away and exit", NULL },
+        { "socket", 's', 0, G_OPTION_ARG_FILENAME, &socket_path,
+          "Status socket (default: $XDG_RUNTIME_DIR/nas-monitor.sock)", "FILE" },
+        { "trace", 't', 0, G_OPTION_ARG_FILENAME, &trace_path,
+          "Record a timeline of the checks, written to FILE on exit and on the trace command",
+          "FILE" },
+        { "version", 'V', 0, G_OPTION_ARG_NONE, &show_version,
+          "Show version and exit", NULL },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- power-aware NAS monitor");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (show_version) {
+        printf("nas-monitord %s\n", VERSION);
+        return 0;
+    }
+
+    init_paths(&monitor);
+    if (config_path) snprintf(monitor.config_path, MAX_PATH, "%s", config_path);
+    if (log_path) snprintf(monitor.log_path, MAX_PATH, "%s", log_path);
+    if (socket_path) snprintf(monitor.socket_path, MAX_PATH, "%s", socket_path);
+    if (trace_path) {
+        snprintf(monitor.trace_path, MAX_PATH, "%s", trace_path);
+        trace_buffer_init(&monitor.trace, TRACE_EVENTS);
+    }
+    g_free(config_path);
+    g_free(log_path);
+    g_free(socket_path);
+    g_free(trace_path);
+
+    if (monitor_log_open(monitor.log_path) < 0) {
+        fprintf(stderr, "Cannot open log file %s: %s\n", monitor.log_path, strerror(errno));
+    }
+    monitor_log("Starting power-aware NAS monitor (native %s)", VERSION);
+
+    if (!acquire_lock(&monitor)) {
+        monitor_log_close();
+        return 1;
+    }
+
+    resolve_cache_init(&monitor.resolve, monitor.address_path);
+    if (!load_config(&monitor)) {
+        cleanup(&monitor);
+        return 1;
+    }
+    // Before g_bus_get_sync starts the GDBus worker thread
+    if (monitor.config.lean_memory) {
+        memory_lean_setup(lean_reserve(&monitor.config));
+    }
+
+    monitor.system_bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL);
+    monitor.session_bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+    monitor.volume_monitor = g_volume_monitor_get();
+    mount_watch_start(&monitor.mounts, monitor.volume_monitor, on_mounts_changed, &monitor);
+    power_monitor_init(&monitor.power, monitor.system_bus);
+    if (monitor.config.shared_probe) {
+        shared_probe_watch(&monitor.shared, monitor.system_bus);
+    }
+
+    monitor.loop = g_main_loop_new(NULL, FALSE);
+    monitor.queue = work_queue_new(monitor.config.max_concurrency, start_job,
+                                   on_queue_idle, &monitor);
+    monitor.once = once;
+    g_unix_signal_add(SIGINT, on_quit_signal, &monitor);
+    g_unix_signal_add(SIGTERM, on_quit_signal, &monitor);
+
+    if (!once) {
+        if (!control_server_start(&monitor.control, monitor.socket_path,
+                                  handle_control_command, &monitor, &error)) {
+            monitor_log("WARNING: Status socket unavailable: %s", error->message);
+            g_clear_error(&error);
+        } else if (monitor.control.activated) {
+            monitor_log("Status socket passed in by systemd");
+        }
+
+        // Live reload on save (the GUI triggers SIGHUP through systemctl reload)
+        watch_config(&monitor);
+        g_unix_signal_add(SIGHUP, on_reload_signal, &monitor);
+
+        // Even in polling mode: a mount carried across a suspend goes stale
+        sleep_watch_start(&monitor.sleep, monitor.system_bus,
+                          monitor.config.unmount_on_suspend, on_sleep, &monitor);
+    }
+
+    if (monitor.config.event_driven && !once) {
+        start_event_sources(&monitor);
+    }
+
+    // Wait for NetworkManager and gvfs rather than a fixed delay; --once is
+    // run by hand, into a session that is already up
+    if (once) {
+        on_session_ready(&monitor);
+    } else {
+        ready_watch_start(&monitor.ready, monitor.system_bus, monitor.session_bus,
+                          READY_TIMEOUT, on_session_ready, &monitor);
+    }
+    g_main_loop_run(monitor.loop);
+
+    cleanup(&monitor);
+    return 0;
+}
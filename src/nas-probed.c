@@ -0,0 +1,447 @@
+/*
+ * NAS Monitor Probe Service
+ * System-wide reachability probes shared by every user's nas-monitord
+ *
+ * Owns io.github.NasMonitor.Probe1 on the system bus. Each logged-in
+ * user's daemon asks it to probe the hosts of its shares instead of
+ * probing them itself; a host probed for one caller is answered from the
+ * result for everyone else who asks within --max-age seconds. Callers
+ * asking while a probe is running wait for it and share it. Because
+ * nas-monitord aligns its polls to round times, that is usually what
+ * happens: N users, one probe per host.
+ *
+ * Nothing runs between requests, so the service costs no wakeups while
+ * idle. Results are dropped whenever NetworkManager reports a network
+ * change, since they describe the old network.
+ *
+ * Compile with:
+ * gcc -o nas-probed nas-probed.c monitor-events.c monitor-log.c monitor-probe.c \
+ *     `pkg-config --cflags --libs gio-2.0` -std=c99
+ */
+
+#define _GNU_SOURCE
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "monitor-events.h"
+#include "monitor-log.h"
+#include "monitor-probe.h"
+#include "monitor-shared.h"
+
+#ifndef VERSION
+#define VERSION "unknown"
+#endif
+
+#define DEFAULT_MAX_AGE 5       /* seconds a result is handed out again */
+#define ADDRESS_TTL 300         /* seconds resolved addresses are reused */
+#define MAX_HOST_NAME 253
+#define MAX_PENDING 256         /* callers waiting for a probe at once */
+
+static const char introspection_xml[] =
+    "<node>"
+    "  <interface name='" SHARED_PROBE_IFACE "'>"
+    "    <method name='Probe'>"
+    "      <arg name='hosts' type='as' direction='in'/>"
+    "      <arg name='timeout_ms' type='u' direction='in'/>"
+    "      <arg name='results' type='a(bbbxxs)' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+typedef struct {
+    ProbeAddresses addresses;
+    gint64 addresses_expire;    /* monotonic seconds */
+    gint64 probed_us;           /* monotonic; 0 until the first probe */
+    bool reachable;
+    bool looked_up;
+    long resolve_us;
+    long total_us;
+    char address[64];
+} HostEntry;
+
+typedef struct {
+    GDBusMethodInvocation *invocation;
+    char **hosts;               /* lowercased */
+    guint timeout_ms;
+    gint64 received_us;
+} Request;
+
+typedef struct {
+    ProbeHost *probes;
+    char **names;
+    int count;
+    guint timeout_ms;
+    unsigned generation;
+} Batch;
+
+typedef struct {
+    GDBusConnection *bus;
+    GDBusNodeInfo *introspection;
+    guint owner_id;
+    guint registration;
+    MonitorEvents events;
+    GMainLoop *loop;
+    gint64 max_age_us;
+    GHashTable *hosts;          /* lowercased name -> HostEntry */
+    GPtrArray *pending;         /* Request, waiting for a probe */
+    bool probing;
+    unsigned generation;        /* bumped when the network changes */
+    unsigned probes;
+    unsigned answered;
+    unsigned shared;            /* results given out to a later caller */
+} Service;
+
+static void request_free(Request *request) {
+    g_strfreev(request->hosts);
+    g_free(request);
+}
+
+static void batch_free(Batch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        g_free(batch->names[i]);
+    }
+    g_free(batch->names);
+    g_free(batch->probes);
+    g_free(batch);
+}
+
+static bool fresh(const Service *service, const HostEntry *entry, gint64 now) {
+    return entry && entry->probed_us && now - entry->probed_us <= service->max_age_us;
+}
+
+static bool answerable(const Service *service, const Request *request, gint64 now) {
+    for (char **host = request->hosts; *host; host++) {
+        if (!fresh(service, g_hash_table_lookup(service->hosts, *host), now)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void answer(Service *service, Request *request) {
+    GVariantBuilder results;
+    g_variant_builder_init(&results, G_VARIANT_TYPE("a(bbbxxs)"));
+    for (char **host = request->hosts; *host; host++) {
+        const HostEntry *entry = g_hash_table_lookup(service->hosts, *host);
+        bool cached = entry->probed_us < request->received_us;
+        service->shared += cached;
+        g_variant_builder_add(&results, "(bbbxxs)", entry->reachable, cached,
+                              entry->looked_up, (gint64)entry->resolve_us,
+                              (gint64)entry->total_us, entry->address);
+    }
+    g_dbus_method_invocation_return_value(request->invocation,
+                                          g_variant_new("(a(bbbxxs))", &results));
+    service->answered++;
+}
+
+static void probe_thread(GTask *task, gpointer source G_GNUC_UNUSED,
+                         gpointer task_data, GCancellable *cancellable G_GNUC_UNUSED) {
+    Batch *batch = task_data;
+    probe_hosts_reachable(batch->probes, batch->count, (int)batch->timeout_ms);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void start_probe(Service *service);
+
+static void store_result(Service *service, const char *name, const ProbeHost *probe,
+                         gint64 now_us) {
+    HostEntry *entry = g_hash_table_lookup(service->hosts, name);
+    if (!entry) {
+        entry = g_new0(HostEntry, 1);
+        g_hash_table_insert(service->hosts, g_strdup(name), entry);
+    }
+
+    if (probe->looked_up) {
+        entry->addresses = probe->addresses;
+        entry->addresses_expire = now_us / G_USEC_PER_SEC + ADDRESS_TTL;
+    }
+    entry->probed_us = now_us;
+    entry->reachable = probe->reachable;
+    entry->looked_up = probe->looked_up;
+    entry->resolve_us = probe->timing.resolve_us;
+    entry->total_us = probe->timing.total_us;
+    entry->address[0] = '\0';
+    int shown = probe->answered >= 0 ? probe->answered : 0;
+    if (probe->addresses.count > 0) {
+        probe_address_to_string(&probe->addresses.address[shown], entry->address,
+                                sizeof(entry->address));
+    }
+}
+
+// Answers everyone whose hosts are now known; the rest (hosts asked for
+// while this probe was running) get the next one. now is when the results
+// were stored, so they count as fresh even with --max-age 0.
+static void answer_pending(Service *service, gint64 now) {
+    for (guint i = 0; i < service->pending->len;) {
+        Request *request = g_ptr_array_index(service->pending, i);
+        if (answerable(service, request, now)) {
+            answer(service, request);
+            g_ptr_array_remove_index_fast(service->pending, i);
+        } else {
+            i++;
+        }
+    }
+    if (service->pending->len) {
+        start_probe(service);
+    }
+}
+
+static void on_probe_done(GObject *source G_GNUC_UNUSED, GAsyncResult *result,
+                          gpointer user_data) {
+    Service *service = user_data;
+    Batch *batch = g_task_get_task_data(G_TASK(result));
+    service->probing = false;
+
+    // Probed on the network that was just left; try again on the new one
+    gint64 now = g_get_monotonic_time();
+    if (batch->generation == service->generation) {
+        for (int i = 0; i < batch->count; i++) {
+            store_result(service, batch->names[i], &batch->probes[i], now);
+        }
+    }
+    answer_pending(service, now);
+    monitor_log_flush();
+}
+
+// One probe for every host some waiting caller needs, with the longest
+// timeout any of them asked for
+static void start_probe(Service *service) {
+    if (service->probing) {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    GPtrArray *names = g_ptr_array_new();
+    guint timeout_ms = 0;
+    for (guint i = 0; i < service->pending->len; i++) {
+        const Request *request = g_ptr_array_index(service->pending, i);
+        for (char **host = request->hosts; *host; host++) {
+            bool listed = false;
+            for (guint n = 0; n < names->len && !listed; n++) {
+                listed = strcmp(g_ptr_array_index(names, n), *host) == 0;
+            }
+            if (!listed && !fresh(service, g_hash_table_lookup(service->hosts, *host), now)) {
+                g_ptr_array_add(names, g_strdup(*host));
+            }
+        }
+        timeout_ms = MAX(timeout_ms, request->timeout_ms);
+    }
+
+    Batch *batch = g_new0(Batch, 1);
+    batch->count = (int)names->len;
+    batch->names = (char **)g_ptr_array_free(names, FALSE);
+    batch->probes = g_new0(ProbeHost, MAX(batch->count, 1));
+    batch->timeout_ms = timeout_ms;
+    batch->generation = service->generation;
+    for (int i = 0; i < batch->count; i++) {
+        const HostEntry *entry = g_hash_table_lookup(service->hosts, batch->names[i]);
+        batch->probes[i].name = batch->names[i];
+        if (entry && entry->addresses_expire > now / G_USEC_PER_SEC) {
+            batch->probes[i].addresses = entry->addresses;
+        }
+    }
+
+    service->probing = true;
+    service->probes++;
+    GTask *task = g_task_new(NULL, NULL, on_probe_done, service);
+    g_task_set_task_data(task, batch, (GDestroyNotify)batch_free);
+    g_task_run_in_thread(task, probe_thread);
+    g_object_unref(task);
+}
+
+static bool valid_host(const char *host) {
+    size_t length = strlen(host);
+    if (length == 0 || length > MAX_HOST_NAME) {
+        return false;
+    }
+    for (const char *p = host; *p; p++) {
+        if (!g_ascii_isalnum(*p) && !strchr(".-_:[]%", *p)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void handle_probe(Service *service, GVariant *params, GDBusMethodInvocation *invocation) {
+    GVariantIter *iter;
+    guint32 timeout_ms;
+    g_variant_get(params, "(asu)", &iter, &timeout_ms);
+
+    GPtrArray *hosts = g_ptr_array_new();
+    const char *host;
+    bool valid = timeout_ms > 0 && timeout_ms <= SHARED_PROBE_MAX_TIMEOUT_MS &&
+                 g_variant_iter_n_children(iter) <= SHARED_PROBE_MAX_HOSTS;
+    while (valid && g_variant_iter_next(iter, "&s", &host)) {
+        valid = valid_host(host);
+        g_ptr_array_add(hosts, g_ascii_strdown(host, -1));
+    }
+    g_ptr_array_add(hosts, NULL);
+    g_variant_iter_free(iter);
+
+    Request *request = g_new0(Request, 1);
+    request->invocation = invocation;
+    request->hosts = (char **)g_ptr_array_free(hosts, FALSE);
+    request->timeout_ms = timeout_ms;
+    request->received_us = g_get_monotonic_time();
+
+    if (!valid) {
+        g_dbus_method_invocation_return_error(
+            invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+            "Expected up to %d host names and a timeout of 1 to %d ms",
+            SHARED_PROBE_MAX_HOSTS, SHARED_PROBE_MAX_TIMEOUT_MS);
+        request_free(request);
+    } else if (answerable(service, request, request->received_us)) {
+        answer(service, request);
+        request_free(request);
+    } else if (service->pending->len >= MAX_PENDING) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                              "Too many callers waiting for a probe");
+        request_free(request);
+    } else {
+        g_ptr_array_add(service->pending, request);
+        start_probe(service);
+    }
+}
+
+static void on_method_call(GDBusConnection *bus G_GNUC_UNUSED,
+                           const gchar *sender G_GNUC_UNUSED,
+                           const gchar *path G_GNUC_UNUSED,
+                           const gchar *iface G_GNUC_UNUSED,
+                           const gchar *method, GVariant *params,
+                           GDBusMethodInvocation *invocation, gpointer user_data) {
+    Service *service = user_data;
+    if (strcmp(method, "Probe") == 0) {
+        handle_probe(service, params, invocation);
+    } else {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Unknown method %s", method);
+    }
+}
+
+static const GDBusInterfaceVTable vtable = { on_method_call, NULL, NULL, { 0 } };
+
+static void on_event(MonitorEventKind kind, int value G_GNUC_UNUSED, gpointer user_data) {
+    Service *service = user_data;
+    if (kind != MONITOR_EVENT_NETWORK) {
+        return;
+    }
+    g_hash_table_remove_all(service->hosts);
+    service->generation++;
+}
+
+static void on_name_acquired(GDBusConnection *bus G_GNUC_UNUSED, const gchar *name,
+                             gpointer user_data G_GNUC_UNUSED) {
+    monitor_log("Serving probes as %s", name);
+    monitor_log_flush();
+}
+
+static void on_name_lost(GDBusConnection *bus, const gchar *name, gpointer user_data) {
+    Service *service = user_data;
+    monitor_log(bus ? "ERROR: %s is owned by another process or not allowed by the bus policy"
+                    : "ERROR: Cannot connect to the bus to own %s", name);
+    g_main_loop_quit(service->loop);
+}
+
+static gboolean on_quit_signal(gpointer user_data) {
+    Service *service = user_data;
+    g_main_loop_quit(service->loop);
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char *argv[]) {
+    Service service = {0};
+    gint max_age = DEFAULT_MAX_AGE;
+    gboolean session = FALSE;
+    gboolean show_version = FALSE;
+
+    GOptionEntry entries[] = {
+        { "max-age", 'm', 0, G_OPTION_ARG_INT, &max_age,
+          "Seconds a probe result is handed to later callers (default 5)", "SECONDS" },
+        { "session", 0, 0, G_OPTION_ARG_NONE, &session,
+          "Serve on the session bus instead of the system bus, for testing", NULL },
+        { "version", 'V', 0, G_OPTION_ARG_NONE, &show_version,
+          "Show version and exit", NULL },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    GError *error = NULL;
+    GOptionContext *context = g_option_context_new("- shared NAS probe service");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    if (show_version) {
+        printf("nas-probed %s\n", VERSION);
+        return 0;
+    }
+    if (max_age < 0 || max_age > 3600) {
+        fprintf(stderr, "--max-age must be between 0 and 3600 seconds\n");
+        return 2;
+    }
+
+    monitor_log_open(NULL);
+    service.max_age_us = (gint64)max_age * G_USEC_PER_SEC;
+    service.hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    service.pending = g_ptr_array_new_with_free_func((GDestroyNotify)request_free);
+    service.introspection = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+    service.loop = g_main_loop_new(NULL, FALSE);
+
+    GBusType bus_type = session ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM;
+    service.bus = g_bus_get_sync(bus_type, NULL, &error);
+    if (!service.bus) {
+        monitor_log("ERROR: Cannot connect to the bus: %s", error->message);
+        g_error_free(error);
+        monitor_log_close();
+        return 1;
+    }
+
+    monitor_log("Starting NAS probe service (%s), results shared for %ds", VERSION, max_age);
+    // Exported before the name is taken, so no caller finds it missing
+    service.registration = g_dbus_connection_register_object(
+        service.bus, SHARED_PROBE_PATH, service.introspection->interfaces[0],
+        &vtable, &service, NULL, &error);
+    if (!service.registration) {
+        monitor_log("ERROR: Cannot export %s: %s", SHARED_PROBE_PATH, error->message);
+        g_error_free(error);
+        monitor_log_close();
+        return 1;
+    }
+    GDBusConnection *system_bus = session ? g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL)
+                                          : g_object_ref(service.bus);
+    if (system_bus) {
+        events_subscribe(&service.events, system_bus, false, on_event, &service);
+        g_object_unref(system_bus);
+    }
+    service.owner_id = g_bus_own_name_on_connection(
+        service.bus, SHARED_PROBE_NAME, G_BUS_NAME_OWNER_FLAGS_NONE,
+        on_name_acquired, on_name_lost, &service, NULL);
+    g_unix_signal_add(SIGINT, on_quit_signal, &service);
+    g_unix_signal_add(SIGTERM, on_quit_signal, &service);
+
+    g_main_loop_run(service.loop);
+
+    monitor_log("NAS probe service stopping: %u probes, %u requests, %u results shared",
+                service.probes, service.answered, service.shared);
+    g_bus_unown_name(service.owner_id);
+    g_dbus_connection_unregister_object(service.bus, service.registration);
+    events_unsubscribe(&service.events);
+    g_ptr_array_free(service.pending, TRUE);
+    g_hash_table_destroy(service.hosts);
+    g_dbus_node_info_unref(service.introspection);
+    g_main_loop_unref(service.loop);
+    g_object_unref(service.bus);
+    monitor_log_close();
+    return 0;
+}
@@ -0,0 +1,325 @@
+#!/bin/bash
+# NAS Monitor Cycle Benchmark
+# Times the monitor cycle of nas-monitor.sh against mocked backends
+#
+# nmcli, upower, gio and the SMB port probe (timeout + /dev/tcp) are
+# replaced by scripts on PATH with fixed latencies, so runs are repeatable
+# and need no NAS, network or desktop session. Every measured cycle starts
+# cold: nothing mounted and no backoff, so each one probes and mounts.
+
+set -euo pipefail
+export LC_ALL=C     # EPOCHREALTIME with a '.' separator
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(dirname "$SCRIPT_DIR")"
+
+# Scenario
+DEVICES=8
+FAILURE_RATIO=0         # share of hosts that do not answer the probe
+MOUNT_FAILURE_RATIO=0   # share of answering hosts whose mount fails
+CYCLES=50
+WARMUP=2
+ON_BATTERY=false
+PROBE_MS=2              # mock latency of a probe that succeeds
+BENCH_PROBE_TIMEOUT_MS=100    # and how long one that fails takes
+MOUNT_MS=20
+CSV_FILE="$PROJECT_ROOT/build/bench.csv"
+
+PHASES=(network power mount_table probe mount cycle)
+
+usage() {
+    cat << EOF
+Usage: $0 [options]
+
+  --devices N               Shares to monitor, one host each (default $DEVICES)
+  --failure-ratio R         Fraction of hosts that are unreachable (default $FAILURE_RATIO)
+  --mount-failure-ratio R   Fraction of reachable shares that fail to mount (default $MOUNT_FAILURE_RATIO)
+  --cycles N                Measured cycles (default $CYCLES)
+  --warmup N                Cycles run first and discarded (default $WARMUP)
+  --battery                 Report the battery at 80% instead of AC power
+  --probe-ms MS             Latency of a successful probe (default $PROBE_MS)
+  --probe-timeout-ms MS     Time an unreachable host takes to fail (default $BENCH_PROBE_TIMEOUT_MS)
+  --mount-ms MS             Latency of a mount (default $MOUNT_MS)
+  --csv FILE                Append results here (default build/bench.csv)
+
+Phases: ${PHASES[*]} (per-cycle totals in ms).
+EOF
+}
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --devices) DEVICES="$2"; shift ;;
+        --failure-ratio) FAILURE_RATIO="$2"; shift ;;
+        --mount-failure-ratio) MOUNT_FAILURE_RATIO="$2"; shift ;;
+        --cycles) CYCLES="$2"; shift ;;
+        --warmup) WARMUP="$2"; shift ;;
+        --battery) ON_BATTERY=true ;;
+        --probe-ms) PROBE_MS="$2"; shift ;;
+        --probe-timeout-ms) BENCH_PROBE_TIMEOUT_MS="$2"; shift ;;
+        --mount-ms) MOUNT_MS="$2"; shift ;;
+        --csv) CSV_FILE="$2"; shift ;;
+        -h|--help) usage; exit 0 ;;
+        *) echo "Unknown option: $1" >&2; usage >&2; exit 2 ;;
+    esac
+    shift
+done
+
+BENCH_DIR=$(mktemp -d /tmp/nas-monitor-bench.XXXXXX)
+trap '[ -n "${BENCH_KEEP:-}" ] || rm -rf "$BENCH_DIR"' EXIT
+
+# Round a ratio of the device count without bc
+count_of() {
+    awk -v n="$DEVICES" -v r="$1" 'BEGIN { printf "%d", n * r + 0.5 }'
+}
+
+ms_to_seconds() {
+    printf '%d.%03d' $(($1 / 1000)) $(($1 % 1000))
+}
+
+# Hosts nas-1 .. nas-N; the first ones are down, the next ones fail to mount
+setup_scenario() {
+    local down mount_failing i
+    down=$(count_of "$FAILURE_RATIO")
+    mount_failing=$(awk -v n="$((DEVICES - down))" -v r="$MOUNT_FAILURE_RATIO" \
+        'BEGIN { printf "%d", n * r + 0.5 }')
+
+    MOCK_DOWN=","
+    MOCK_MOUNT_FAIL=","
+    for ((i = 1; i <= DEVICES; i++)); do
+        if [ "$i" -le "$down" ]; then
+            MOCK_DOWN+="nas-$i.bench,"
+        elif [ "$i" -le $((down + mount_failing)) ]; then
+            MOCK_MOUNT_FAIL+="nas-$i.bench/share,"
+        fi
+    done
+
+    {
+        echo "[networks]"
+        echo "home_networks=BenchWiFi"
+        echo
+        echo "[nas_devices]"
+        for ((i = 1; i <= DEVICES; i++)); do
+            echo "nas-$i.bench/share"
+        done
+        echo
+        echo "[behavior]"
+        echo "probe_timeout_ms=$BENCH_PROBE_TIMEOUT_MS"
+        echo "enable_notifications=false"
+    } > "$BENCH_DIR/config.conf"
+}
+
+# The mocks sleep with read -t on a FIFO instead of forking sleep, so the
+# fork count is the engine's own
+write_mocks() {
+    local bin="$BENCH_DIR/bin"
+    mkdir -p "$bin"
+    mkfifo "$BENCH_DIR/pause"
+    : > "$BENCH_DIR/mounts"
+
+    export MOCK_PAUSE="$BENCH_DIR/pause" MOCK_MOUNTS="$BENCH_DIR/mounts"
+    export MOCK_DOWN MOCK_MOUNT_FAIL MOCK_ON_BATTERY="$ON_BATTERY"
+    export MOCK_PROBE_S MOCK_PROBE_TIMEOUT_S MOCK_MOUNT_S
+    MOCK_PROBE_S=$(ms_to_seconds "$PROBE_MS")
+    MOCK_PROBE_TIMEOUT_S=$(ms_to_seconds "$BENCH_PROBE_TIMEOUT_MS")
+    MOCK_MOUNT_S=$(ms_to_seconds "$MOUNT_MS")
+
+    cat > "$bin/nmcli" << 'EOF'
+#!/bin/bash
+case "$*" in
+    *"dev wifi list"*) echo "yes:BenchWiFi" ;;
+esac
+EOF
+
+    cat > "$bin/upower" << 'EOF'
+#!/bin/bash
+case "$1" in
+    -e)
+        echo "/org/freedesktop/UPower/devices/line_power_AC"
+        echo "/org/freedesktop/UPower/devices/battery_BAT0" ;;
+    -i)
+        case "$2" in
+            *line_power*)
+                if [ "$MOCK_ON_BATTERY" = true ]; then
+                    echo "    online:              no"
+                else
+                    echo "    online:              yes"
+                fi ;;
+            *battery*) echo "    percentage:          80%" ;;
+        esac ;;
+esac
+EOF
+
+    # gio mount -l lists what earlier gio mount calls added
+    cat > "$bin/gio" << 'EOF'
+#!/bin/bash
+[ "$1" = mount ] || exit 1
+if [ "$2" = -l ]; then
+    while IFS= read -r uri; do
+        echo "Mount(0): share on ${uri#smb://} -> $uri"
+    done < "$MOCK_MOUNTS"
+    exit 0
+fi
+read -r -t "$MOCK_MOUNT_S" <> "$MOCK_PAUSE" || true
+spec="${2#smb://}"
+[[ "$MOCK_MOUNT_FAIL" == *",$spec,"* ]] && exit 2
+echo "$2/" >> "$MOCK_MOUNTS"
+EOF
+
+    # is_host_reachable runs: timeout SECONDS bash -c ': < /dev/tcp/...' _ HOST,
+    # which stands in for the probe. Anything else, such as
+    # timeout -k 5 SECONDS gio mount, runs the command without a time limit.
+    cat > "$bin/timeout" << 'EOF'
+#!/bin/bash
+[ "$1" = -k ] && shift 2
+if [ "$2" = bash ] && [ "$3" = -c ] && [[ "$4" == *"/dev/tcp/"* ]]; then
+    host="${!#}"
+    if [[ "$MOCK_DOWN" == *",$host,"* ]]; then
+        read -r -t "$MOCK_PROBE_TIMEOUT_S" <> "$MOCK_PAUSE" || true
+        exit 124
+    fi
+    read -r -t "$MOCK_PROBE_S" <> "$MOCK_PAUSE" || true
+    exit 0
+fi
+exec "${@:2}"
+EOF
+
+    chmod +x "$bin"/*
+    export PATH="$bin:$PATH"
+}
+
+# Phase samples go through a file descriptor because several of the
+# wrapped functions run inside $(...) subshells
+record() {
+    local now="${EPOCHREALTIME/./}"
+    local start="${2/./}"
+    printf '%d %s %d\n' "$CYCLE" "$1" $((10#$now - 10#$start)) >&"$SAMPLES_FD"
+}
+
+wrap() {
+    local func="$1" phase="$2"
+    eval "__bench_$func() $(declare -f "$func" | tail -n +2)"
+    eval "$func() { local __t=\$EPOCHREALTIME __rc=0; __bench_$func \"\$@\" || __rc=\$?; record $phase \$__t; return \$__rc; }"
+}
+
+load_engine() {
+    CONFIG_FILE="$BENCH_DIR/config.conf"
+    load_config > /dev/null
+
+    wrap read_current_network network
+    wrap check_home_network network
+    wrap check_power_source power
+    wrap get_battery_level power
+    wrap is_host_reachable probe
+
+    # Functions win over PATH, so this sees the gio calls the engine makes
+    # itself. Mounts run under timeout, which starts gio as a program, so
+    # they are timed around the timeout call instead.
+    gio() {
+        local t=$EPOCHREALTIME rc=0
+        command gio "$@" || rc=$?
+        if [ "${2:-}" = -l ]; then record mount_table "$t"; else record mount "$t"; fi
+        return $rc
+    }
+    timeout() {
+        local t=$EPOCHREALTIME rc=0
+        command timeout "$@" || rc=$?
+        [[ " $* " == *" gio mount smb://"* ]] && record mount "$t"
+        return $rc
+    }
+}
+
+# Same steps as one pass of the loop in main(), minus the sleep
+run_cycle() {
+    : > "$MOCK_MOUNTS"
+    for nas_device in "${NAS_DEVICES[@]}"; do
+        reset_backoff "$nas_device"
+    done
+
+    local t=$EPOCHREALTIME
+    read_current_network
+    check_home_network
+    if check_power_source; then
+        ON_AC_POWER=true
+    else
+        ON_AC_POWER=false
+    fi
+    CHECK_INTERVAL=$(determine_check_interval)
+    check_and_mount_nas || true
+    record cycle "$t"
+}
+
+# Forks are counted from the kernel's last allocated PID, which other
+# processes on the machine also advance; run on a quiet system
+last_pid() {
+    local pid=""
+    read -r pid < /proc/sys/kernel/ns_last_pid 2>/dev/null || true
+    echo "${pid:-}"
+}
+
+# Nearest-rank percentiles of one phase across cycles, in milliseconds
+summarize() {
+    local phase="$1"
+    awk -v phase="$phase" -v first="$((WARMUP + 1))" -v cycles="$((WARMUP + CYCLES))" '
+        $2 == phase { sum[$1] += $3 }
+        END { for (c = first; c <= cycles; c++) print sum[c] + 0 }' "$BENCH_DIR/samples" |
+        sort -n |
+        awk '{ v[NR] = $1 }
+            function rank(p) { i = int(p * NR / 100); if (i < p * NR / 100) i++; return v[i < 1 ? 1 : i] }
+            END { printf "%.3f,%.3f,%.3f,%.3f", rank(50) / 1000, rank(90) / 1000,
+                                                rank(99) / 1000, v[NR] / 1000 }'
+}
+
+bench_main() {
+    setup_scenario
+    write_mocks
+    load_engine
+
+    exec {SAMPLES_FD}> "$BENCH_DIR/samples"
+    local forks=0 pid_before pid_after counted=true
+    for ((CYCLE = 1; CYCLE <= WARMUP + CYCLES; CYCLE++)); do
+        pid_before=$(last_pid)
+        run_cycle > /dev/null
+        pid_after=$(last_pid)
+        if [ -z "$pid_before" ] || [ -z "$pid_after" ]; then
+            counted=false
+        elif [ "$CYCLE" -gt "$WARMUP" ]; then
+            # Less the $(last_pid) that read pid_after
+            forks=$((forks + pid_after - pid_before - 1))
+        fi
+    done
+    exec {SAMPLES_FD}>&-
+
+    local forks_per_cycle="NA"
+    $counted && forks_per_cycle=$(awk -v f="$forks" -v c="$CYCLES" 'BEGIN { printf "%.1f", f / c }')
+    local wakeups_per_hour=$((3600 / CHECK_INTERVAL))
+    local version
+    version=$(git -C "$PROJECT_ROOT" describe --always --dirty 2>/dev/null || echo unknown)
+
+    mkdir -p "$(dirname "$CSV_FILE")"
+    if [ ! -s "$CSV_FILE" ]; then
+        echo "engine,version,devices,failure_ratio,mount_failure_ratio,on_battery,cycles,phase,p50_ms,p90_ms,p99_ms,max_ms,forks_per_cycle,wakeups_per_hour" > "$CSV_FILE"
+    fi
+
+    echo "nas-monitor.sh $version: $DEVICES devices, failure ratio $FAILURE_RATIO," \
+         "mount failure ratio $MOUNT_FAILURE_RATIO, $CYCLES cycles"
+    printf '%-12s %10s %10s %10s %10s\n' phase p50_ms p90_ms p99_ms max_ms
+    local phase stats
+    for phase in "${PHASES[@]}"; do
+        stats=$(summarize "$phase")
+        printf '%-12s %10s %10s %10s %10s\n' "$phase" ${stats//,/ }
+        echo "shell,$version,$DEVICES,$FAILURE_RATIO,$MOUNT_FAILURE_RATIO,$ON_BATTERY,$CYCLES,$phase,$stats,$forks_per_cycle,$wakeups_per_hour" >> "$CSV_FILE"
+    done
+    echo "Forks per cycle: $forks_per_cycle"
+    echo "Wakeups per hour: $wakeups_per_hour (check interval ${CHECK_INTERVAL}s)"
+    echo "Results appended to $CSV_FILE"
+}
+
+# Everything but the final call to main. Sourced at the top level, since
+# declare inside a function would make the engine's arrays local to it, and
+# with set -eu off, as the engine relies on unset variables and non-zero
+# returns.
+set +eu
+# shellcheck source=/dev/null
+source <(sed '$d' "$PROJECT_ROOT/src/nas-monitor.sh")
+
+bench_main
@@ -13,7 +13,9 @@ PERFORMANCE_LOG="$TEST_LOG_DIR/performance.log"
 # Test parameters
 TEST_DURATION=60  # seconds
 SAMPLE_INTERVAL=5  # seconds
-MAX_MEMORY_MB=50   # Maximum expected memory usage
+MAX_MEMORY_MB=50   # Maximum expected memory usage of nas-monitor.sh
+MAX_NATIVE_MEMORY_MB=10  # and of nas-monitord, which runs alone
+MEMORY_BUDGET_MB=$MAX_MEMORY_MB  # whichever the service runs, see detect_engine
 MAX_CPU_PERCENT=5  # Maximum expected CPU usage
 
 # Colors
@@ -67,7 +69,7 @@ start_monitoring() {
             if [ -n "$ps_output" ]; then
                 cpu_percent=$(echo "$ps_output" | awk '{print $2}')
                 memory_percent=$(echo "$ps_output" | awk '{print $3}')
-                memory_mb=$(echo "$ps_output" | awk '{print int($4/1024)}')
+                memory_mb=$(echo "$ps_output" | awk '{printf "%.1f", $4/1024}')
                 processes=$(echo "$ps_output" | awk '{print $5}')
                 
                 # Log to CSV
@@ -79,6 +81,28 @@ start_monitoring() {
     done
 }
 
+# The unit runs either engine; nas-monitord is held to the tighter budget
+detect_engine() {
+    local pid="$1" comm=""
+    comm=$(ps -p "$pid" -o comm= 2>/dev/null || true)
+    if [ "$comm" = nas-monitord ]; then
+        RESULTS["engine"]="nas-monitord"
+        MEMORY_BUDGET_MB=$MAX_NATIVE_MEMORY_MB
+    else
+        RESULTS["engine"]="nas-monitor.sh"
+        MEMORY_BUDGET_MB=$MAX_MEMORY_MB
+    fi
+}
+
+# nas-monitord's own high-water mark, which sampling every few seconds
+# can miss; empty for the shell engine or without nc
+native_peak_memory() {
+    local socket="${XDG_RUNTIME_DIR:-/tmp}/nas-monitor.sock"
+    [ "${RESULTS[engine]:-}" = nas-monitord ] && command -v nc >/dev/null 2>&1 || return 0
+    printf 'metrics\n' | nc -U -q 1 "$socket" 2>/dev/null |
+        awk '$1 == "nas_monitor_resident_memory_peak_bytes" { printf "%.1f", $2 / 1048576 }'
+}
+
 # Test 1: Baseline resource usage
 test_baseline_resource_usage() {
     echo -e "${BLUE}Testing baseline resource usage...${NC}"
@@ -89,6 +113,7 @@ test_baseline_resource_usage() {
     # Start service
     systemctl --user start nas-monitor.service
     sleep 5  # Let it stabilize
+    detect_engine "$(systemctl --user show --property MainPID --value nas-monitor.service)"
     
     # Monitor for test duration
     start_monitoring "nas-monitor.service" "$baseline_log" &
@@ -98,6 +123,8 @@ test_baseline_resource_usage() {
     
     # Stop monitoring
     kill "$monitor_pid" 2>/dev/null || true
+    local peak_memory
+    peak_memory=$(native_peak_memory)
     systemctl --user stop nas-monitor.service
     
     # Analyze results
@@ -106,12 +133,15 @@ test_baseline_resource_usage() {
         avg_cpu=$(tail -n +2 "$baseline_log" | awk -F, '{sum+=$2} END {printf "%.2f", sum/NR}')
         avg_memory=$(tail -n +2 "$baseline_log" | awk -F, '{sum+=$3} END {printf "%.1f", sum/NR}')
         max_memory=$(tail -n +2 "$baseline_log" | awk -F, '{if($3>max) max=$3} END {print max}')
+        if [ -n "$peak_memory" ] && (( $(echo "$peak_memory > $max_memory" | bc -l) )); then
+            max_memory="$peak_memory"
+        fi
         
         RESULTS["baseline_cpu"]="$avg_cpu"
         RESULTS["baseline_memory"]="$avg_memory"
         RESULTS["max_memory"]="$max_memory"
         
-        echo -e "${GREEN}✓ Baseline test complete${NC}"
+        echo -e "${GREEN}✓ Baseline test complete (${RESULTS[engine]})${NC}"
         echo "  Average CPU: ${avg_cpu}%"
         echo "  Average Memory: ${avg_memory}MB"
         echo "  Peak Memory: ${max_memory}MB"
@@ -123,10 +153,10 @@ test_baseline_resource_usage() {
             echo -e "${RED}  CPU usage exceeds limit (${MAX_CPU_PERCENT}%)${NC}"
         fi
         
-        if (( $(echo "$max_memory < $MAX_MEMORY_MB" | bc -l) )); then
+        if (( $(echo "$max_memory < $MEMORY_BUDGET_MB" | bc -l) )); then
             echo -e "${GREEN}  Memory usage within limits${NC}"
         else
-            echo -e "${RED}  Memory usage exceeds limit (${MAX_MEMORY_MB}MB)${NC}"
+            echo -e "${RED}  Memory usage exceeds limit (${MEMORY_BUDGET_MB}MB)${NC}"
         fi
     else
         echo -e "${RED}✗ Failed to collect baseline data${NC}"
@@ -611,8 +641,8 @@ generate_performance_report() {
     fi
     
     # Check memory usage
-    if [ -n "${RESULTS[max_memory]:-}" ] && (( $(echo "${RESULTS[max_memory]} > $MAX_MEMORY_MB" | bc -l) )); then
-        echo -e "${RED}  ✗ High memory usage detected${NC}"
+    if [ -n "${RESULTS[max_memory]:-}" ] && (( $(echo "${RESULTS[max_memory]} > $MEMORY_BUDGET_MB" | bc -l) )); then
+        echo -e "${RED}  ✗ High memory usage detected (budget ${MEMORY_BUDGET_MB}MB)${NC}"
         ((issues++))
     else
         echo -e "${GREEN}  ✓ Memory usage acceptable${NC}"
@@ -151,6 +151,128 @@ test_config_parsing() {
     assert_contains "Network list contains 5G variant" 'TestWiFi-5G' "$networks_line"
 }
 
+# Test 2b: Shared config parser (libnasmon-config)
+test_config_library() {
+    log_test "Shared config parser"
+    
+    local driver="$TEST_LOG_DIR/config-check.c"
+    local binary="$TEST_LOG_DIR/config-check"
+    mkdir -p "$TEST_LOG_DIR"
+    
+    # Prints what the GUI and the daemon would both read from a file
+    cat > "$driver" << 'EOF'
+#include "monitor-config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+int main(int argc, char **argv) {
+    MonitorConfig config;
+    config_set_defaults(&config);
+    if (argc < 2 || config_load(&config, argv[1]) < 0) return 2;
+    if (argc > 2) {
+        // Prints the file with one share added and one removed
+        static char text[65536];
+        FILE *file = fopen(argv[1], "r");
+        size_t length = file ? fread(text, 1, sizeof(text) - 1, file) : 0;
+        if (file) fclose(file);
+        const char *add[] = { argv[2] };
+        const char *remove[] = { argc > 3 ? argv[3] : "" };
+        char *edited = config_edit_devices(text, length, add, 1, remove, argc > 3);
+        fputs(edited ? edited : "", stdout);
+        free(edited);
+        config_free(&config);
+        return edited ? 0 : 1;
+    }
+    printf("devices=%d networks=%d home_ac_interval=%d\n",
+           config.device_count, config.network_count, config.home_ac_interval);
+    printf("min_battery_level=%d\n", config.min_battery_level);
+    printf("max_concurrency=%d\n", config.max_concurrency);
+    printf("adaptive_schedule=%d\n", config.adaptive_schedule);
+    printf("min_check_interval=%d\n", config.min_check_interval);
+    printf("unmount_on_leave=%d\n", config.unmount_on_leave);
+    printf("unmount_on_suspend=%d\n", config.unmount_on_suspend);
+    printf("stale_mount_timeout_ms=%d\n", config.stale_mount_timeout_ms);
+    printf("mount_timeout=%d\n", config.mount_timeout);
+    for (int i = 0; i < config.device_count; i++)
+        printf("device %s mount_timeout=%d\n", config.devices[i].spec,
+               config_mount_timeout(&config, &config.devices[i]));
+    for (int i = 0; i < config.profile_count; i++) {
+        const NetworkProfile *p = &config.profiles[i];
+        printf("profile %s ssid=\"%s\" bssids=%d gateways=%d devices=%d home_ac_interval=%d"
+               " connections=%d subnets=%d\n",
+               p->name, p->ssid ? p->ssid : "(none)", p->bssid_count, p->gateway_mac_count,
+               p->device_count, p->home_ac_interval, p->connection_count, p->subnet_count);
+        for (int b = 0; b < p->bssid_count; b++) printf("  bssid %s\n", p->bssids[b]);
+    }
+    for (int i = 0; i < config.issue_count; i++)
+        printf("line %d: %s\n", config.issues[i].line, config.issues[i].message);
+    config_free(&config);
+    return 0;
+}
+EOF
+    
+    if ! assert_success "Config parser compiles without GLib" \
+        "gcc -std=c99 -Wall -Wextra -Werror -I'$PROJECT_ROOT/src' -o '$binary' '$driver' '$PROJECT_ROOT/src/monitor-config.c'"; then
+        return 0
+    fi
+    
+    local output
+    output=$("$binary" "$TEST_CONFIG_DIR/valid-basic.conf")
+    assert_contains "Valid config parses devices and networks" 'devices=1 networks=3 home_ac_interval=30' "$output"
+    assert_contains "Adaptive schedule is off by default" '^adaptive_schedule=0$' "$output"
+    assert_contains "Adaptive schedule has a default floor" '^min_check_interval=5$' "$output"
+    assert_contains "Leaving the network unmounts by default" '^unmount_on_leave=1$' "$output"
+    assert_contains "Suspending unmounts by default" '^unmount_on_suspend=1$' "$output"
+    assert_contains "Stale mount timeout defaults to 2s" '^stale_mount_timeout_ms=2000$' "$output"
+    assert_contains "Mount timeout defaults to 30s" '^mount_timeout=30$' "$output"
+    assert_failure "Valid config reports no issues" "'$binary' '$TEST_CONFIG_DIR/valid-basic.conf' | grep -q '^line'"
+    
+    output=$("$binary" "$TEST_CONFIG_DIR/valid-adaptive.conf")
+    assert_contains "Adaptive schedule can be turned on" '^adaptive_schedule=1$' "$output"
+    assert_contains "Adaptive schedule floor can be raised" '^min_check_interval=10$' "$output"
+    
+    output=$("$binary" "$TEST_CONFIG_DIR/valid-timeouts.conf")
+    assert_contains "Share without an entry uses mount_timeout" \
+        '^device test-nas.local/home mount_timeout=20$' "$output"
+    assert_contains "[mount_timeouts] entry overrides mount_timeout" \
+        '^device backup-nas.local/archive mount_timeout=120$' "$output"
+    assert_contains "[mount_timeouts] entry for an unlisted share is reported" \
+        'line 14: mount_timeouts: "retired-nas.local/old" is not in \[nas_devices\]' "$output"
+    
+    output=$("$binary" "$TEST_CONFIG_DIR/invalid-config.conf")
+    assert_contains "Invalid value reported with its line number" 'line 8: home_ac_interval' "$output"
+    assert_contains "Invalid value keeps the default" 'home_ac_interval=15' "$output"
+    
+    # Each key has its own range: a percentage may be 0, a count stays small
+    printf '[behavior]\nmin_battery_level=0\nmax_concurrency=86400\n' > "$TEST_LOG_DIR/ranges.conf"
+    output=$("$binary" "$TEST_LOG_DIR/ranges.conf")
+    assert_contains "Battery cutoff of 0 is accepted" '^min_battery_level=0$' "$output"
+    assert_contains "Out-of-range value reports the key's own range" \
+        'line 3: max_concurrency: expected a number from 1 to 64, got "86400"' "$output"
+    assert_contains "Out-of-range value keeps the default" '^max_concurrency=4$' "$output"
+    rm -f "$TEST_LOG_DIR/ranges.conf"
+    
+    output=$("$binary" "$TEST_CONFIG_DIR/valid-profiles.conf")
+    assert_contains "Profile keeps its devices and interval override" \
+        'profile lab ssid="eduroam" bssids=2 gateways=0 devices=1 home_ac_interval=30' "$output"
+    assert_contains "BSSIDs are normalised to lowercase with colons" 'bssid aa:bb:cc:dd:ee:02' "$output"
+    assert_contains "Empty ssid is a wired profile" 'profile dock ssid="" bssids=0 gateways=1 devices=1' "$output"
+    assert_contains "Profile device missing from [nas_devices] is reported" \
+        '"retired-nas.local/old" is not in \[nas_devices\]' "$output"
+    assert_contains "VPN connection alone identifies a profile" \
+        'profile office-vpn ssid="(none)" .* connections=1 subnets=0' "$output"
+    assert_contains "Subnet list identifies a profile" \
+        'profile home-lan ssid="(none)" .* connections=0 subnets=2' "$output"
+    
+    output=$("$binary" "$TEST_CONFIG_DIR/valid-basic.conf" new-nas.local/media test-nas.local/home)
+    assert_contains "Device batch edits [nas_devices] and keeps the rest" \
+        'home_networks=TestWiFi.*new-nas.local/media' "$(tr '\n' ' ' <<< "$output")"
+    assert_failure "Device batch drops removed shares" \
+        "'$binary' '$TEST_CONFIG_DIR/valid-basic.conf' new-nas.local/media test-nas.local/home | grep -qx 'test-nas.local/home'"
+    
+    rm -f "$driver" "$binary"
+}
+
 # Test 3: Power source detection simulation
 test_power_detection() {
     log_test "Power source detection logic"
@@ -278,7 +400,7 @@ test_gui_compilation() {
         # Check if GTK development files are available
         if pkg-config --exists gtk+-3.0; then
             local test_binary="$TEST_LOG_DIR/test-gui"
-            local compile_cmd="gcc -std=c99 -o '$test_binary' '$gui_source' $(pkg-config --cflags --libs gtk+-3.0)"
+            local compile_cmd="gcc -std=c99 -o '$test_binary' '$gui_source' '$PROJECT_ROOT/src/monitor-config.c' $(pkg-config --cflags --libs gtk+-3.0)"
             
             assert_success "GUI compilation" "$compile_cmd"
             
@@ -292,6 +414,118 @@ test_gui_compilation() {
     fi
 }
 
+# Test 7b: Native daemon compilation
+test_native_daemon_compilation() {
+    log_test "Native daemon compilation test"
+    
+    local daemon_source="$PROJECT_ROOT/src/nas-monitord.c"
+    
+    if [ -f "$daemon_source" ]; then
+        if pkg-config --exists gio-2.0; then
+            local test_binary="$TEST_LOG_DIR/test-nas-monitord"
+            local compile_cmd="gcc -std=c99 -o '$test_binary' '$daemon_source' '$PROJECT_ROOT'/src/monitor-*.c $(pkg-config --cflags --libs gio-2.0)"
+            
+            assert_success "Native daemon compilation" "$compile_cmd"
+            assert_success "Native daemon reports version" "'$test_binary' --version"
+            
+            # Clean up test binary
+            [ -f "$test_binary" ] && rm -f "$test_binary"
+        else
+            echo -e "${YELLOW}⚠ SKIP: GIO development files not available${NC}"
+        fi
+    else
+        echo -e "${YELLOW}⚠ SKIP: Native daemon source not found at $daemon_source${NC}"
+    fi
+}
+
+# Test 7b2: Forced unmounts time out
+test_unmount_timeout() {
+    log_test "Unmount timeout"
+
+    if ! pkg-config --exists gio-2.0; then
+        echo -e "${YELLOW}⚠ SKIP: GIO development files not available${NC}"
+        return 0
+    fi
+
+    local driver="$TEST_LOG_DIR/unmount-check.c"
+    local binary="$TEST_LOG_DIR/unmount-check"
+    mkdir -p "$TEST_LOG_DIR"
+
+    # A mount whose unmount only ends once it is cancelled, like gvfsd
+    # waiting on a server that has gone away
+    cat > "$driver" << 'EOF'
+#include "monitor-log.h"
+#include "monitor-mount.h"
+#include <stdio.h>
+typedef struct { GObject parent; } HungMount;
+typedef struct { GObjectClass parent_class; } HungMountClass;
+static void hung_mount_iface_init(GMountIface *iface);
+G_DEFINE_TYPE_WITH_CODE(HungMount, hung_mount, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_MOUNT, hung_mount_iface_init))
+static void hung_mount_init(HungMount *self) { (void)self; }
+static void hung_mount_class_init(HungMountClass *klass) { (void)klass; }
+static GFile *get_root(GMount *mount) {
+    (void)mount;
+    return g_file_new_for_uri("smb://nas.local/share/");
+}
+static void wait_for_cancel(GTask *task, gpointer source, gpointer data, GCancellable *cancellable) {
+    (void)source; (void)data;
+    while (!g_cancellable_is_cancelled(cancellable)) g_usleep(10000);
+    g_task_return_error_if_cancelled(task);
+}
+static void unmount(GMount *mount, GMountUnmountFlags flags, GMountOperation *operation,
+                    GCancellable *cancellable, GAsyncReadyCallback callback, gpointer data) {
+    (void)flags; (void)operation;
+    GTask *task = g_task_new(mount, cancellable, callback, data);
+    g_task_run_in_thread(task, wait_for_cancel);
+    g_object_unref(task);
+}
+static gboolean unmount_finish(GMount *mount, GAsyncResult *result, GError **error) {
+    (void)mount;
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+static void hung_mount_iface_init(GMountIface *iface) {
+    iface->get_root = get_root;
+    iface->unmount_with_operation = unmount;
+    iface->unmount_with_operation_finish = unmount_finish;
+}
+static void on_done(bool success, gpointer user_data) { *(int *)user_data = success; }
+int main(void) {
+    monitor_log_open("-");
+    GMount *mount = g_object_new(hung_mount_get_type(), NULL);
+    int result = -1;
+    mount_unmount_async(mount, 200, on_done, &result);
+    while (result < 0) g_main_context_iteration(NULL, TRUE);
+    monitor_log_flush();
+    printf("success=%d\n", result);
+    g_object_unref(mount);
+    return 0;
+}
+EOF
+
+    local compile_cmd="gcc -std=c99 -I'$PROJECT_ROOT/src' -o '$binary' '$driver' '$PROJECT_ROOT/src/monitor-mount.c' '$PROJECT_ROOT/src/monitor-log.c' '$PROJECT_ROOT/src/monitor-config.c' $(pkg-config --cflags --libs gio-2.0)"
+    if assert_success "Unmount check driver compiles" "$compile_cmd"; then
+        local output
+        output=$(timeout 10 "$binary" 2>&1)
+        assert_contains "Hung unmount is reported as failed" '^success=0$' "$output"
+        assert_contains "Hung unmount is logged as timed out" \
+            'Unmounting nas.local/share timed out after 200ms' "$output"
+    fi
+    rm -f "$driver" "$binary"
+}
+
+# Test 7c: Control client
+test_control_client() {
+    log_test "Control client compilation test"
+
+    local test_binary="$TEST_LOG_DIR/test-nas-monitorctl"
+    assert_success "Control client compiles without GLib or GTK" \
+        "gcc -std=c99 -Wall -Wextra -Werror -o '$test_binary' '$PROJECT_ROOT/src/nas-monitorctl.c'"
+    assert_failure "Control client reports a missing daemon" \
+        "'$test_binary' --socket '$TEST_LOG_DIR/no-such.sock' status 2>/dev/null"
+    rm -f "$test_binary"
+}
+
 # Test 8: systemd service file validation
 test_systemd_service() {
     log_test "systemd service file validation"
@@ -310,6 +544,61 @@ test_systemd_service() {
     else
         echo -e "${YELLOW}⚠ SKIP: Service file not found at $service_file${NC}"
     fi
+
+    local socket_file="$PROJECT_ROOT/systemd/nas-monitor.socket"
+    if [ -f "$socket_file" ]; then
+        assert_contains "Socket unit listens where the daemon binds" \
+            'ListenStream=%t/nas-monitor.sock' "$(cat "$socket_file")"
+    fi
+}
+
+# Test 8b: Single-instance lock
+test_instance_lock() {
+    log_test "Single-instance lock"
+
+    local daemon_script="$PROJECT_ROOT/src/nas-monitor.sh"
+    local lock_script="$TEST_LOG_DIR/check-lock.sh"
+    {
+        echo "LOCK_FILE='$TEST_LOG_DIR/nas-monitor.lock'"
+        sed -n '/^check_lock() {/,/^}/p' "$daemon_script"
+        echo 'check_lock; echo "locked by $$"; [ -z "$1" ] || sleep "$1"'
+    } > "$lock_script"
+
+    bash "$lock_script" 2 > /dev/null &
+    local holder=$!
+    sleep 0.5
+    assert_contains "Second instance is refused while the lock is held" \
+        "already running (PID: $holder)" "$(bash "$lock_script")"
+    wait "$holder"
+    assert_contains "Lock is free again once its holder exits" \
+        'locked by' "$(bash "$lock_script")"
+    rm -f "$lock_script" "$TEST_LOG_DIR/nas-monitor.lock"
+}
+
+# Test 8c: Shell config loading and reload
+test_shell_reload() {
+    log_test "Shell config loading and reload"
+
+    local daemon_script="$PROJECT_ROOT/src/nas-monitor.sh"
+    local config="$TEST_LOG_DIR/reload.conf"
+    local output
+    printf '[nas_devices]\nnas.local/share\n\n[behavior]\nprobe_timeout_ms=900\n' > "$config"
+    # Everything but the final call to main; the second config drops the key
+    output=$(bash -c 'source <(sed "\$d" "$1"); CONFIG_FILE="$2"
+        load_config; echo "before=$PROBE_TIMEOUT_MS"
+        printf "[nas_devices]\nnas.local/share\n" > "$2"
+        reload_config; echo "after=$PROBE_TIMEOUT_MS"' _ "$daemon_script" "$config")
+    assert_contains "Reload reads the file" '^before=900$' "$output"
+    assert_contains "Key removed from the file is back to its default" '^after=500$' "$output"
+    rm -f "$config"
+    
+    # Profiles are nas-monitord's; their keys must not leak into [intervals]
+    output=$(bash -c 'source <(sed "\$d" "$1"); CONFIG_FILE="$2"
+        load_config; echo "home_ac_interval=$HOME_AC_INTERVAL"' _ "$daemon_script" \
+        "$TEST_CONFIG_DIR/valid-profiles.conf")
+    assert_contains "Shell fallback warns about profile sections" \
+        'Ignoring \[profile:lab\]: network profiles need nas-monitord' "$output"
+    assert_contains "Profile keys do not override global settings" '^home_ac_interval=15$' "$output"
 }
 
 # Test 9: File permissions
@@ -340,7 +629,7 @@ test_dependencies() {
     log_test "System dependencies check"
     
     # Check for required commands
-    local required_commands=("bash" "systemctl" "gio")
+    local required_commands=("bash" "systemctl" "gio" "flock")
     for cmd in "${required_commands[@]}"; do
         if command -v "$cmd" >/dev/null 2>&1; then
             echo -e "${GREEN}✓ PASS: Required command available: $cmd${NC}"
@@ -375,12 +664,18 @@ run_all_tests() {
     
     test_script_syntax || true
     test_config_parsing || true
+    test_config_library || true
     test_power_detection || true 
     test_network_validation || true 
     test_nas_device_validation || true 
     test_interval_validation || true 
     test_gui_compilation || true 
+    test_native_daemon_compilation || true 
+    test_unmount_timeout || true
+    test_control_client || true
     test_systemd_service || true 
+    test_instance_lock || true
+    test_shell_reload || true
     test_file_permissions || true 
     test_dependencies || true 
     